@@ -115,12 +115,103 @@ int docmd_chs(arg_struct *arg) {
     return ERR_NONE;
 }
 
+/* Fast path for +, -, *, and / when X and Y are both real or complex.
+ * The result is computed with the same operators map_binary() uses, but
+ * instead of allocating a new object for it, it is written into whichever of
+ * the old Y and LASTX objects has the right type; both of those are about to
+ * be discarded, and reals and complex numbers are never shared, so they can
+ * be overwritten safely. The other one is reused for the copy of T that goes
+ * into Z, when the types allow it.
+ * Returns false if the operands aren't both scalars, in which case the caller
+ * should fall back on the generic code; otherwise, returns true and sets
+ * *error.
+ */
+static bool scalar_binary(mappable_rr mrr, mappable_rc mrc,
+                          mappable_cr mcr, mappable_cc mcc, int *error) {
+    int xt = reg_x->type;
+    int yt = reg_y->type;
+    if (xt != TYPE_REAL && xt != TYPE_COMPLEX
+            || yt != TYPE_REAL && yt != TYPE_COMPLEX)
+        return false;
+
+    phloat re, im;
+    int type;
+    if (xt == TYPE_REAL) {
+        vartype_real *x = (vartype_real *) reg_x;
+        if (yt == TYPE_REAL) {
+            *error = mrr(x->x, ((vartype_real *) reg_y)->x, &re);
+            type = TYPE_REAL;
+        } else {
+            vartype_complex *y = (vartype_complex *) reg_y;
+            *error = mrc(x->x, y->re, y->im, &re, &im);
+            type = TYPE_COMPLEX;
+        }
+    } else {
+        vartype_complex *x = (vartype_complex *) reg_x;
+        if (yt == TYPE_REAL)
+            *error = mcr(x->re, x->im, ((vartype_real *) reg_y)->x, &re, &im);
+        else {
+            vartype_complex *y = (vartype_complex *) reg_y;
+            *error = mcc(x->re, x->im, y->re, y->im, &re, &im);
+        }
+        type = TYPE_COMPLEX;
+    }
+    if (*error != ERR_NONE)
+        return true;
+
+    vartype *res, *spare;
+    if (reg_y->type == type) {
+        res = reg_y;
+        spare = reg_lastx;
+    } else if (reg_lastx != NULL && reg_lastx->type == type) {
+        res = reg_lastx;
+        spare = reg_y;
+    } else {
+        res = type == TYPE_REAL ? new_real(re) : new_complex(re, im);
+        if (res == NULL)
+            *error = ERR_INSUFFICIENT_MEMORY;
+        else
+            binary_result(res);
+        return true;
+    }
+    if (type == TYPE_REAL)
+        ((vartype_real *) res)->x = re;
+    else {
+        ((vartype_complex *) res)->re = re;
+        ((vartype_complex *) res)->im = im;
+    }
+
+    /* Same stack shuffle as binary_result() */
+    reg_lastx = reg_x;
+    reg_x = res;
+    reg_y = reg_z;
+    if (spare != NULL && spare->type == reg_t->type
+            && (spare->type == TYPE_REAL || spare->type == TYPE_COMPLEX)) {
+        if (spare->type == TYPE_REAL)
+            ((vartype_real *) spare)->x = ((vartype_real *) reg_t)->x;
+        else {
+            ((vartype_complex *) spare)->re = ((vartype_complex *) reg_t)->re;
+            ((vartype_complex *) spare)->im = ((vartype_complex *) reg_t)->im;
+        }
+        reg_z = spare;
+    } else {
+        free_vartype(spare);
+        reg_z = dup_vartype(reg_t);
+    }
+    if (flags.f.trace_print && flags.f.printer_exists)
+        docmd_prx(NULL);
+    return true;
+}
+
 static void docmd_div_completion(int error, vartype *res) {
     if (error == ERR_NONE)
         binary_result(res);
 }
 
 int docmd_div(arg_struct *arg) {
+    int error;
+    if (scalar_binary(div_rr, div_rc, div_cr, div_cc, &error))
+        return error;
     return generic_div(reg_x, reg_y, docmd_div_completion);
 }
 
@@ -130,12 +221,18 @@ static void docmd_mul_completion(int error, vartype *res) {
 }
 
 int docmd_mul(arg_struct *arg) {
+    int error;
+    if (scalar_binary(mul_rr, mul_rc, mul_cr, mul_cc, &error))
+        return error;
     return generic_mul(reg_x, reg_y, docmd_mul_completion);
 }
 
 int docmd_sub(arg_struct *arg) {
     vartype *res;
-    int error = generic_sub(reg_x, reg_y, &res);
+    int error;
+    if (scalar_binary(sub_rr, sub_rc, sub_cr, sub_cc, &error))
+        return error;
+    error = generic_sub(reg_x, reg_y, &res);
     if (error == ERR_NONE)
         binary_result(res);
     return error;
@@ -143,7 +240,10 @@ int docmd_sub(arg_struct *arg) {
 
 int docmd_add(arg_struct *arg) {
     vartype *res;
-    int error = generic_add(reg_x, reg_y, &res);
+    int error;
+    if (scalar_binary(add_rr, add_rc, add_cr, add_cc, &error))
+        return error;
+    error = generic_add(reg_x, reg_y, &res);
     if (error == ERR_NONE)
         binary_result(res);
     return error;
@@ -352,7 +452,7 @@ int docmd_rcl(arg_struct *arg) {
 }
 
 /* Temporary for use by docmd_rcl_div() & docmd_rcl_mul() */
-static vartype *temp_v;
+static CORE_TLS vartype *temp_v;
 
 static void docmd_rcl_div_completion(int error, vartype *res) {
     free_vartype(temp_v);
@@ -648,7 +748,7 @@ int docmd_rdxcomma(arg_struct *arg) {
 }
 
 int docmd_clsigma(arg_struct *arg) {
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     vartype_realmatrix *r;
     int4 first = mode_sigma_reg;
     int4 last = first + (flags.f.all_sigma ? 13 : 6);
@@ -710,7 +810,7 @@ int docmd_clst(arg_struct *arg) {
 }
 
 int docmd_clrg(arg_struct *arg) {
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     if (regs == NULL)
         return ERR_NONEXISTENT;
     if (regs->type == TYPE_REALMATRIX) {
@@ -1156,7 +1256,7 @@ int docmd_fp(arg_struct *arg) {
         return ERR_INVALID_TYPE;
 }
 
-static phloat rnd_multiplier;
+static CORE_TLS_PHLOAT phloat rnd_multiplier;
 
 static int mappable_rnd_r(phloat x, phloat *y) {
     if (flags.f.fix_or_all) {
@@ -674,7 +674,7 @@ static int generic_loop(arg_struct *arg, bool isg) {
     }
     switch (arg->type) {
         case ARGTYPE_NUM: {
-            vartype *regs = recall_var("REGS", 4);
+            vartype *regs = recall_regs();
             if (regs == NULL)
                 return ERR_SIZE_ERROR;
             else if (regs->type == TYPE_REALMATRIX) {
@@ -1189,7 +1189,7 @@ static const sigma_label_spec sigma_labels[] = {
 };
 
 int docmd_prsigma(arg_struct *arg) {
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     vartype_realmatrix *rm;
     int nr;
     int4 size, max, i;
@@ -1248,8 +1248,8 @@ int docmd_prp(arg_struct *arg) {
     return print_program(prgm_index, -1, -1, 0);
 }
 
-static vartype *prv_var;
-static int4 prv_index;
+static CORE_TLS vartype *prv_var;
+static CORE_TLS int4 prv_index;
 static int prv_worker(int interrupted);
 
 int docmd_prv(arg_struct *arg) {
@@ -1433,8 +1433,8 @@ int docmd_prx(arg_struct *arg) {
     }
 }
 
-static int prusr_state;
-static int prusr_index;
+static CORE_TLS int prusr_state;
+static CORE_TLS int prusr_index;
 static int prusr_worker(int interrupted);
 
 int docmd_prusr(arg_struct *arg) {
@@ -1616,14 +1616,27 @@ int docmd_gto(arg_struct *arg) {
 
     if (arg->type == ARGTYPE_IND_NUM || arg->type == ARGTYPE_IND_STK
             || arg->type == ARGTYPE_IND_STR) {
+        ind_cache_struct *c = ind_cache;
         int err = resolve_ind_arg(arg);
         if (err != ERR_NONE)
             return err;
+        if (c != NULL && c->target_gen == lookup_generation) {
+            /* Same pointer value as last time, and no labels have changed */
+            current_prgm = c->target_prgm;
+            pc = c->target_pc;
+            prgm_highlight_row = 1;
+            return ERR_NONE;
+        }
         if (arg->type == ARGTYPE_NUM) {
             int4 target_pc = find_local_label(arg);
             if (target_pc == -2)
                 return ERR_LABEL_NOT_FOUND;
             else {
+                if (c != NULL) {
+                    c->target_prgm = current_prgm;
+                    c->target_pc = target_pc;
+                    c->target_gen = lookup_generation;
+                }
                 pc = target_pc;
                 prgm_highlight_row = 1;
                 return ERR_NONE;
@@ -1632,6 +1645,11 @@ int docmd_gto(arg_struct *arg) {
             int newprgm;
             int4 newpc;
             if (find_global_label(arg, &newprgm, &newpc)) {
+                if (c != NULL) {
+                    c->target_prgm = newprgm;
+                    c->target_pc = newpc;
+                    c->target_gen = lookup_generation;
+                }
                 current_prgm = newprgm;
                 pc = newpc;
                 prgm_highlight_row = 1;
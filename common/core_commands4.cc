@@ -1238,7 +1238,7 @@ int docmd_percent_ch(arg_struct *arg) {
     return ERR_NONE;
 }
 
-static vartype *matx_v;
+static CORE_TLS vartype *matx_v;
 
 static void matx_completion(int error, vartype *res) {
     if (error != ERR_NONE) {
@@ -376,7 +376,7 @@ int docmd_basechs(arg_struct *arg) {
     return ERR_NONE;
 }
 
-static struct sum_struct {
+static CORE_TLS_PHLOAT struct sum_struct {
     phloat x;
     phloat x2;
     phloat y;
@@ -397,7 +397,7 @@ static int get_summation() {
     int4 first = mode_sigma_reg;
     int4 last = first + (flags.f.all_sigma ? 13 : 6);
     int4 size, i;
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     vartype_realmatrix *r;
     phloat *sigmaregs;
     if (regs == NULL)
@@ -430,7 +430,7 @@ static int get_summation() {
     return ERR_NONE;
 }
     
-static struct model_struct {
+static CORE_TLS_PHLOAT struct model_struct {
     phloat x;
     phloat x2;
     phloat y;
@@ -1274,7 +1274,7 @@ static int sigma_helper_1(int weight) {
     int4 first = mode_sigma_reg;
     int4 last = first + (flags.f.all_sigma ? 13 : 6);
     int4 size, i;
-    vartype *regs = recall_var("REGS", 4);
+    vartype *regs = recall_regs();
     vartype_realmatrix *r;
     phloat *sigmaregs;
     if (regs == NULL)
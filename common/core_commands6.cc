@@ -37,6 +37,20 @@ static int mappable_sin_r(phloat x, phloat *y) {
     return ERR_NONE;
 }
 
+static int mappable_sin_ra(const phloat *x, phloat *y, int4 n) {
+    int4 i;
+    if (flags.f.rad)
+        for (i = 0; i < n; i++)
+            y[i] = sin(x[i]);
+    else if (flags.f.grad)
+        for (i = 0; i < n; i++)
+            y[i] = sin_grad(x[i]);
+    else
+        for (i = 0; i < n; i++)
+            y[i] = sin_deg(x[i]);
+    return ERR_NONE;
+}
+
 static int mappable_sin_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
     /* NOTE: DEG/RAD/GRAD mode does not apply here. */
     if (xim == 0) {
@@ -74,7 +88,8 @@ static int mappable_sin_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
 int docmd_sin(arg_struct *arg) {
     if (reg_x->type != TYPE_STRING) {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_sin_r, mappable_sin_c);
+        int err = map_unary(reg_x, &v, mappable_sin_r, mappable_sin_c,
+                            mappable_sin_ra);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -92,6 +107,20 @@ static int mappable_cos_r(phloat x, phloat *y) {
     return ERR_NONE;
 }
 
+static int mappable_cos_ra(const phloat *x, phloat *y, int4 n) {
+    int4 i;
+    if (flags.f.rad)
+        for (i = 0; i < n; i++)
+            y[i] = cos(x[i]);
+    else if (flags.f.grad)
+        for (i = 0; i < n; i++)
+            y[i] = cos_grad(x[i]);
+    else
+        for (i = 0; i < n; i++)
+            y[i] = cos_deg(x[i]);
+    return ERR_NONE;
+}
+
 static int mappable_cos_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
     /* NOTE: DEG/RAD/GRAD mode does not apply here. */
     if (xim == 0) {
@@ -136,7 +165,8 @@ static int mappable_cos_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
 int docmd_cos(arg_struct *arg) {
     if (reg_x->type != TYPE_STRING) {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_cos_r, mappable_cos_c);
+        int err = map_unary(reg_x, &v, mappable_cos_r, mappable_cos_c,
+                            mappable_cos_ra);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -375,6 +405,16 @@ static int mappable_log_r(phloat x, phloat *y) {
     }
 }
 
+static int mappable_log_ra(const phloat *x, phloat *y, int4 n) {
+    int4 i;
+    for (i = 0; i < n; i++)
+        if (x[i] <= 0)
+            return ERR_INVALID_DATA;
+    for (i = 0; i < n; i++)
+        y[i] = log10(x[i]);
+    return ERR_NONE;
+}
+
 static int mappable_log_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
     if (xim == 0) {
         if (xre == 0)
@@ -439,7 +479,8 @@ int docmd_log(arg_struct *arg) {
         }
     } else {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_log_r, mappable_log_c);
+        int err = map_unary(reg_x, &v, mappable_log_r, mappable_log_c,
+                            mappable_log_ra);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -456,6 +497,12 @@ static int mappable_10_pow_x_r(phloat x, phloat *y) {
     return ERR_NONE;
 }
 
+static int mappable_10_pow_x_ra(const phloat *x, phloat *y, int4 n) {
+    for (int4 i = 0; i < n; i++)
+        y[i] = pow(10, x[i]);
+    return range_check_array(y, n);
+}
+
 static int mappable_10_pow_x_c(phloat xre, phloat xim, phloat *yre, phloat *yim){
     int inf;
     phloat h;
@@ -491,7 +538,8 @@ int docmd_10_pow_x(arg_struct *arg) {
     if (reg_x->type != TYPE_STRING) {
         vartype *v;
         int err = map_unary(reg_x, &v, mappable_10_pow_x_r,
-                                       mappable_10_pow_x_c);
+                                       mappable_10_pow_x_c,
+                                       mappable_10_pow_x_ra);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -508,6 +556,16 @@ static int mappable_ln_r(phloat x, phloat *y) {
     }
 }
 
+static int mappable_ln_ra(const phloat *x, phloat *y, int4 n) {
+    int4 i;
+    for (i = 0; i < n; i++)
+        if (x[i] <= 0)
+            return ERR_INVALID_DATA;
+    for (i = 0; i < n; i++)
+        y[i] = log(x[i]);
+    return ERR_NONE;
+}
+
 static int mappable_ln_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
     if (xim == 0) {
         if (xre == 0)
@@ -572,7 +630,8 @@ int docmd_ln(arg_struct *arg) {
         }
     } else {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_ln_r, mappable_ln_c);
+        int err = map_unary(reg_x, &v, mappable_ln_r, mappable_ln_c,
+                            mappable_ln_ra);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -589,6 +648,12 @@ static int mappable_e_pow_x_r(phloat x, phloat *y) {
     return ERR_NONE;
 }
 
+static int mappable_e_pow_x_ra(const phloat *x, phloat *y, int4 n) {
+    for (int4 i = 0; i < n; i++)
+        y[i] = exp(x[i]);
+    return range_check_array(y, n);
+}
+
 static int mappable_e_pow_x_c(phloat xre, phloat xim, phloat *yre, phloat *yim){
     phloat h = exp(xre);
     int inf = p_isinf(h);
@@ -619,7 +684,8 @@ static int mappable_e_pow_x_c(phloat xre, phloat xim, phloat *yre, phloat *yim){
 int docmd_e_pow_x(arg_struct *arg) {
     if (reg_x->type != TYPE_STRING) {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_e_pow_x_r, mappable_e_pow_x_c);
+        int err = map_unary(reg_x, &v, mappable_e_pow_x_r, mappable_e_pow_x_c,
+                            mappable_e_pow_x_ra);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -636,6 +702,16 @@ static int mappable_sqrt_r(phloat x, phloat *y) {
     }
 }
 
+static int mappable_sqrt_ra(const phloat *x, phloat *y, int4 n) {
+    int4 i;
+    for (i = 0; i < n; i++)
+        if (x[i] < 0)
+            return ERR_INVALID_DATA;
+    for (i = 0; i < n; i++)
+        y[i] = sqrt(x[i]);
+    return ERR_NONE;
+}
+
 static int mappable_sqrt_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
     if (xre == 0 && xim == 0) {
         *yre = 0;
@@ -688,7 +764,8 @@ int docmd_sqrt(arg_struct *arg) {
         return ERR_ALPHA_DATA_IS_INVALID;
     } else {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_sqrt_r, mappable_sqrt_c);
+        int err = map_unary(reg_x, &v, mappable_sqrt_r, mappable_sqrt_c,
+                            mappable_sqrt_ra);
         if (err != ERR_NONE)
             return err;
         unary_result(v);
@@ -709,6 +786,12 @@ static int mappable_square_r(phloat x, phloat *y) {
     return ERR_NONE;
 }
 
+static int mappable_square_ra(const phloat *x, phloat *y, int4 n) {
+    for (int4 i = 0; i < n; i++)
+        y[i] = x[i] * x[i];
+    return range_check_array(y, n);
+}
+
 static int mappable_square_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
     phloat rre = xre * xre - xim * xim;
     phloat rim = 2 * xre * xim;
@@ -735,7 +818,8 @@ int docmd_square(arg_struct *arg) {
         return ERR_ALPHA_DATA_IS_INVALID;
     else {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_square_r, mappable_square_c);
+        int err = map_unary(reg_x, &v, mappable_square_r, mappable_square_c,
+                            mappable_square_ra);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -755,6 +839,20 @@ static int mappable_inv_r(phloat x, phloat *y) {
     return ERR_NONE;
 }
 
+static int mappable_inv_ra(const phloat *x, phloat *y, int4 n) {
+    int4 i, k;
+    int err;
+    for (k = 0; k < n; k++)
+        if (x[k] == 0)
+            break;
+    for (i = 0; i < k; i++)
+        y[i] = 1 / x[i];
+    err = range_check_array(y, k);
+    if (err != ERR_NONE)
+        return err;
+    return k < n ? ERR_DIVIDE_BY_0 : ERR_NONE;
+}
+
 static int mappable_inv_c(phloat xre, phloat xim, phloat *yre, phloat *yim) {
     int inf;
     phloat h = hypot(xre, xim);
@@ -780,7 +878,8 @@ int docmd_inv(arg_struct *arg) {
         return ERR_ALPHA_DATA_IS_INVALID;
     else {
         vartype *v;
-        int err = map_unary(reg_x, &v, mappable_inv_r, mappable_inv_c);
+        int err = map_unary(reg_x, &v, mappable_inv_r, mappable_inv_c,
+                            mappable_inv_ra);
         if (err == ERR_NONE)
             unary_result(v);
         return err;
@@ -521,25 +521,30 @@ static char smallchars_map[128] =
 
 
 
-static char display[272];
+static CORE_TLS char display[272];
 
-static int is_dirty = 0;
-static int dirty_top, dirty_left, dirty_bottom, dirty_right;
+static CORE_TLS int is_dirty = 0;
+static CORE_TLS int dirty_top, dirty_left, dirty_bottom, dirty_right;
+/* While set, display updates are accumulated, not sent to the shell */
+static CORE_TLS bool display_held = false;
 
-static int catalogmenu_section[5];
-static int catalogmenu_rows[5];
-static int catalogmenu_row[5];
-static int catalogmenu_item[5][6];
+static CORE_TLS int catalogmenu_section[5];
+static CORE_TLS int catalogmenu_rows[5];
+static CORE_TLS int catalogmenu_row[5];
+static CORE_TLS int catalogmenu_item[5][6];
+/* Set when variables or programs have changed since the catalog menu was
+ * last brought up to date; see mark_catalog_dirty() */
+static CORE_TLS bool catalog_dirty = false;
 
-static int custommenu_length[3][6];
-static char custommenu_label[3][6][7];
+static CORE_TLS int custommenu_length[3][6];
+static CORE_TLS char custommenu_label[3][6][7];
 
-static arg_struct progmenu_arg[9];
-static int progmenu_is_gto[9];
-static int progmenu_length[6];
-static char progmenu_label[6][7];
+static CORE_TLS_PHLOAT arg_struct progmenu_arg[9];
+static CORE_TLS int progmenu_is_gto[9];
+static CORE_TLS int progmenu_length[6];
+static CORE_TLS char progmenu_label[6][7];
 
-static int appmenu_exitcallback;
+static CORE_TLS int appmenu_exitcallback;
 
 
 /*******************************/
@@ -552,6 +557,7 @@ static int get_cat_index();
 
 
 bool persist_display() {
+    refresh_catalog();
     for (int i = 0; i < 5; i++) {
         if (!write_int(catalogmenu_section[i])) return false;
         if (!write_int(catalogmenu_rows[i])) return false;
@@ -693,7 +699,7 @@ void clear_display() {
 }
 
 void flush_display() {
-    if (!is_dirty)
+    if (!is_dirty || display_held)
         return;
     shell_blitter(display, 17, dirty_left, dirty_top,
                     dirty_right - dirty_left, dirty_bottom - dirty_top);
@@ -701,9 +707,19 @@ void flush_display() {
 }
 
 void repaint_display() {
+    if (display_held) {
+        mark_dirty(0, 0, 16, 131);
+        return;
+    }
     shell_blitter(display, 17, 0, 0, 131, 16);
 }
 
+void hold_display(bool hold) {
+    display_held = hold;
+    if (!hold)
+        flush_display();
+}
+
 void draw_pixel(int x, int y) {
     display[y * 17 + (x >> 3)] |= 1 << (x & 7);
     mark_dirty(y, x, y + 1, x + 1);
@@ -781,7 +797,7 @@ void draw_pattern(phloat dx, phloat dy, const char *pattern, int pattern_width){
 }
 
 void fly_goose() {
-    static uint4 lastgoosetime = 0;
+    static CORE_TLS uint4 lastgoosetime = 0;
     uint4 goosetime = shell_milliseconds();
     if (goosetime < lastgoosetime)
         // shell_millisends() wrapped around
@@ -1917,6 +1933,7 @@ void redisplay() {
     int avail_rows = 2;
     int i;
 
+    refresh_catalog();
     if (mode_clall) {
         clear_display();
         draw_string(0, 0, "Clear All Memory?", 17);
@@ -2208,7 +2225,7 @@ typedef struct {
     int normal;
 } prp_data_struct;
 
-static prp_data_struct *prp_data;
+static CORE_TLS prp_data_struct *prp_data;
 static int print_program_worker(int interrupted);
 
 int print_program(int prgm_index, int4 pc, int4 lines, int normal) {
@@ -2652,6 +2669,7 @@ void set_cat_section(int section) {
 }
 
 int get_cat_section() {
+    refresh_catalog();
     int index = get_cat_index();
     if (index != -1)
         return catalogmenu_section[index];
@@ -2660,6 +2678,7 @@ int get_cat_section() {
 }
 
 void move_cat_row(int direction) {
+    refresh_catalog();
     int index = get_cat_index();
     if (index == -1)
         return;
@@ -2684,6 +2703,7 @@ void set_cat_row(int row) {
 }
 
 int get_cat_row() {
+    refresh_catalog();
     int index = get_cat_index();
     if (index == -1)
         return 0;
@@ -2692,6 +2712,7 @@ int get_cat_row() {
 }
 
 int get_cat_item(int menukey) {
+    refresh_catalog();
     int index = get_cat_index();
     if (index == -1)
         return -1;
@@ -2700,6 +2721,7 @@ int get_cat_item(int menukey) {
 }
 
 void update_catalog() {
+    catalog_dirty = false;
     int *the_menu;
     if (mode_commandmenu != MENU_NONE)
         the_menu = &mode_commandmenu;
@@ -2768,6 +2790,15 @@ void update_catalog() {
     draw_catalog();
 }
 
+void mark_catalog_dirty() {
+    catalog_dirty = true;
+}
+
+void refresh_catalog() {
+    if (catalog_dirty)
+        update_catalog();
+}
+
 void clear_custom_menu() {
     int row, key;
     for (row = 0; row < 3; row++)
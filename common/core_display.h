@@ -27,6 +27,10 @@ bool unpersist_display(int version);
 void clear_display();
 void flush_display();
 void repaint_display();
+/* Holds back display updates until hold_display(false), which sends them to
+ * the shell in one go; for running many keystrokes without a repaint each.
+ */
+void hold_display(bool hold);
 void draw_pixel(int x, int y);
 void draw_pattern(phloat dx, phloat dy, const char *pattern, int pattern_width);
 void fly_goose();
@@ -90,6 +94,13 @@ void set_cat_row(int row);
 int get_cat_row();
 int get_cat_item(int menukey);
 void update_catalog();
+/* Variable and program mutators call mark_catalog_dirty() instead of
+ * update_catalog(), so that a program that creates and deletes variables in
+ * a loop doesn't redraw the catalog every time; refresh_catalog() does the
+ * pending update, and is called by redisplay() and by everything else that
+ * reads the catalog menu's contents. */
+void mark_catalog_dirty();
+void refresh_catalog();
 
 void clear_custom_menu();
 void assign_custom_key(int keynum, const char *name, int length);
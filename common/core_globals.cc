@@ -25,6 +25,7 @@
 #include "core_helpers.h"
 #include "core_main.h"
 #include "core_math1.h"
+#include "core_native.h"
 #include "core_tables.h"
 #include "core_variables.h"
 #include "shell.h"
@@ -38,7 +39,7 @@
 // File used for reading and writing the state file, and for importing and
 // exporting programs. Since only one of these operations can be active at one
 // time, having one FILE pointer for all of them is sufficient.
-FILE *gfile = NULL;
+CORE_TLS FILE *gfile = NULL;
 
 error_spec errors[] = {
     { /* NONE */                   NULL,                       0 },
@@ -545,126 +546,128 @@ menu_spec menus[] = {
 #define LABELS_INCREMENT 10
 
 /* Registers */
-vartype *reg_x = NULL;
-vartype *reg_y = NULL;
-vartype *reg_z = NULL;
-vartype *reg_t = NULL;
-vartype *reg_lastx = NULL;
-int reg_alpha_length = 0;
-char reg_alpha[44];
+CORE_TLS vartype *reg_x = NULL;
+CORE_TLS vartype *reg_y = NULL;
+CORE_TLS vartype *reg_z = NULL;
+CORE_TLS vartype *reg_t = NULL;
+CORE_TLS vartype *reg_lastx = NULL;
+CORE_TLS int reg_alpha_length = 0;
+CORE_TLS char reg_alpha[44];
 
 /* Flags */
-flags_struct flags;
+CORE_TLS flags_struct flags;
 
 /* Variables */
-int vars_capacity = 0;
-int vars_count = 0;
-var_struct *vars = NULL;
+CORE_TLS int vars_capacity = 0;
+CORE_TLS int vars_count = 0;
+CORE_TLS var_struct *vars = NULL;
 
 /* Programs */
-int prgms_capacity = 0;
-int prgms_count = 0;
-prgm_struct *prgms = NULL;
-int labels_capacity = 0;
-int labels_count = 0;
-label_struct *labels = NULL;
-
-int current_prgm = -1;
-int4 pc;
-int prgm_highlight_row = 0;
-
-int varmenu_length;
-char varmenu[7];
-int varmenu_rows;
-int varmenu_row;
-int varmenu_labellength[6];
-char varmenu_labeltext[6][7];
-int varmenu_role;
-
-bool mode_clall;
-int (*mode_interruptible)(int) = NULL;
-bool mode_stoppable;
-bool mode_command_entry;
-bool mode_number_entry;
-bool mode_alpha_entry;
-bool mode_shift;
-int mode_appmenu;
-int mode_plainmenu;
-bool mode_plainmenu_sticky;
-int mode_transientmenu;
-int mode_alphamenu;
-int mode_commandmenu;
-bool mode_running;
-bool mode_getkey;
-bool mode_pause = false;
-bool mode_disable_stack_lift; /* transient */
-bool mode_varmenu;
-bool mode_updown;
-int4 mode_sigma_reg;
-int mode_goose;
-bool mode_time_clktd;
-bool mode_time_clk24;
-int mode_wsize;
-
-phloat entered_number;
-int entered_string_length;
-char entered_string[15];
-
-int pending_command;
-arg_struct pending_command_arg;
-int xeq_invisible;
+CORE_TLS int prgms_capacity = 0;
+CORE_TLS int prgms_count = 0;
+CORE_TLS prgm_struct *prgms = NULL;
+CORE_TLS int labels_capacity = 0;
+CORE_TLS int labels_count = 0;
+CORE_TLS label_struct *labels = NULL;
+
+CORE_TLS int current_prgm = -1;
+CORE_TLS int4 pc;
+CORE_TLS int prgm_highlight_row = 0;
+CORE_TLS ind_cache_struct *ind_cache = NULL;
+CORE_TLS uint4 lookup_generation = 1;
+
+CORE_TLS int varmenu_length;
+CORE_TLS char varmenu[7];
+CORE_TLS int varmenu_rows;
+CORE_TLS int varmenu_row;
+CORE_TLS int varmenu_labellength[6];
+CORE_TLS char varmenu_labeltext[6][7];
+CORE_TLS int varmenu_role;
+
+CORE_TLS bool mode_clall;
+CORE_TLS int (*mode_interruptible)(int) = NULL;
+CORE_TLS bool mode_stoppable;
+CORE_TLS bool mode_command_entry;
+CORE_TLS bool mode_number_entry;
+CORE_TLS bool mode_alpha_entry;
+CORE_TLS bool mode_shift;
+CORE_TLS int mode_appmenu;
+CORE_TLS int mode_plainmenu;
+CORE_TLS bool mode_plainmenu_sticky;
+CORE_TLS int mode_transientmenu;
+CORE_TLS int mode_alphamenu;
+CORE_TLS int mode_commandmenu;
+CORE_TLS bool mode_running;
+CORE_TLS bool mode_getkey;
+CORE_TLS bool mode_pause = false;
+CORE_TLS bool mode_disable_stack_lift; /* transient */
+CORE_TLS bool mode_varmenu;
+CORE_TLS bool mode_updown;
+CORE_TLS int4 mode_sigma_reg;
+CORE_TLS int mode_goose;
+CORE_TLS bool mode_time_clktd;
+CORE_TLS bool mode_time_clk24;
+CORE_TLS int mode_wsize;
+
+CORE_TLS_PHLOAT phloat entered_number;
+CORE_TLS int entered_string_length;
+CORE_TLS char entered_string[15];
+
+CORE_TLS int pending_command;
+CORE_TLS_PHLOAT arg_struct pending_command_arg;
+CORE_TLS int xeq_invisible;
 
 /* Multi-keystroke commands -- edit state */
 /* Relevant when mode_command_entry != 0 */
-int incomplete_command;
-int incomplete_ind;
-int incomplete_alpha;
-int incomplete_length;
-int incomplete_maxdigits;
-int incomplete_argtype;
-int incomplete_num;
-char incomplete_str[7];
-int4 incomplete_saved_pc;
-int4 incomplete_saved_highlight_row;
+CORE_TLS int incomplete_command;
+CORE_TLS int incomplete_ind;
+CORE_TLS int incomplete_alpha;
+CORE_TLS int incomplete_length;
+CORE_TLS int incomplete_maxdigits;
+CORE_TLS int incomplete_argtype;
+CORE_TLS int incomplete_num;
+CORE_TLS char incomplete_str[7];
+CORE_TLS int4 incomplete_saved_pc;
+CORE_TLS int4 incomplete_saved_highlight_row;
 
 /* Command line handling temporaries */
-char cmdline[100];
-int cmdline_length;
-int cmdline_row;
+CORE_TLS char cmdline[100];
+CORE_TLS int cmdline_length;
+CORE_TLS int cmdline_row;
 
 /* Matrix editor / matrix indexing */
-int matedit_mode; /* 0=off, 1=index, 2=edit, 3=editn */
-char matedit_name[7];
-int matedit_length;
-vartype *matedit_x;
-int4 matedit_i;
-int4 matedit_j;
-int matedit_prev_appmenu;
+CORE_TLS int matedit_mode; /* 0=off, 1=index, 2=edit, 3=editn */
+CORE_TLS char matedit_name[7];
+CORE_TLS int matedit_length;
+CORE_TLS vartype *matedit_x;
+CORE_TLS int4 matedit_i;
+CORE_TLS int4 matedit_j;
+CORE_TLS int matedit_prev_appmenu;
 
 /* INPUT */
-char input_name[11];
-int input_length;
-arg_struct input_arg;
+CORE_TLS char input_name[11];
+CORE_TLS int input_length;
+CORE_TLS_PHLOAT arg_struct input_arg;
 
 /* BASE application */
-int baseapp = 0;
+CORE_TLS int baseapp = 0;
 
 /* Random number generator */
-int8 random_number_low, random_number_high;
+CORE_TLS int8 random_number_low, random_number_high;
 
 /* NORM & TRACE mode: number waiting to be printed */
-int deferred_print = 0;
+CORE_TLS int deferred_print = 0;
 
 /* Keystroke buffer - holds keystrokes received while
  * there is a program running.
  */
-int keybuf_head = 0;
-int keybuf_tail = 0;
-int keybuf[16];
+CORE_TLS int keybuf_head = 0;
+CORE_TLS int keybuf_tail = 0;
+CORE_TLS int keybuf[16];
 
-int remove_program_catalog = 0;
+CORE_TLS int remove_program_catalog = 0;
 
-int state_file_number_format;
+CORE_TLS int state_file_number_format;
 
 /* No user interaction: we keep track of whether or not the user
  * has pressed any keys since powering up, and we don't allow
@@ -675,7 +678,7 @@ int state_file_number_format;
  *
  * from locking the user out.
  */
-bool no_keystrokes_yet;
+CORE_TLS bool no_keystrokes_yet;
 
 
 /* Version number for the state file.
@@ -750,8 +753,8 @@ bool no_keystrokes_yet;
 /* Private globals */
 /*******************/
 
-static bool state_bool_is_int;
-bool state_is_portable;
+static CORE_TLS bool state_bool_is_int;
+CORE_TLS bool state_is_portable;
 
 typedef struct {
     int4 prgm;
@@ -781,14 +784,14 @@ typedef struct {
  * be in sync, hence the need to track them separately.
  */
 #define MAX_RTN_LEVEL 1024
-static int rtn_sp = 0;
-static int rtn_stack_capacity = 0;
-static rtn_stack_entry *rtn_stack = NULL;
-static int rtn_level = 0;
-static bool rtn_level_0_has_matrix_entry;
-static int rtn_stop_level = -1;
-static bool rtn_solve_active = false;
-static bool rtn_integ_active = false;
+static CORE_TLS int rtn_sp = 0;
+static CORE_TLS int rtn_stack_capacity = 0;
+static CORE_TLS rtn_stack_entry *rtn_stack = NULL;
+static CORE_TLS int rtn_level = 0;
+static CORE_TLS bool rtn_level_0_has_matrix_entry;
+static CORE_TLS int rtn_stop_level = -1;
+static CORE_TLS bool rtn_solve_active = false;
+static CORE_TLS bool rtn_integ_active = false;
 
 #ifdef IPHONE
 /* For iPhone, we disable OFF by default, to satisfy App Store
@@ -804,9 +807,20 @@ typedef struct {
     int4 columns;
 } matrix_persister;
 
-static int array_count;
-static int array_list_capacity;
-static void **array_list;
+static CORE_TLS int array_count;
+static CORE_TLS int array_list_capacity;
+static CORE_TLS void **array_list;
+
+/* Global label index. Hashes label names to chains of indices into labels[];
+ * the chains are linked through label_hash_next[], which runs parallel to
+ * labels[], and are kept in descending index order, so that the first match
+ * is the last definition, which is the one XEQ and GTO should find.
+ * ENDs are not hashed.
+ */
+#define LABEL_HASH_MIN_SIZE 64
+static CORE_TLS int label_hash_size = 0;
+static CORE_TLS int *label_hash = NULL;
+static CORE_TLS int *label_hash_next = NULL;
 
 
 static bool array_list_grow();
@@ -814,7 +828,24 @@ static int array_list_search(void *array);
 static bool persist_vartype(vartype *v);
 static bool unpersist_vartype(vartype **v, bool padded);
 static void update_label_table(int prgm, int4 pc, int inserted);
-static void invalidate_lclbls(int prgm_index, bool force);
+static int find_label_position(int prgm, int4 pc);
+static void insert_label(int lblindex, int prgm, int4 pc,
+                         const char *name, int length);
+static void remove_labels(int lblindex, int count);
+static void rebuild_label_hash();
+static void free_label_hash();
+static bool grow_prgm_text(prgm_struct *prgm, int4 size);
+static bool grow_prgms();
+static void free_prgm(int prgm_index);
+static void invalidate_lclbls(int prgm_index);
+static void insert_lclbls(int prgm_index, int4 pc, int length);
+static void delete_lclbls(int prgm_index, int4 pc, int length);
+static void invalidate_line_pcs(int prgm_index);
+static void insert_line_pc(int prgm_index, int4 pc, int length);
+static void delete_line_pc(int prgm_index, int4 pc, int length);
+static bool rebuild_line_pcs(int prgm_index);
+static int4 search_line_pcs(prgm_struct *prgm, int4 pc);
+static bool build_decoded(int prgm_index);
 static int pc_line_convert(int4 loc, int loc_is_pc);
 static bool convert_programs(bool *clear_stack);
 #ifdef BCD_MATH
@@ -959,7 +990,7 @@ struct fake_bcd {
 // should then clean up what has already been read, rewind the state file,
 // and try again in mode 2.
 
-int bug_mode;
+CORE_TLS int bug_mode;
 
 static bool unpersist_vartype(vartype **v, bool padded) {
     if (state_is_portable) {
@@ -1534,7 +1565,7 @@ static bool persist_globals() {
     return ret;
 }
 
-static bool suppress_varmenu_update = false;
+static CORE_TLS bool suppress_varmenu_update = false;
 
 static bool unpersist_globals(int4 ver) {
     int i;
@@ -1636,6 +1667,7 @@ static bool unpersist_globals(int4 ver) {
             free(vars);
             vars = NULL;
         }
+        invalidate_var_index();
         if (!read_int(&vars_count)) {
             vars_count = 0;
             goto done;
@@ -1706,6 +1738,19 @@ static bool unpersist_globals(int4 ver) {
             prgms[i].capacity = prgms[i].size;
             prgms[i].text = (unsigned char *) malloc(prgms[i].size);
             // TODO - handle memory allocation failure
+            prgms[i].lclbl_invalid = 1;
+            prgms[i].lclbls = NULL;
+            prgms[i].lclbls_count = 0;
+            prgms[i].lclbls_capacity = 0;
+            prgms[i].lines_invalid = 1;
+            prgms[i].line_pcs = NULL;
+            prgms[i].lines_count = 0;
+            prgms[i].lines_capacity = 0;
+            prgms[i].decoded = NULL;
+            prgms[i].decoded_line = 0;
+            prgms[i].decoded_jump = 0;
+            prgms[i].profile = NULL;
+            prgms[i].native = NULL;
         }
         for (i = 0; i < prgms_count; i++) {
             if (fread(prgms[i].text, 1, prgms[i].size, gfile)
@@ -1738,6 +1783,7 @@ static bool unpersist_globals(int4 ver) {
             free(vars);
             vars = NULL;
         }
+        invalidate_var_index();
         if (!read_int(&vars_count)) {
             vars_count = 0;
             goto done;
@@ -1889,7 +1935,7 @@ static bool unpersist_globals(int4 ver) {
         } else {
             if (ver < 22)
                 for (i = 0; i < prgms_count; i++)
-                    invalidate_lclbls(i, true);
+                    invalidate_lclbls(i);
         }
         #ifdef BCD_MATH
             if (state_file_number_format == NUMBER_FORMAT_BCD20_OLD
@@ -1910,8 +1956,7 @@ void clear_all_prgms() {
     if (prgms != NULL) {
         int i;
         for (i = 0; i < prgms_count; i++)
-            if (prgms[i].text != NULL)
-                free(prgms[i].text);
+            free_prgm(i);
         free(prgms);
     }
     prgms = NULL;
@@ -1922,6 +1967,7 @@ void clear_all_prgms() {
     labels = NULL;
     labels_capacity = 0;
     labels_count = 0;
+    free_label_hash();
 }
 
 int clear_prgm(const arg_struct *arg) {
@@ -1934,14 +1980,9 @@ int clear_prgm(const arg_struct *arg) {
                 return ERR_INTERNAL_ERROR;
             prgm_index = current_prgm;
         } else {
-            int i;
-            for (i = labels_count - 1; i >= 0; i--)
-                if (string_equals(arg->val.text, arg->length,
-                                 labels[i].name, labels[i].length))
-                    goto found;
-            return ERR_LABEL_NOT_FOUND;
-            found:
-            prgm_index = labels[i].prgm;
+            int4 lblpc;
+            if (!find_global_label(arg, &prgm_index, &lblpc))
+                return ERR_LABEL_NOT_FOUND;
         }
     }
     return clear_prgm_by_index(prgm_index);
@@ -1956,22 +1997,15 @@ int clear_prgm_by_index(int prgm_index) {
         pc = -1;
     else if (current_prgm > prgm_index)
         current_prgm--;
-    free(prgms[prgm_index].text);
+    free_prgm(prgm_index);
     for (i = prgm_index; i < prgms_count - 1; i++)
         prgms[i] = prgms[i + 1];
     prgms_count--;
-    i = j = 0;
-    while (j < labels_count) {
-        if (j > i)
-            labels[i] = labels[j];
-        j++;
-        if (labels[i].prgm > prgm_index) {
-            labels[i].prgm--;
-            i++;
-        } else if (labels[i].prgm < prgm_index)
-            i++;
-    }
-    labels_count = i;
+    i = find_label_position(prgm_index, 0);
+    j = find_label_position(prgm_index + 1, 0);
+    remove_labels(i, j - i);
+    for (; i < labels_count; i++)
+        labels[i].prgm--;
     if (prgms_count == 0 || prgm_index == prgms_count) {
         int saved_prgm = current_prgm;
         int saved_pc = pc;
@@ -1979,7 +2013,7 @@ int clear_prgm_by_index(int prgm_index) {
         current_prgm = saved_prgm;
         pc = saved_pc;
     }
-    update_catalog();
+    mark_catalog_dirty();
     return ERR_NONE;
 }
 
@@ -2000,29 +2034,20 @@ void clear_prgm_lines(int4 count) {
     }
     deleted = pc - frompc;
 
-    for (i = pc; i < prgms[current_prgm].size; i++)
-        prgms[current_prgm].text[i - deleted] = prgms[current_prgm].text[i];
-    prgms[current_prgm].size -= deleted;
+    prgm_struct *prgm = prgms + current_prgm;
+    memmove(prgm->text + frompc, prgm->text + pc, prgm->size - pc);
+    prgm->size -= deleted;
     pc = frompc;
 
-    i = j = 0;
-    while (j < labels_count) {
-        if (j > i)
-            labels[i] = labels[j];
-        j++;
-        if (labels[i].prgm == current_prgm) {
-            if (labels[i].pc < frompc)
-                i++;
-            else if (labels[i].pc >= frompc + deleted) {
-                labels[i].pc -= deleted;
-                i++;
-            }
-        } else
-            i++;
-    }
-    labels_count = i;
+    i = find_label_position(current_prgm, frompc);
+    j = find_label_position(current_prgm, frompc + deleted);
+    remove_labels(i, j - i);
+    for (; i < labels_count && labels[i].prgm == current_prgm; i++)
+        labels[i].pc -= deleted;
 
-    invalidate_lclbls(current_prgm, false);
+    invalidate_lclbls(current_prgm);
+    invalidate_line_pcs(current_prgm);
+    invalidate_decoded(current_prgm);
     clear_all_rtns();
 }
 
@@ -2039,23 +2064,25 @@ void goto_dot_dot(bool force_new) {
             return;
         }
     }
-    if (prgms_count == prgms_capacity) {
-        prgm_struct *newprgms;
-        int i;
-        prgms_capacity += 10;
-        newprgms = (prgm_struct *) malloc(prgms_capacity * sizeof(prgm_struct));
-        // TODO - handle memory allocation failure
-        for (i = 0; i < prgms_count; i++)
-            newprgms[i] = prgms[i];
-        if (prgms != NULL)
-            free(prgms);
-        prgms = newprgms;
-    }
+    // TODO - handle memory allocation failure
+    grow_prgms();
     current_prgm = prgms_count++;
     prgms[current_prgm].capacity = 0;
     prgms[current_prgm].size = 0;
     prgms[current_prgm].lclbl_invalid = 1;
     prgms[current_prgm].text = NULL;
+    prgms[current_prgm].lclbls = NULL;
+    prgms[current_prgm].lclbls_count = 0;
+    prgms[current_prgm].lclbls_capacity = 0;
+    prgms[current_prgm].lines_invalid = 1;
+    prgms[current_prgm].line_pcs = NULL;
+    prgms[current_prgm].lines_count = 0;
+    prgms[current_prgm].lines_capacity = 0;
+    prgms[current_prgm].decoded = NULL;
+    prgms[current_prgm].decoded_line = 0;
+    prgms[current_prgm].decoded_jump = 0;
+    prgms[current_prgm].profile = NULL;
+    prgms[current_prgm].native = NULL;
     command = CMD_END;
     arg.type = ARGTYPE_NONE;
     store_command(0, command, &arg);
@@ -2126,8 +2153,6 @@ int get_command_length(int prgm_index, int4 pc) {
 void get_next_command(int4 *pc, int *command, arg_struct *arg, int find_target){
     prgm_struct *prgm = prgms + current_prgm;
     int i;
-    int4 target_pc;
-    int4 orig_pc = *pc;
 
     *command = prgm->text[(*pc)++];
     arg->type = prgm->text[(*pc)++];
@@ -2137,21 +2162,14 @@ void get_next_command(int4 *pc, int *command, arg_struct *arg, int find_target){
     if ((*command == CMD_GTO || *command == CMD_XEQ)
             && (arg->type == ARGTYPE_NUM
                 || arg->type == ARGTYPE_LCLBL
-                || arg->type == ARGTYPE_STK)) {
-        if (find_target) {
-            target_pc = 0;
-            for (i = 0; i < 4; i++)
-                target_pc = (target_pc << 8) | prgm->text[(*pc)++];
-            if (target_pc != -1) {
-                arg->target = target_pc;
-                find_target = 0;
-            }
-        } else
-            (*pc) += 4;
-    } else {
+                || arg->type == ARGTYPE_STK))
+        /* Skip the 4 bytes that used to cache the target pc in the program
+         * text; targets are now found using the local label table.
+         */
+        (*pc) += 4;
+    else
         find_target = 0;
-        arg->target = -1;
-    }
+    arg->target = -1;
 
     switch (arg->type) {
         case ARGTYPE_NUM:
@@ -2201,26 +2219,404 @@ void get_next_command(int4 *pc, int *command, arg_struct *arg, int find_target){
         arg->type = ARGTYPE_DOUBLE;
     }
     
-    if (find_target) {
-        target_pc = find_local_label(arg);
-        arg->target = target_pc;
-        for (i = 5; i >= 2; i--) {
-            prgm->text[orig_pc + i] = target_pc;
-            target_pc >>= 8;
+    if (find_target)
+        arg->target = find_local_label(arg);
+}
+
+/* Commands that can be part of a superinstruction. FUSE_STRAIGHT commands
+ * never change the pc, never pause or stop the program, and never start
+ * interruptible commands; FUSE_TEST commands are like that too, except that
+ * they return ERR_YES or ERR_NO.
+ */
+#define FUSE_NONE 0
+#define FUSE_STRAIGHT 1
+#define FUSE_TEST 2
+#define FUSE_GTO 3
+
+static int fuse_class(const decoded_cmd_struct *dc) {
+    switch (dc->cmd) {
+        case CMD_ENTER:
+        case CMD_SWAP:
+        case CMD_DIV:
+        case CMD_MUL:
+        case CMD_SUB:
+        case CMD_ADD:
+        case CMD_STO:
+        case CMD_STO_DIV:
+        case CMD_STO_MUL:
+        case CMD_STO_SUB:
+        case CMD_STO_ADD:
+        case CMD_RCL:
+        case CMD_RCL_DIV:
+        case CMD_RCL_MUL:
+        case CMD_RCL_SUB:
+        case CMD_RCL_ADD:
+        case CMD_NUMBER:
+            return FUSE_STRAIGHT;
+        case CMD_FS_T:
+        case CMD_FC_T:
+        case CMD_FSC_T:
+        case CMD_FCC_T:
+        case CMD_ISG:
+        case CMD_DSE:
+        case CMD_X_EQ_0:
+        case CMD_X_NE_0:
+        case CMD_X_LT_0:
+        case CMD_X_GT_0:
+        case CMD_X_LE_0:
+        case CMD_X_GE_0:
+        case CMD_X_EQ_Y:
+        case CMD_X_NE_Y:
+        case CMD_X_LT_Y:
+        case CMD_X_GT_Y:
+        case CMD_X_LE_Y:
+        case CMD_X_GE_Y:
+            return FUSE_TEST;
+        case CMD_GTO:
+            if (dc->arg.type == ARGTYPE_NUM || dc->arg.type == ARGTYPE_LCLBL
+                    || dc->arg.type == ARGTYPE_STK)
+                return FUSE_GTO;
+            return FUSE_NONE;
+        default:
+            return FUSE_NONE;
+    }
+}
+
+/* Peephole pass over a decoded program, marking the lines that start a
+ * superinstruction. Recognized are: a test followed by a local GTO, as in
+ * ISG nn, GTO lbl or X<Y?, GTO lbl; runs of two or three straight-line
+ * commands, as in RCL nn, +, STO nn; and a straight-line command followed by
+ * a test and a local GTO. Every line gets its own marking, so a jump into the
+ * middle of a sequence still finds a valid one.
+ */
+static void fuse_decoded(decoded_cmd_struct *decoded, int4 lines) {
+    int4 i;
+    for (i = 0; i < lines; i++) {
+        int c0 = fuse_class(decoded + i);
+        int c1 = i + 1 < lines ? fuse_class(decoded + i + 1) : FUSE_NONE;
+        int c2 = i + 2 < lines ? fuse_class(decoded + i + 2) : FUSE_NONE;
+        int n = 1;
+        if (c0 == FUSE_TEST) {
+            if (c1 == FUSE_GTO)
+                n = 2;
+        } else if (c0 == FUSE_STRAIGHT) {
+            if (c1 == FUSE_TEST && c2 == FUSE_GTO)
+                n = 3;
+            else if (c1 == FUSE_STRAIGHT)
+                n = c2 == FUSE_STRAIGHT ? 3 : 2;
+        }
+        decoded[i].fused = n;
+    }
+}
+
+/* Compiled programs; see core_native.h. Not thread-local: the table is
+ * registered once, before any calculator starts, and only read after that.
+ */
+static const native_prgm_struct *natives = NULL;
+static int natives_count = 0;
+
+void core_register_native(const native_prgm_struct *table, int count) {
+    natives = table;
+    natives_count = count;
+}
+
+uint4 program_hash(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    uint4 h = 2166136261U;
+    for (int4 i = 0; i < prgm->size; i++) {
+        h ^= prgm->text[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+const native_prgm_struct *find_native(int prgm_index) {
+    if (natives_count == 0)
+        return NULL;
+    prgm_struct *prgm = prgms + prgm_index;
+    uint4 h = program_hash(prgm_index);
+    for (int i = 0; i < natives_count; i++)
+        if (natives[i].size == prgm->size && natives[i].hash == h
+                && memcmp(natives[i].text, prgm->text, prgm->size) == 0)
+            return natives + i;
+    return NULL;
+}
+
+static bool build_decoded(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    int saved_prgm = current_prgm;
+    int4 pc2 = 0;
+    int4 lines = 0;
+    int4 ind_lines = 0;
+    while (pc2 < prgm->size) {
+        int argtype = prgm->text[pc2 + 1] & 15;
+        if (argtype == ARGTYPE_IND_NUM || argtype == ARGTYPE_IND_STK
+                || argtype == ARGTYPE_IND_STR)
+            ind_lines++;
+        pc2 += get_command_length(prgm_index, pc2);
+        lines++;
+    }
+    /* The inline caches go in the same block, after the decoded lines */
+    prgm->decoded = (decoded_cmd_struct *)
+                        malloc(lines * sizeof(decoded_cmd_struct)
+                               + ind_lines * sizeof(ind_cache_struct));
+    if (prgm->decoded == NULL)
+        return false;
+    /* The line index is what maps a pc to its decoded line */
+    if (prgm->lines_invalid && !rebuild_line_pcs(prgm_index)) {
+        invalidate_decoded(prgm_index);
+        return false;
+    }
+    prgm->decoded_line = 0;
+    prgm->decoded_jump = 0;
+
+    ind_cache_struct *ind = (ind_cache_struct *) (prgm->decoded + lines);
+    current_prgm = prgm_index;
+    pc2 = 0;
+    lines = 0;
+    while (pc2 < prgm->size) {
+        decoded_cmd_struct *dc = prgm->decoded + lines;
+        lines++;
+        /* Local label targets are resolved on first execution; see
+         * get_next_decoded_command().
+         */
+        get_next_command(&pc2, &dc->cmd, &dc->arg, 0);
+        dc->next_pc = pc2;
+        if ((dc->arg.type == ARGTYPE_IND_NUM || dc->arg.type == ARGTYPE_IND_STK
+                || dc->arg.type == ARGTYPE_IND_STR) && ind_lines-- > 0) {
+            dc->ind = ind++;
+            dc->ind->type = ARGTYPE_NONE;
+            dc->ind->source_gen = 0;
+            dc->ind->target_gen = 0;
+        } else
+            dc->ind = NULL;
+    }
+    current_prgm = saved_prgm;
+    fuse_decoded(prgm->decoded, lines);
+    prgm->native = find_native(prgm_index);
+    return true;
+}
+
+decoded_cmd_struct *get_decoded_command(int4 pc) {
+    /* Returns the current program's decoded instruction cache entry for pc,
+     * building the cache if necessary, or NULL if pc is not the start of a
+     * line, or if the cache can't be built. Local GTO and XEQ targets are
+     * not resolved yet; see resolve_decoded_target().
+     */
+    prgm_struct *prgm = prgms + current_prgm;
+    if (prgm->decoded == NULL && !build_decoded(current_prgm)
+            || prgm->lines_invalid && !rebuild_line_pcs(current_prgm))
+        return NULL;
+    int4 i = prgm->decoded_line + 1;
+    if (i >= prgm->lines_count || prgm->line_pcs[i] != pc) {
+        i = prgm->decoded_jump;
+        if (i >= prgm->lines_count || prgm->line_pcs[i] != pc) {
+            i = search_line_pcs(prgm, pc);
+            if (i == prgm->lines_count || prgm->line_pcs[i] != pc)
+                return NULL;
+            prgm->decoded_jump = i;
         }
-        prgm->lclbl_invalid = 0;
     }
+    prgm->decoded_line = i;
+    return prgm->decoded + i;
+}
+
+void resolve_decoded_target(decoded_cmd_struct *dc) {
+    /* Like get_next_command(), this searches from the line following the
+     * GTO or XEQ, so the global pc must already point there.
+     */
+    if (dc->arg.target == -1 && (dc->cmd == CMD_GTO || dc->cmd == CMD_XEQ)
+            && (dc->arg.type == ARGTYPE_NUM
+                || dc->arg.type == ARGTYPE_LCLBL
+                || dc->arg.type == ARGTYPE_STK))
+        dc->arg.target = find_local_label(&dc->arg);
+}
+
+void get_next_decoded_command(int4 *pc, int *command, arg_struct *arg) {
+    /* Equivalent to get_next_command(pc, command, arg, 1), but served from
+     * the current program's decoded instruction cache, which is built on
+     * the first call after the program was last modified.
+     */
+    decoded_cmd_struct *dc = get_decoded_command(*pc);
+    if (dc == NULL) {
+        get_next_command(pc, command, arg, 1);
+        return;
+    }
+    *pc = dc->next_pc;
+    resolve_decoded_target(dc);
+    *command = dc->cmd;
+    *arg = dc->arg;
+}
+
+void invalidate_decoded(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    /* Any change to a program may move or remove labels that inline caches
+     * elsewhere point to */
+    bump_lookup_generation();
+    if (prgm->decoded != NULL) {
+        free(prgm->decoded);
+        prgm->decoded = NULL;
+    }
+    if (prgm->profile != NULL) {
+        free(prgm->profile);
+        prgm->profile = NULL;
+    }
+    prgm->native = NULL;
+}
+
+static bool grow_labels() {
+    int new_capacity = labels_capacity + 50;
+    label_struct *new_labels = (label_struct *)
+                realloc(labels, new_capacity * sizeof(label_struct));
+    if (new_labels == NULL)
+        return false;
+    labels = new_labels;
+    int *new_next = (int *) realloc(label_hash_next, new_capacity * sizeof(int));
+    if (new_next == NULL)
+        return false;
+    label_hash_next = new_next;
+    labels_capacity = new_capacity;
+    return true;
+}
+
+static int label_hash_code(const char *name, int length) {
+    uint4 h = 0;
+    for (int i = 0; i < length; i++)
+        h = h * 31 + (unsigned char) name[i];
+    return h & (label_hash_size - 1);
+}
+
+static void link_label(int lblindex) {
+    label_struct *lbl = labels + lblindex;
+    if (lbl->length == 0 || label_hash_size == 0)
+        return;
+    int *p = label_hash + label_hash_code(lbl->name, lbl->length);
+    while (*p > lblindex)
+        p = label_hash_next + *p;
+    label_hash_next[lblindex] = *p;
+    *p = lblindex;
+}
+
+static void unlink_label(int lblindex) {
+    label_struct *lbl = labels + lblindex;
+    if (lbl->length == 0 || label_hash_size == 0)
+        return;
+    int *p = label_hash + label_hash_code(lbl->name, lbl->length);
+    while (*p != lblindex)
+        p = label_hash_next + *p;
+    *p = label_hash_next[lblindex];
+}
+
+/* Adds 'delta' to all indices >= 'from' in the hash chains. Used when
+ * labels[] entries have been shifted; the order of the chains is preserved.
+ * Since the chains run in descending index order, label_hash_next[] entries
+ * below the ones that moved can't point at any that did, so only the heads
+ * and the moved entries need to be looked at.
+ */
+static void renumber_label_hash(int from, int delta) {
+    int i;
+    for (i = 0; i < label_hash_size; i++)
+        if (label_hash[i] >= from)
+            label_hash[i] += delta;
+    for (i = delta < 0 ? from + delta : from; i < labels_count; i++)
+        if (label_hash_next[i] >= from)
+            label_hash_next[i] += delta;
+}
+
+static void rebuild_label_hash() {
+    int size = label_hash_size == 0 ? LABEL_HASH_MIN_SIZE : label_hash_size;
+    while (size < labels_count)
+        size <<= 1;
+    if (size != label_hash_size) {
+        int *new_hash = (int *) realloc(label_hash, size * sizeof(int));
+        /* Out of memory: chains work with a table of any size, so keep
+         * using the old one, if there is one; find_global_label() falls
+         * back on a linear search if there isn't.
+         */
+        if (new_hash != NULL) {
+            label_hash = new_hash;
+            label_hash_size = size;
+        } else if (label_hash_size == 0)
+            return;
+    }
+    for (int i = 0; i < label_hash_size; i++)
+        label_hash[i] = -1;
+    for (int i = 0; i < labels_count; i++)
+        link_label(i);
+}
+
+static void free_label_hash() {
+    free(label_hash);
+    label_hash = NULL;
+    label_hash_size = 0;
+    free(label_hash_next);
+    label_hash_next = NULL;
+}
+
+/* Returns the index of the first label at or after (prgm, pc); labels[] is
+ * sorted by program and pc.
+ */
+static int find_label_position(int prgm, int4 pc) {
+    int lo = 0, hi = labels_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (labels[mid].prgm < prgm
+                || labels[mid].prgm == prgm && labels[mid].pc < pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void insert_label(int lblindex, int prgm, int4 pc,
+                         const char *name, int length) {
+    if (labels_count == labels_capacity && !grow_labels())
+        // TODO - handle memory allocation failure
+        return;
+    memmove(labels + lblindex + 1, labels + lblindex,
+            (labels_count - lblindex) * sizeof(label_struct));
+    memmove(label_hash_next + lblindex + 1, label_hash_next + lblindex,
+            (labels_count - lblindex) * sizeof(int));
+    labels_count++;
+    bump_lookup_generation();
+    label_struct *lbl = labels + lblindex;
+    lbl->length = length;
+    memcpy(lbl->name, name, length);
+    lbl->prgm = prgm;
+    lbl->pc = pc;
+    if (labels_count > label_hash_size)
+        rebuild_label_hash();
+    else {
+        renumber_label_hash(lblindex, 1);
+        link_label(lblindex);
+    }
+}
+
+static void remove_labels(int lblindex, int count) {
+    int i;
+    if (count == 0)
+        return;
+    for (i = lblindex; i < lblindex + count; i++)
+        unlink_label(i);
+    memmove(labels + lblindex, labels + lblindex + count,
+            (labels_count - lblindex - count) * sizeof(label_struct));
+    memmove(label_hash_next + lblindex, label_hash_next + lblindex + count,
+            (labels_count - lblindex - count) * sizeof(int));
+    labels_count -= count;
+    bump_lookup_generation();
+    renumber_label_hash(lblindex + count, -count);
 }
 
 void rebuild_label_table() {
-    /* TODO -- this is *not* efficient; inserting and deleting ENDs and
-     * global LBLs should not cause every single program to get rescanned!
-     * But, I don't feel like dealing with that at the moment, so just
-     * this ugly brute force approach for now.
+    /* Full rescan of all programs. Only used after loading or importing
+     * programs; store_command(), delete_command(), and the clear_prgm
+     * functions maintain the table and its hash index incrementally.
      */
     int prgm_index;
     int4 pc;
     labels_count = 0;
+    bump_lookup_generation();
     for (prgm_index = 0; prgm_index < prgms_count; prgm_index++) {
         prgm_struct *prgm = prgms + prgm_index;
         pc = 0;
@@ -2233,19 +2629,9 @@ void rebuild_label_table() {
             if (command == CMD_END
                         || (command == CMD_LBL && argtype == ARGTYPE_STR)) {
                 label_struct *newlabel;
-                if (labels_count == labels_capacity) {
-                    label_struct *newlabels;
-                    int i;
-                    labels_capacity += 50;
-                    newlabels = (label_struct *)
-                                malloc(labels_capacity * sizeof(label_struct));
+                if (labels_count == labels_capacity)
                     // TODO - handle memory allocation failure
-                    for (i = 0; i < labels_count; i++)
-                        newlabels[i] = labels[i];
-                    if (labels != NULL)
-                        free(labels);
-                    labels = newlabels;
-                }
+                    grow_labels();
                 newlabel = labels + labels_count++;
                 if (command == CMD_END)
                     newlabel->length = 0;
@@ -2261,6 +2647,7 @@ void rebuild_label_table() {
             pc += get_command_length(prgm_index, pc);
         }
     }
+    rebuild_label_hash();
 }
 
 static void update_label_table(int prgm, int4 pc, int inserted) {
@@ -2273,30 +2660,208 @@ static void update_label_table(int prgm, int4 pc, int inserted) {
     }
 }
 
-static void invalidate_lclbls(int prgm_index, bool force) {
+/* Makes room for at least 'size' bytes of program text. The buffer grows
+ * geometrically, so that entering or importing a long program line by line
+ * takes time proportional to its length, not to the square of it.
+ */
+static bool grow_prgm_text(prgm_struct *prgm, int4 size) {
+    if (size <= prgm->capacity)
+        return true;
+    int4 new_capacity = prgm->capacity < 512 ? 512 : prgm->capacity;
+    while (new_capacity < size)
+        new_capacity *= 2;
+    unsigned char *new_text = (unsigned char *)
+            realloc(prgm->text, new_capacity);
+    if (new_text == NULL)
+        return false;
+    prgm->text = new_text;
+    prgm->capacity = new_capacity;
+    return true;
+}
+
+/* Makes room for one more program in prgms */
+static bool grow_prgms() {
+    if (prgms_count < prgms_capacity)
+        return true;
+    int new_capacity = prgms_capacity < 10 ? 10 : prgms_capacity * 2;
+    prgm_struct *new_prgms = (prgm_struct *)
+            realloc(prgms, new_capacity * sizeof(prgm_struct));
+    if (new_prgms == NULL)
+        return false;
+    prgms = new_prgms;
+    prgms_capacity = new_capacity;
+    return true;
+}
+
+static void free_prgm(int prgm_index) {
     prgm_struct *prgm = prgms + prgm_index;
-    if (force || !prgm->lclbl_invalid) {
-        int4 pc2 = 0;
-        while (pc2 < prgm->size) {
-            int command = prgm->text[pc2];
-            int argtype = prgm->text[pc2 + 1];
-            command |= (argtype & 240) << 4;
-            argtype &= 15;
-            if ((command == CMD_GTO || command == CMD_XEQ)
-                    && (argtype == ARGTYPE_NUM || argtype == ARGTYPE_STK
-                                               || argtype == ARGTYPE_LCLBL)) {
-                /* A dest_pc value of -1 signals 'unknown',
-                 * -2 means 'nonexistent', and anything else is
-                 * the pc where the destination label is found.
-                 */
-                int4 pos;
-                for (pos = pc2 + 2; pos < pc2 + 6; pos++)
-                    prgm->text[pos] = 255;
+    if (prgm->text != NULL)
+        free(prgm->text);
+    if (prgm->lclbls != NULL)
+        free(prgm->lclbls);
+    if (prgm->line_pcs != NULL)
+        free(prgm->line_pcs);
+    invalidate_decoded(prgm_index);
+}
+
+/* Local label table keys for LBL A-J, a-e, and for synthetic LBL ST T etc.
+ * Numeric labels use the label number as the key.
+ */
+#define LCLBL_KEY(c) (-1 - (int4) (unsigned char) (c))
+#define STK_LBL_KEY(c) (-257 - (int4) (unsigned char) (c))
+
+/* Returns the number of local label table keys for the line at 'pc', and
+ * stores them in 'keys'. Synthetic LBL ST T etc. get two keys, because they
+ * can be reached with GTO ST T as well as with GTO 112 etc.
+ */
+static int get_lclbl_keys(prgm_struct *prgm, int4 pc, int4 *keys) {
+    int command = prgm->text[pc];
+    int argtype = prgm->text[pc + 1];
+    command |= (argtype & 240) << 4;
+    argtype &= 15;
+    if (command != CMD_LBL)
+        return 0;
+    switch (argtype) {
+        case ARGTYPE_NUM: {
+            int4 num = 0;
+            unsigned char c;
+            int4 pos = pc + 2;
+            do {
+                c = prgm->text[pos++];
+                num = (num << 7) | (c & 127);
+            } while ((c & 128) == 0);
+            keys[0] = num;
+            return 1;
+        }
+        case ARGTYPE_LCLBL:
+            keys[0] = LCLBL_KEY(prgm->text[pc + 2]);
+            return 1;
+        case ARGTYPE_STK: {
+            char stk = prgm->text[pc + 2];
+            keys[0] = STK_LBL_KEY(stk);
+            switch (stk) {
+                case 'T': keys[1] = 112; return 2;
+                case 'Z': keys[1] = 113; return 2;
+                case 'Y': keys[1] = 114; return 2;
+                case 'X': keys[1] = 115; return 2;
+                case 'L': keys[1] = 116; return 2;
             }
-            pc2 += get_command_length(prgm_index, pc2);
+            return 1;
         }
-        prgm->lclbl_invalid = 1;
+        default:
+            return 0;
+    }
+}
+
+/* Returns the index of the first local label table entry at or after
+ * (key, pc).
+ */
+static int4 search_lclbls(prgm_struct *prgm, int4 key, int4 pc) {
+    int4 lo = 0, hi = prgm->lclbls_count;
+    while (lo < hi) {
+        int4 mid = (lo + hi) / 2;
+        lclbl_struct *l = prgm->lclbls + mid;
+        if (l->key < key || l->key == key && l->pc < pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static bool grow_lclbls(prgm_struct *prgm) {
+    int4 new_capacity = prgm->lclbls_capacity + 16;
+    lclbl_struct *new_lclbls = (lclbl_struct *)
+            realloc(prgm->lclbls, new_capacity * sizeof(lclbl_struct));
+    if (new_lclbls == NULL)
+        return false;
+    prgm->lclbls = new_lclbls;
+    prgm->lclbls_capacity = new_capacity;
+    return true;
+}
+
+static int lclbl_compare(const void *a, const void *b) {
+    const lclbl_struct *la = (const lclbl_struct *) a;
+    const lclbl_struct *lb = (const lclbl_struct *) b;
+    if (la->key != lb->key)
+        return la->key < lb->key ? -1 : 1;
+    return la->pc < lb->pc ? -1 : la->pc > lb->pc ? 1 : 0;
+}
+
+static void rebuild_lclbls(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    int4 pc2 = 0;
+    prgm->lclbls_count = 0;
+    while (pc2 < prgm->size) {
+        int4 keys[2];
+        int n = get_lclbl_keys(prgm, pc2, keys);
+        for (int i = 0; i < n; i++) {
+            if (prgm->lclbls_count == prgm->lclbls_capacity
+                    && !grow_lclbls(prgm))
+                // TODO - handle memory allocation failure
+                return;
+            lclbl_struct *l = prgm->lclbls + prgm->lclbls_count++;
+            l->key = keys[i];
+            l->pc = pc2;
+        }
+        pc2 += get_command_length(prgm_index, pc2);
     }
+    qsort(prgm->lclbls, prgm->lclbls_count, sizeof(lclbl_struct),
+          lclbl_compare);
+    prgm->lclbl_invalid = 0;
+}
+
+static void invalidate_lclbls(int prgm_index) {
+    prgms[prgm_index].lclbl_invalid = 1;
+}
+
+/* Updates the local label table after a line of 'length' bytes has been
+ * inserted at 'pc'.
+ */
+static void insert_lclbls(int prgm_index, int4 pc, int length) {
+    prgm_struct *prgm = prgms + prgm_index;
+    if (prgm->lclbl_invalid)
+        return;
+    int4 i;
+    for (i = 0; i < prgm->lclbls_count; i++)
+        if (prgm->lclbls[i].pc >= pc)
+            prgm->lclbls[i].pc += length;
+    int4 keys[2];
+    int n = get_lclbl_keys(prgm, pc, keys);
+    for (int k = 0; k < n; k++) {
+        if (prgm->lclbls_count == prgm->lclbls_capacity
+                && !grow_lclbls(prgm)) {
+            prgm->lclbl_invalid = 1;
+            return;
+        }
+        i = search_lclbls(prgm, keys[k], pc);
+        memmove(prgm->lclbls + i + 1, prgm->lclbls + i,
+                (prgm->lclbls_count - i) * sizeof(lclbl_struct));
+        prgm->lclbls[i].key = keys[k];
+        prgm->lclbls[i].pc = pc;
+        prgm->lclbls_count++;
+    }
+}
+
+/* Updates the local label table for the deletion of the 'length'-byte line
+ * at 'pc'. Must be called while that line is still in the program text.
+ */
+static void delete_lclbls(int prgm_index, int4 pc, int length) {
+    prgm_struct *prgm = prgms + prgm_index;
+    if (prgm->lclbl_invalid)
+        return;
+    int4 i;
+    int4 keys[2];
+    int n = get_lclbl_keys(prgm, pc, keys);
+    for (int k = 0; k < n; k++) {
+        i = search_lclbls(prgm, keys[k], pc);
+        memmove(prgm->lclbls + i, prgm->lclbls + i + 1,
+                (prgm->lclbls_count - i - 1) * sizeof(lclbl_struct));
+        prgm->lclbls_count--;
+    }
+    for (i = 0; i < prgm->lclbls_count; i++)
+        if (prgm->lclbls[i].pc > pc)
+            prgm->lclbls[i].pc -= length;
 }
 
 void delete_command(int4 pc) {
@@ -2316,39 +2881,40 @@ void delete_command(int4 pc) {
             /* Don't allow deletion of last program's END. */
             return;
         nextprgm = prgm + 1;
+        int lblindex = find_label_position(current_prgm, pc);
+        for (int i = lblindex + 1; i < labels_count; i++) {
+            if (labels[i].prgm == current_prgm + 1)
+                labels[i].pc += pc;
+            labels[i].prgm--;
+        }
+        remove_labels(lblindex, 1);
         prgm->size -= 2;
         newsize = prgm->size + nextprgm->size;
-        if (newsize > prgm->capacity) {
-            int4 newcapacity = (newsize + 511) & ~511;
-            unsigned char *newtext = (unsigned char *) malloc(newcapacity);
-            // TODO - handle memory allocation failure
-            for (pos = 0; pos < prgm->size; pos++)
-                newtext[pos] = prgm->text[pos];
-            free(prgm->text);
-            prgm->text = newtext;
-            prgm->capacity = newcapacity;
-        }
-        for (pos = 0; pos < nextprgm->size; pos++)
-            prgm->text[prgm->size++] = nextprgm->text[pos];
-        free(nextprgm->text);
+        // TODO - handle memory allocation failure
+        grow_prgm_text(prgm, newsize);
+        memcpy(prgm->text + prgm->size, nextprgm->text, nextprgm->size);
+        prgm->size = newsize;
+        free_prgm(current_prgm + 1);
+        invalidate_decoded(current_prgm);
         for (pos = current_prgm + 1; pos < prgms_count - 1; pos++)
             prgms[pos] = prgms[pos + 1];
         prgms_count--;
-        rebuild_label_table();
-        invalidate_lclbls(current_prgm, true);
+        invalidate_lclbls(current_prgm);
+        invalidate_line_pcs(current_prgm);
         clear_all_rtns();
         draw_varmenu();
         return;
     }
 
-    for (pos = pc; pos < prgm->size - length; pos++)
-        prgm->text[pos] = prgm->text[pos + length];
+    delete_lclbls(current_prgm, pc, length);
+    delete_line_pc(current_prgm, pc, length);
+    memmove(prgm->text + pc, prgm->text + pc + length,
+            prgm->size - pc - length);
     prgm->size -= length;
     if (command == CMD_LBL && argtype == ARGTYPE_STR)
-        rebuild_label_table();
-    else
-        update_label_table(current_prgm, pc, -length);
-    invalidate_lclbls(current_prgm, false);
+        remove_labels(find_label_position(current_prgm, pc), 1);
+    update_label_table(current_prgm, pc, -length);
+    invalidate_decoded(current_prgm);
     clear_all_rtns();
     draw_varmenu();
 }
@@ -2357,7 +2923,6 @@ void store_command(int4 pc, int command, arg_struct *arg) {
     unsigned char buf[100];
     int bufptr = 0;
     int i;
-    int4 pos;
     prgm_struct *prgm = prgms + current_prgm;
 
     /* We should never be called with pc = -1, but just to be safe... */
@@ -2399,32 +2964,32 @@ void store_command(int4 pc, int command, arg_struct *arg) {
      */
     if (command == CMD_END && prgm->size > 0) {
         prgm_struct *new_prgm;
-        if (prgms_count == prgms_capacity) {
-            prgm_struct *new_prgms;
-            int i;
-            prgms_capacity += 10;
-            new_prgms = (prgm_struct *)
-                            malloc(prgms_capacity * sizeof(prgm_struct));
-            // TODO - handle memory allocation failure
-            for (i = 0; i <= current_prgm; i++)
-                new_prgms[i] = prgms[i];
-            for (i = current_prgm + 1; i < prgms_count; i++)
-                new_prgms[i + 1] = prgms[i];
-            free(prgms);
-            prgms = new_prgms;
-            prgm = prgms + current_prgm;
-        } else {
-            for (i = prgms_count - 1; i > current_prgm; i--)
-                prgms[i + 1] = prgms[i];
-        }
+        // TODO - handle memory allocation failure
+        grow_prgms();
+        prgm = prgms + current_prgm;
+        memmove(prgm + 2, prgm + 1,
+                (prgms_count - current_prgm - 1) * sizeof(prgm_struct));
         prgms_count++;
         new_prgm = prgm + 1;
         new_prgm->size = prgm->size - pc;
-        new_prgm->capacity = (new_prgm->size + 511) & ~511;
-        new_prgm->text = (unsigned char *) malloc(new_prgm->capacity);
+        new_prgm->capacity = 0;
+        new_prgm->text = NULL;
         // TODO - handle memory allocation failure
-        for (i = pc; i < prgm->size; i++)
-            new_prgm->text[i - pc] = prgm->text[i];
+        grow_prgm_text(new_prgm, new_prgm->size);
+        memcpy(new_prgm->text, prgm->text + pc, new_prgm->size);
+        new_prgm->lclbls = NULL;
+        new_prgm->lclbls_count = 0;
+        new_prgm->lclbls_capacity = 0;
+        new_prgm->lines_invalid = 1;
+        new_prgm->line_pcs = NULL;
+        new_prgm->lines_count = 0;
+        new_prgm->lines_capacity = 0;
+        new_prgm->decoded = NULL;
+        new_prgm->decoded_line = 0;
+        new_prgm->decoded_jump = 0;
+        new_prgm->profile = NULL;
+        new_prgm->native = NULL;
+        invalidate_decoded(current_prgm);
         current_prgm++;
 
         /* Truncate the previously 'current' program and append an END.
@@ -2438,9 +3003,18 @@ void store_command(int4 pc, int command, arg_struct *arg) {
         if (flags.f.printer_exists && (flags.f.trace_print || flags.f.normal_print))
             print_program_line(current_prgm - 1, pc);
 
-        rebuild_label_table();
-        invalidate_lclbls(current_prgm, true);
-        invalidate_lclbls(current_prgm - 1, true);
+        /* Labels at or after the split point move to the new program */
+        int lblindex = find_label_position(current_prgm - 1, pc);
+        for (i = lblindex; i < labels_count; i++) {
+            if (labels[i].prgm == current_prgm - 1)
+                labels[i].pc -= pc;
+            labels[i].prgm++;
+        }
+        insert_label(lblindex, current_prgm - 1, pc, "", 0);
+        invalidate_lclbls(current_prgm);
+        invalidate_lclbls(current_prgm - 1);
+        invalidate_line_pcs(current_prgm);
+        invalidate_line_pcs(current_prgm - 1);
         clear_all_rtns();
         draw_varmenu();
         return;
@@ -2490,34 +3064,23 @@ void store_command(int4 pc, int command, arg_struct *arg) {
         }
     }
 
-    if (bufptr + prgm->size > prgm->capacity) {
-        unsigned char *newtext;
-        prgm->capacity += 512;
-        newtext = (unsigned char *) malloc(prgm->capacity);
-        // TODO - handle memory allocation failure
-        for (pos = 0; pos < pc; pos++)
-            newtext[pos] = prgm->text[pos];
-        for (pos = pc; pos < prgm->size; pos++)
-            newtext[pos + bufptr] = prgm->text[pos];
-        if (prgm->text != NULL)
-            free(prgm->text);
-        prgm->text = newtext;
-    } else {
-        for (pos = prgm->size - 1; pos >= pc; pos--)
-            prgm->text[pos + bufptr] = prgm->text[pos];
-    }
-    for (pos = 0; pos < bufptr; pos++)
-        prgm->text[pc + pos] = buf[pos];
+    // TODO - handle memory allocation failure
+    grow_prgm_text(prgm, prgm->size + bufptr);
+    memmove(prgm->text + pc + bufptr, prgm->text + pc, prgm->size - pc);
+    memcpy(prgm->text + pc, buf, bufptr);
     prgm->size += bufptr;
     if (command != CMD_END && flags.f.printer_exists && (flags.f.trace_print || flags.f.normal_print))
         print_program_line(current_prgm, pc);
     
+    update_label_table(current_prgm, pc, bufptr);
     if (command == CMD_END ||
             (command == CMD_LBL && arg->type == ARGTYPE_STR))
-        rebuild_label_table();
-    else
-        update_label_table(current_prgm, pc, bufptr);
-    invalidate_lclbls(current_prgm, false);
+        insert_label(find_label_position(current_prgm, pc), current_prgm, pc,
+                     command == CMD_END ? "" : arg->val.text,
+                     command == CMD_END ? 0 : arg->length);
+    insert_lclbls(current_prgm, pc, bufptr);
+    insert_line_pc(current_prgm, pc, bufptr);
+    invalidate_decoded(current_prgm);
     clear_all_rtns();
     if (!suppress_varmenu_update)
         draw_varmenu();
@@ -2531,23 +3094,121 @@ void store_command_after(int4 *pc, int command, arg_struct *arg) {
     store_command(*pc, command, arg);
 }
 
+static bool grow_line_pcs(prgm_struct *prgm, int4 min_capacity) {
+    int4 new_capacity = prgm->lines_capacity;
+    while (new_capacity < min_capacity)
+        new_capacity = new_capacity == 0 ? 64 : new_capacity * 2;
+    int4 *new_line_pcs = (int4 *)
+            realloc(prgm->line_pcs, new_capacity * sizeof(int4));
+    if (new_line_pcs == NULL)
+        return false;
+    prgm->line_pcs = new_line_pcs;
+    prgm->lines_capacity = new_capacity;
+    return true;
+}
+
+static bool rebuild_line_pcs(int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    int4 pc2 = 0;
+    prgm->lines_count = 0;
+    while (pc2 < prgm->size) {
+        if (prgm->lines_count == prgm->lines_capacity
+                && !grow_line_pcs(prgm, prgm->lines_count + 1))
+            return false;
+        prgm->line_pcs[prgm->lines_count++] = pc2;
+        pc2 += get_command_length(prgm_index, pc2);
+    }
+    prgm->lines_invalid = 0;
+    return true;
+}
+
+static void invalidate_line_pcs(int prgm_index) {
+    prgms[prgm_index].lines_invalid = 1;
+}
+
+/* Returns the index of the first line starting at or after 'pc' */
+static int4 search_line_pcs(prgm_struct *prgm, int4 pc) {
+    int4 lo = 0, hi = prgm->lines_count;
+    while (lo < hi) {
+        int4 mid = (lo + hi) / 2;
+        if (prgm->line_pcs[mid] < pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Updates the line index after a line of 'length' bytes has been inserted
+ * at 'pc'.
+ */
+static void insert_line_pc(int prgm_index, int4 pc, int length) {
+    prgm_struct *prgm = prgms + prgm_index;
+    if (prgm->lines_invalid)
+        return;
+    if (prgm->lines_count == prgm->lines_capacity
+            && !grow_line_pcs(prgm, prgm->lines_count + 1)) {
+        prgm->lines_invalid = 1;
+        return;
+    }
+    int4 i = search_line_pcs(prgm, pc);
+    memmove(prgm->line_pcs + i + 1, prgm->line_pcs + i,
+            (prgm->lines_count - i) * sizeof(int4));
+    prgm->line_pcs[i] = pc;
+    prgm->lines_count++;
+    for (i++; i < prgm->lines_count; i++)
+        prgm->line_pcs[i] += length;
+}
+
+/* Updates the line index for the deletion of the 'length'-byte line at
+ * 'pc'.
+ */
+static void delete_line_pc(int prgm_index, int4 pc, int length) {
+    prgm_struct *prgm = prgms + prgm_index;
+    if (prgm->lines_invalid)
+        return;
+    int4 i = search_line_pcs(prgm, pc);
+    memmove(prgm->line_pcs + i, prgm->line_pcs + i + 1,
+            (prgm->lines_count - i - 1) * sizeof(int4));
+    prgm->lines_count--;
+    for (; i < prgm->lines_count; i++)
+        prgm->line_pcs[i] -= length;
+}
+
 static int pc_line_convert(int4 loc, int loc_is_pc) {
-    int4 pc = 0;
-    int4 line = 1;
     prgm_struct *prgm = prgms + current_prgm;
 
-    while (1) {
-        if (loc_is_pc) {
-            if (pc >= loc)
-                return line;
-        } else {
-            if (line >= loc)
-                return pc;
+    if (prgm->lines_invalid && !rebuild_line_pcs(current_prgm)) {
+        /* Out of memory; fall back on walking the program */
+        int4 pc = 0;
+        int4 line = 1;
+        while (1) {
+            if (loc_is_pc) {
+                if (pc >= loc)
+                    return line;
+            } else {
+                if (line >= loc)
+                    return pc;
+            }
+            if (prgm->text[pc] == CMD_END)
+                return loc_is_pc ? line : pc;
+            pc += get_command_length(current_prgm, pc);
+            line++;
         }
-        if (prgm->text[pc] == CMD_END)
-            return loc_is_pc ? line : pc;
-        pc += get_command_length(current_prgm, pc);
-        line++;
+    }
+
+    /* Locations past the END map to the END */
+    if (loc_is_pc) {
+        int4 i = search_line_pcs(prgm, loc);
+        if (i >= prgm->lines_count)
+            i = prgm->lines_count - 1;
+        return i + 1;
+    } else {
+        if (loc < 1)
+            loc = 1;
+        else if (loc > prgm->lines_count)
+            loc = prgm->lines_count;
+        return prgm->line_pcs[loc - 1];
     }
 }
 
@@ -2567,66 +3228,30 @@ int4 line2pc(int4 line) {
 
 int4 find_local_label(const arg_struct *arg) {
     int4 orig_pc = pc;
-    int4 search_pc;
-    int wrapped = 0;
     prgm_struct *prgm = prgms + current_prgm;
+    int4 key, i;
 
     if (orig_pc == -1)
         orig_pc = 0;
-    search_pc = orig_pc;
+    if (prgm->lclbl_invalid)
+        rebuild_lclbls(current_prgm);
 
-    while (!wrapped || search_pc < orig_pc) {
-        int command, argtype;
-        if (search_pc >= prgm->size - 2) {
-            if (orig_pc == 0)
-                break;
-            search_pc = 0;
-            wrapped = 1;
-        }
-        command = prgm->text[search_pc];
-        argtype = prgm->text[search_pc + 1];
-        command |= (argtype & 240) << 4;
-        argtype &= 15;
-        if (command == CMD_LBL && (argtype == arg->type
-                                || argtype == ARGTYPE_STK)) {
-            if (argtype == ARGTYPE_NUM) {
-                int num = 0;
-                unsigned char c;
-                int pos = search_pc + 2;
-                do {
-                    c = prgm->text[pos++];
-                    num = (num << 7) | (c & 127);
-                } while ((c & 128) == 0);
-                if (num == arg->val.num)
-                    return search_pc;
-            } else if (argtype == ARGTYPE_STK) {
-                // Synthetic LBL ST T etc.
-                // Allow GTO ST T and GTO 112
-                char stk = prgm->text[search_pc + 2];
-                if (arg->type == ARGTYPE_STK) {
-                    if (stk = arg->val.stk)
-                        return search_pc;
-                } else if (arg->type == ARGTYPE_NUM) {
-                    int num = 0;
-                    switch (stk) {
-                        case 'T': num = 112; break;
-                        case 'Z': num = 113; break;
-                        case 'Y': num = 114; break;
-                        case 'X': num = 115; break;
-                        case 'L': num = 116; break;
-                    }
-                    if (num == arg->val.num)
-                        return search_pc;
-                }
-            } else {
-                char lclbl = prgm->text[search_pc + 2];
-                if (lclbl == arg->val.lclbl)
-                    return search_pc;
-            }
-        }
-        search_pc += get_command_length(current_prgm, search_pc);
-    }
+    if (arg->type == ARGTYPE_NUM)
+        key = arg->val.num;
+    else if (arg->type == ARGTYPE_STK)
+        key = STK_LBL_KEY(arg->val.stk);
+    else
+        key = LCLBL_KEY(arg->val.lclbl);
 
+    /* Search forward from the current line; if that fails, wrap around
+     * and take the first occurrence in the program.
+     */
+    i = search_lclbls(prgm, key, orig_pc);
+    if (i < prgm->lclbls_count && prgm->lclbls[i].key == key)
+        return prgm->lclbls[i].pc;
+    i = search_lclbls(prgm, key, 0);
+    if (i < prgm->lclbls_count && prgm->lclbls[i].key == key)
+        return prgm->lclbls[i].pc;
     return -2;
 }
 
@@ -2634,21 +3259,26 @@ int find_global_label(const arg_struct *arg, int *prgm, int4 *pc) {
     int i;
     const char *name = arg->val.text;
     int namelen = arg->length;
-    for (i = labels_count - 1; i >= 0; i--) {
-        int j;
-        char *labelname;
-        if (labels[i].length != namelen)
-            continue;
-        labelname = labels[i].name;
-        for (j = 0; j < namelen; j++)
-            if (labelname[j] != name[j])
-                goto nomatch;
-        *prgm = labels[i].prgm;
-        *pc = labels[i].pc;
-        return 1;
-        nomatch:;
+    if (namelen == 0) {
+        /* ENDs aren't hashed; the last one is always the last label */
+        if (labels_count == 0)
+            return 0;
+        i = labels_count - 1;
+    } else {
+        if (label_hash_size != 0)
+            i = label_hash[label_hash_code(name, namelen)];
+        else
+            /* No hash table; see rebuild_label_hash() */
+            i = labels_count - 1;
+        for (; i != -1; i = label_hash_size != 0 ? label_hash_next[i] : i - 1)
+            if (string_equals(labels[i].name, labels[i].length, name, namelen))
+                break;
+        if (i == -1)
+            return 0;
     }
-    return 0;
+    *prgm = labels[i].prgm;
+    *pc = labels[i].pc;
+    return 1;
 }
 
 int push_rtn_addr(int prgm, int4 pc) {
@@ -2748,47 +3378,8 @@ bool should_i_stop_at_this_level() {
     return stop;
 }
 
-static void remove_locals() {
-    int last = -1;
-    for (int i = vars_count - 1; i >= 0; i--) {
-        if (vars[i].level == -1)
-            continue;
-        if (vars[i].level < rtn_level)
-            break;
-        if ((matedit_mode == 1 || matedit_mode == 3)
-                && string_equals(vars[i].name, vars[i].length, matedit_name, matedit_length)) {
-            if (matedit_mode == 3) {
-                set_appmenu_exitcallback(0);
-                set_menu(MENULEVEL_APP, MENU_NONE);
-            }
-            matedit_mode = 0;
-        }
-        if (vars[i].hiding) {
-            for (int j = i - 1; j >= 0; j--)
-                if (vars[j].hidden && string_equals(vars[i].name, vars[i].length, vars[j].name, vars[j].length)) {
-                    vars[j].hidden = false;
-                    break;
-                }
-        }
-        free_vartype(vars[i].value);
-        vars[i].length = 100;
-        last = i;
-    }
-    if (last == -1)
-        return;
-    int from = last;
-    int to = last;
-    while (from < vars_count) {
-        if (vars[from].length != 100)
-            vars[to++] = vars[from];
-        from++;
-    }
-    vars_count -= from - to;
-    update_catalog();
-}
-
 void pop_rtn_addr(int *prgm, int4 *pc, bool *stop) {
-    remove_locals();
+    remove_locals(rtn_level);
     if (rtn_level == 0) {
         *prgm = -1;
         *pc = -1;
@@ -3695,6 +4286,7 @@ void hard_reset(int reason) {
         labels_capacity = 0;
         labels_count = 0;
     }
+    free_label_hash();
     goto_dot_dot(false);
 
     pending_command = CMD_NONE;
@@ -3902,6 +4494,8 @@ static bool convert_programs(bool *clear_stack) {
         int4 oldpc = 0;
         prgm_struct *prgm = prgms + i;
         prgm->lclbl_invalid = 1;
+        invalidate_line_pcs(i);
+        invalidate_decoded(i);
         while (true) {
             while (mod_count >= 0 && current_prgm == mod_prgm[mod_count]
                                   && oldpc >= mod_pc[mod_count]) {
@@ -3963,25 +4557,11 @@ static bool convert_programs(bool *clear_stack) {
                         pc -= sizeof(double);
 
                         int growth = sizeof(phloat) - sizeof(double);
-                        int4 pos;
-                        if (prgm->size + growth > prgm->capacity) {
-                            unsigned char *newtext;
-                            prgm->capacity += 512;
-                            newtext = (unsigned char *) malloc(prgm->capacity);
-                            if (newtext == NULL)
-                                // Failed to grow program; abort.
-                                goto end;
-                            for (pos = 0; pos < pc; pos++)
-                                newtext[pos] = prgm->text[pos];
-                            for (pos = pc; pos < prgm->size; pos++)
-                                newtext[pos + growth] = prgm->text[pos];
-                            if (prgm->text != NULL)
-                                free(prgm->text);
-                            prgm->text = newtext;
-                        } else {
-                            for (pos = prgm->size - 1; pos >= pc; pos--)
-                                prgm->text[pos + growth] = prgm->text[pos];
-                        }
+                        if (!grow_prgm_text(prgm, prgm->size + growth))
+                            // Failed to grow program; abort.
+                            goto end;
+                        memmove(prgm->text + pc + growth, prgm->text + pc,
+                                prgm->size - pc);
                         prgm->size += growth;
                         oldpc -= growth;
 
@@ -4033,6 +4613,7 @@ static void update_decimal_in_programs() {
         current_prgm = i;
         pc = 0;
         prgm_struct *prgm = prgms + i;
+        invalidate_decoded(i);
         while (true) {
             int command = prgm->text[pc++];
             int argtype = prgm->text[pc++];
@@ -25,7 +25,7 @@
 #include "core_phloat.h"
 #include "core_tables.h"
 
-extern FILE *gfile;
+extern CORE_TLS FILE *gfile;
 
 /**********/
 /* Errors */
@@ -272,13 +272,13 @@ typedef struct {
 /******************/
 
 /* Registers */
-extern vartype *reg_x;
-extern vartype *reg_y;
-extern vartype *reg_z;
-extern vartype *reg_t;
-extern vartype *reg_lastx;
-extern int reg_alpha_length;
-extern char reg_alpha[44];
+extern CORE_TLS vartype *reg_x;
+extern CORE_TLS vartype *reg_y;
+extern CORE_TLS vartype *reg_z;
+extern CORE_TLS vartype *reg_t;
+extern CORE_TLS vartype *reg_lastx;
+extern CORE_TLS int reg_alpha_length;
+extern CORE_TLS char reg_alpha[44];
 
 /* FLAGS
  * Note: flags whose names start with VIRTUAL_ are named here for reference
@@ -365,7 +365,7 @@ typedef union {
         char f95; char f96; char f97; char f98; char f99;
     } f;
 } flags_struct;
-extern flags_struct flags;
+extern CORE_TLS flags_struct flags;
 
 /* Variables */
 typedef struct {
@@ -376,16 +376,104 @@ typedef struct {
     bool hiding;
     vartype *value;
 } var_struct;
-extern int vars_capacity;
-extern int vars_count;
-extern var_struct *vars;
+extern CORE_TLS int vars_capacity;
+extern CORE_TLS int vars_count;
+extern CORE_TLS var_struct *vars;
 
 /* Programs */
+/* Inline cache for the indirect argument of one program line, filled by
+ * resolve_ind_arg() and docmd_gto(). It remembers the last pointer value,
+ * either bitwise for reals or as text for strings, and what it resolved to;
+ * since that is a function of the value alone, a pointer holding the same
+ * value as last time is resolved by copying 'arg'. The pointer variable of
+ * IND "name" (source), and the GTO/XEQ target, are also cached, but those
+ * depend on variables and labels, so they are only valid while their
+ * generation numbers equal lookup_generation.
+ */
+typedef struct {
+    unsigned char type;
+    bool is_string;
+    union {
+        char x[sizeof(phloat)];
+        char text[15];
+    } key;
+    arg_struct arg;
+    uint4 source_gen;
+    const vartype *source;
+    uint4 target_gen;
+    int target_prgm;
+    int4 target_pc;
+} ind_cache_struct;
+/* Pre-decoded program line, as returned by get_next_command(). The decoded
+ * array is built lazily, the first time a program is run, and is discarded
+ * whenever the program text is modified. The byte-coded 'text' remains the
+ * authoritative representation of the program.
+ *
+ * 'fused' is the number of lines, starting with this one, that
+ * continue_running() may execute as a single superinstruction; 1 means no
+ * fusion. See fuse_decoded(). 'ind' is the line's inline cache if it has an
+ * indirect argument, and NULL otherwise.
+ */
+typedef struct {
+    int cmd;
+    int fused;
+    int4 next_pc;
+    arg_struct arg;
+    ind_cache_struct *ind;
+} decoded_cmd_struct;
+/* Execution profile of one program line; see core_profile(). */
+typedef struct {
+    uint4 hits;
+    uint8 ticks;
+} profile_line_struct;
+/* Local label table entry. Keys are the label number for LBL 00-99, and
+ * negative values for LBL A-J, a-e, and the synthetic LBL ST T etc.; see
+ * find_local_label().
+ */
+typedef struct {
+    int4 key;
+    int4 pc;
+} lclbl_struct;
 typedef struct {
     int4 capacity;
     int4 size;
     int lclbl_invalid;
     unsigned char *text;
+    /* Local labels, sorted by key and pc. Rebuilt lazily when lclbl_invalid
+     * is set, and kept up to date by single-line edits otherwise.
+     */
+    lclbl_struct *lclbls;
+    int4 lclbls_count;
+    int4 lclbls_capacity;
+    /* Line start offsets: line_pcs[n] is the pc of line n + 1, the last
+     * entry being the END. Used by pc2line() and line2pc(); rebuilt lazily
+     * when lines_invalid is set, and kept up to date by single-line edits
+     * otherwise.
+     */
+    int lines_invalid;
+    int4 *line_pcs;
+    int4 lines_count;
+    int4 lines_capacity;
+    /* Decoded instruction cache; NULL if not built yet. Indexed by line,
+     * like line_pcs, which is what maps a pc to its entry. 'decoded_line'
+     * is the entry last looked up, so the line after it, which is usually
+     * the next one asked for, is found without searching; 'decoded_jump'
+     * is the last one that did have to be searched for, which is usually
+     * the top of a loop.
+     */
+    decoded_cmd_struct *decoded;
+    int4 decoded_line;
+    int4 decoded_jump;
+    /* Profiler data, indexed by line, like line_pcs; NULL unless the
+     * program has run while profiling was on. Discarded along with the
+     * decoded instruction cache.
+     */
+    profile_line_struct *profile;
+    /* Compiled version of this program, if one was registered whose text
+     * matches; looked up when the decoded instruction cache is built, and
+     * dropped along with it. See core_native.h.
+     */
+    const struct native_prgm_struct *native;
 } prgm_struct;
 typedef struct {
     int4 capacity;
@@ -393,81 +481,92 @@ typedef struct {
     int lclbl_invalid;
     int4 text;
 } prgm_struct_32bit;
-extern int prgms_capacity;
-extern int prgms_count;
-extern prgm_struct *prgms;
+extern CORE_TLS int prgms_capacity;
+extern CORE_TLS int prgms_count;
+extern CORE_TLS prgm_struct *prgms;
 typedef struct {
     unsigned char length;
     char name[7];
     int prgm;
     int4 pc;
 } label_struct;
-extern int labels_capacity;
-extern int labels_count;
-extern label_struct *labels;
-
-extern int current_prgm;
-extern int4 pc;
-extern int prgm_highlight_row;
-
-extern int varmenu_length;
-extern char varmenu[7];
-extern int varmenu_rows;
-extern int varmenu_row;
-extern int varmenu_labellength[6];
-extern char varmenu_labeltext[6][7];
-extern int varmenu_role;
+extern CORE_TLS int labels_capacity;
+extern CORE_TLS int labels_count;
+extern CORE_TLS label_struct *labels;
+
+extern CORE_TLS int current_prgm;
+extern CORE_TLS int4 pc;
+extern CORE_TLS int prgm_highlight_row;
+/* Inline cache of the program line being executed from the decoded
+ * instruction cache, or NULL; see ind_cache_struct. */
+extern CORE_TLS ind_cache_struct *ind_cache;
+/* Bumped whenever variables are created, replaced, or deleted, and whenever
+ * programs or labels change, which invalidates the sources and targets
+ * in all inline caches. Never 0, which marks an unfilled entry. */
+extern CORE_TLS uint4 lookup_generation;
+static inline void bump_lookup_generation() {
+    if (++lookup_generation == 0)
+        lookup_generation = 1;
+}
+
+extern CORE_TLS int varmenu_length;
+extern CORE_TLS char varmenu[7];
+extern CORE_TLS int varmenu_rows;
+extern CORE_TLS int varmenu_row;
+extern CORE_TLS int varmenu_labellength[6];
+extern CORE_TLS char varmenu_labeltext[6][7];
+extern CORE_TLS int varmenu_role;
 
 
 /****************/
 /* More globals */
 /****************/
 
-extern bool mode_clall;
-extern int (*mode_interruptible)(int);
-extern bool mode_stoppable;
-extern bool mode_command_entry;
-extern bool mode_number_entry;
-extern bool mode_alpha_entry;
-extern bool mode_shift;
-extern int mode_appmenu;
-extern int mode_plainmenu;
-extern bool mode_plainmenu_sticky;
-extern int mode_transientmenu;
-extern int mode_alphamenu;
-extern int mode_commandmenu;
-extern bool mode_running;
-extern bool mode_getkey;
-extern bool mode_pause;
-extern bool mode_disable_stack_lift;
-extern bool mode_varmenu;
-extern bool mode_updown;
-extern int4 mode_sigma_reg;
-extern int mode_goose;
-extern bool mode_time_clktd;
-extern bool mode_time_clk24;
-extern int mode_wsize;
-
-extern phloat entered_number;
-extern int entered_string_length;
-extern char entered_string[15];
-
-extern int pending_command;
-extern arg_struct pending_command_arg;
-extern int xeq_invisible;
+extern CORE_TLS bool mode_clall;
+extern CORE_TLS int (*mode_interruptible)(int);
+extern CORE_TLS bool mode_stoppable;
+extern CORE_TLS bool mode_command_entry;
+extern CORE_TLS bool mode_number_entry;
+extern CORE_TLS bool mode_alpha_entry;
+extern CORE_TLS bool mode_shift;
+extern CORE_TLS int mode_appmenu;
+extern CORE_TLS int mode_plainmenu;
+extern CORE_TLS bool mode_plainmenu_sticky;
+extern CORE_TLS int mode_transientmenu;
+extern CORE_TLS int mode_alphamenu;
+extern CORE_TLS int mode_commandmenu;
+extern CORE_TLS bool mode_running;
+extern CORE_TLS bool mode_getkey;
+extern CORE_TLS bool mode_pause;
+extern CORE_TLS bool mode_disable_stack_lift;
+extern CORE_TLS bool mode_varmenu;
+extern CORE_TLS bool mode_updown;
+extern CORE_TLS int4 mode_sigma_reg;
+extern CORE_TLS int mode_goose;
+extern CORE_TLS bool mode_time_clktd;
+extern CORE_TLS bool mode_time_clk24;
+extern CORE_TLS int mode_wsize;
+
+extern CORE_TLS_PHLOAT phloat entered_number;
+extern CORE_TLS int entered_string_length;
+extern CORE_TLS char entered_string[15];
+
+extern CORE_TLS int pending_command;
+extern CORE_TLS_PHLOAT arg_struct pending_command_arg;
+extern CORE_TLS int xeq_invisible;
 
 /* Multi-keystroke commands -- edit state */
 /* Relevant when mode_command_entry != 0 */
-extern int incomplete_command;
-extern int incomplete_ind;
-extern int incomplete_alpha;
-extern int incomplete_length;
-extern int incomplete_maxdigits;
-extern int incomplete_argtype;
-extern int incomplete_num;
-extern char incomplete_str[7];
-extern int4 incomplete_saved_pc;
-extern int4 incomplete_saved_highlight_row;
+extern CORE_TLS int incomplete_command;
+extern CORE_TLS int incomplete_ind;
+extern CORE_TLS int incomplete_alpha;
+extern CORE_TLS int incomplete_length;
+extern CORE_TLS int incomplete_maxdigits;
+extern CORE_TLS int incomplete_argtype;
+extern CORE_TLS int incomplete_num;
+extern CORE_TLS char incomplete_str[7];
+extern CORE_TLS int4 incomplete_saved_pc;
+extern CORE_TLS int4 incomplete_saved_highlight_row;
 
 #define CATSECT_TOP 0
 #define CATSECT_FCN 1
@@ -483,49 +582,49 @@ extern int4 incomplete_saved_highlight_row;
 #define CATSECT_PGM_INTEG 11
 
 /* Command line handling temporaries */
-extern char cmdline[100];
-extern int cmdline_length;
-extern int cmdline_row;
+extern CORE_TLS char cmdline[100];
+extern CORE_TLS int cmdline_length;
+extern CORE_TLS int cmdline_row;
 
 /* Matrix editor / matrix indexing */
-extern int matedit_mode; /* 0=off, 1=index, 2=edit, 3=editn */
-extern char matedit_name[7];
-extern int matedit_length;
-extern vartype *matedit_x;
-extern int4 matedit_i;
-extern int4 matedit_j;
-extern int matedit_prev_appmenu;
+extern CORE_TLS int matedit_mode; /* 0=off, 1=index, 2=edit, 3=editn */
+extern CORE_TLS char matedit_name[7];
+extern CORE_TLS int matedit_length;
+extern CORE_TLS vartype *matedit_x;
+extern CORE_TLS int4 matedit_i;
+extern CORE_TLS int4 matedit_j;
+extern CORE_TLS int matedit_prev_appmenu;
 
 /* INPUT */
-extern char input_name[11];
-extern int input_length;
-extern arg_struct input_arg;
+extern CORE_TLS char input_name[11];
+extern CORE_TLS int input_length;
+extern CORE_TLS_PHLOAT arg_struct input_arg;
 
 /* BASE application */
-extern int baseapp;
+extern CORE_TLS int baseapp;
 
 /* Random number generator */
-extern int8 random_number_low, random_number_high;
+extern CORE_TLS int8 random_number_low, random_number_high;
 
 /* NORM & TRACE mode: number waiting to be printed */
-extern int deferred_print;
+extern CORE_TLS int deferred_print;
 
 /* Keystroke buffer - holds keystrokes received while
  * there is a program running.
  */
-extern int keybuf_head;
-extern int keybuf_tail;
-extern int keybuf[16];
+extern CORE_TLS int keybuf_head;
+extern CORE_TLS int keybuf_tail;
+extern CORE_TLS int keybuf[16];
 
-extern int remove_program_catalog;
+extern CORE_TLS int remove_program_catalog;
 
 #define NUMBER_FORMAT_BINARY 0
 #define NUMBER_FORMAT_BCD20_OLD 1
 #define NUMBER_FORMAT_BCD20_NEW 2
 #define NUMBER_FORMAT_BID128 3
-extern int state_file_number_format;
+extern CORE_TLS int state_file_number_format;
 
-extern bool no_keystrokes_yet;
+extern CORE_TLS bool no_keystrokes_yet;
 
 
 /*********************/
@@ -541,6 +640,10 @@ int mvar_prgms_exist();
 int label_has_mvar(int lblindex);
 int get_command_length(int prgm, int4 pc);
 void get_next_command(int4 *pc, int *command, arg_struct *arg, int find_target);
+void get_next_decoded_command(int4 *pc, int *command, arg_struct *arg);
+decoded_cmd_struct *get_decoded_command(int4 pc);
+void resolve_decoded_target(decoded_cmd_struct *dc);
+void invalidate_decoded(int prgm_index);
 void rebuild_label_table();
 void delete_command(int4 pc);
 void store_command(int4 pc, int command, arg_struct *arg);
@@ -562,7 +665,7 @@ bool solve_active();
 bool integ_active();
 bool unwind_stack_until_solve();
 
-extern bool state_is_portable;
+extern CORE_TLS bool state_is_portable;
 
 bool read_bool(bool *b);
 bool write_bool(bool b);
@@ -17,6 +17,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "core_helpers.h"
 #include "core_commands2.h"
@@ -27,11 +28,47 @@
 #include "shell.h"
 
 
+/* Inline cache helpers for resolve_ind_arg(); 'c' is the entry of the line
+ * being executed, and 'type' the indirect argument type it was resolving.
+ * On a hit, 'arg' is set to the cached resolution.
+ */
+static bool ind_cache_hit(const ind_cache_struct *c, int type, arg_struct *arg,
+                          bool is_string, const char *key, int len) {
+    if (c->type != type || c->is_string != is_string)
+        return false;
+    if (is_string) {
+        if (c->arg.length != len || memcmp(c->key.text, key, len) != 0)
+            return false;
+    } else {
+        if (memcmp(c->key.x, key, sizeof(phloat)) != 0)
+            return false;
+    }
+    *arg = c->arg;
+    return true;
+}
+
+static void ind_cache_fill(ind_cache_struct *c, int type, const arg_struct *arg,
+                           bool is_string, const char *key, int len) {
+    /* The target belonged to the previous resolution */
+    c->target_gen = 0;
+    if (is_string && len > (int) sizeof(c->key.text)) {
+        c->type = ARGTYPE_NONE;
+        return;
+    }
+    c->type = type;
+    c->is_string = is_string;
+    memcpy(is_string ? c->key.text : c->key.x, key,
+           is_string ? len : sizeof(phloat));
+    c->arg = *arg;
+}
+
 int resolve_ind_arg(arg_struct *arg) {
     vartype *v;
-    switch (arg->type) {
+    ind_cache_struct *c = ind_cache;
+    int type = arg->type;
+    switch (type) {
         case ARGTYPE_IND_NUM: {
-            vartype *regs = recall_var("REGS", 4);
+            vartype *regs = recall_regs();
             if (regs == NULL)
                 return ERR_SIZE_ERROR;
             if (regs->type != TYPE_REALMATRIX)
@@ -42,17 +79,25 @@ int resolve_ind_arg(arg_struct *arg) {
                 int4 num = arg->val.num;
                 if (num >= size)
                     return ERR_SIZE_ERROR;
+                phloat *d = &rm->array->data[num];
                 if (rm->array->is_string[num]) {
-                    phloat *d = &rm->array->data[num];
                     int len = phloat_length(*d);
                     if (len == 0)
                         return ERR_RESTRICTED_OPERATION;
+                    if (c != NULL && ind_cache_hit(c, type, arg, true,
+                                                   phloat_text(*d), len))
+                        return ERR_NONE;
                     arg->type = ARGTYPE_STR;
                     arg->length = len;
                     for (int i = 0; i < len; i++)
                         arg->val.text[i] = phloat_text(*d)[i];
+                    if (c != NULL)
+                        ind_cache_fill(c, type, arg, true, phloat_text(*d), len);
                 } else {
-                    phloat x = rm->array->data[num];
+                    if (c != NULL && ind_cache_hit(c, type, arg, false,
+                                                   (const char *) d, 0))
+                        return ERR_NONE;
+                    phloat x = *d;
                     if (x < 0)
                         x = -x;
                     if (x >= 2147483648.0)
@@ -60,6 +105,8 @@ int resolve_ind_arg(arg_struct *arg) {
                     else
                         arg->val.num = to_int4(x);
                     arg->type = ARGTYPE_NUM;
+                    if (c != NULL)
+                        ind_cache_fill(c, type, arg, false, (const char *) d, 0);
                 }
                 return ERR_NONE;
             }
@@ -75,12 +122,26 @@ int resolve_ind_arg(arg_struct *arg) {
             goto finish_resolve;
         }
         case ARGTYPE_IND_STR: {
-            v = recall_var(arg->val.text, arg->length);
-            if (v == NULL)
-                return ERR_NONEXISTENT;
+            /* The variable itself is cached as well, for as long as no
+             * variables are created, replaced, or deleted */
+            if (c != NULL && c->source_gen == lookup_generation)
+                v = (vartype *) c->source;
+            else {
+                v = recall_var(arg->val.text, arg->length);
+                if (v == NULL)
+                    return ERR_NONEXISTENT;
+                if (c != NULL) {
+                    c->source = v;
+                    c->source_gen = lookup_generation;
+                }
+            }
             finish_resolve:
             if (v->type == TYPE_REAL) {
-                phloat x = ((vartype_real *) v)->x;
+                phloat *xp = &((vartype_real *) v)->x;
+                if (c != NULL && ind_cache_hit(c, type, arg, false,
+                                               (const char *) xp, 0))
+                    return ERR_NONE;
+                phloat x = *xp;
                 if (x < 0)
                     x = -x;
                 if (x >= 2147483648.0)
@@ -88,15 +149,22 @@ int resolve_ind_arg(arg_struct *arg) {
                 else
                     arg->val.num = to_int4(x);
                 arg->type = ARGTYPE_NUM;
+                if (c != NULL)
+                    ind_cache_fill(c, type, arg, false, (const char *) xp, 0);
                 return ERR_NONE;
             } else if (v->type == TYPE_STRING) {
                 vartype_string *s = (vartype_string *) v;
                 if (s->length == 0)
                     return ERR_RESTRICTED_OPERATION;
+                if (c != NULL && ind_cache_hit(c, type, arg, true,
+                                               s->text, s->length))
+                    return ERR_NONE;
                 arg->type = ARGTYPE_STR;
                 arg->length = s->length;
                 for (int i = 0; i < s->length; i++)
                     arg->val.text[i] = s->text[i];
+                if (c != NULL)
+                    ind_cache_fill(c, type, arg, true, s->text, s->length);
                 return ERR_NONE;
             } else
                 return ERR_INVALID_TYPE;
@@ -254,7 +322,7 @@ bool string_equals(const char *s1, int s1len, const char *s2, int s2len) {
 }
 
 #if (!defined(ANDROID) && !defined(IPHONE))
-static bool always_on = false;
+static CORE_TLS bool always_on = false;
 int shell_always_on(int ao) {
     int ret = always_on ? 1 : 0;
     if (ao != -1)
@@ -1273,8 +1341,8 @@ char *phloat2program(phloat d) {
     /* Converts a phloat to its most compact representation;
      * used for generating HP-42S style number literals in programs.
      */
-    static char allbuf[50];
-    static char scibuf[50];
+    static CORE_TLS char allbuf[50];
+    static CORE_TLS char scibuf[50];
     int alllen;
     int scilen;
     char dot = flags.f.decimal_point ? '.' : ',';
@@ -27,9 +27,9 @@
 /***** Matrix-matrix division *****/
 /**********************************/
 
-static void (*linalg_div_completion)(int, vartype *);
-static const vartype *linalg_div_left;
-static vartype *linalg_div_result;
+static CORE_TLS void (*linalg_div_completion)(int, vartype *);
+static CORE_TLS const vartype *linalg_div_left;
+static CORE_TLS vartype *linalg_div_result;
 
 static int div_rr_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                     phloat det);
@@ -307,7 +307,7 @@ typedef struct {
     void (*completion)(int error, vartype *result);
 } mul_rr_data_struct;
 
-static mul_rr_data_struct *mul_rr_data;
+static CORE_TLS mul_rr_data_struct *mul_rr_data;
 
 static int matrix_mul_rr_worker(int interrupted);
 
@@ -561,7 +561,7 @@ typedef struct {
     void (*completion)(int error, vartype *result);
 } mul_rc_data_struct;
 
-static mul_rc_data_struct *mul_rc_data;
+static CORE_TLS mul_rc_data_struct *mul_rc_data;
 
 static int matrix_mul_rc_worker(int interrupted);
 
@@ -694,7 +694,7 @@ typedef struct {
     void (*completion)(int error, vartype *result);
 } mul_cr_data_struct;
 
-static mul_cr_data_struct *mul_cr_data;
+static CORE_TLS mul_cr_data_struct *mul_cr_data;
 
 static int matrix_mul_cr_worker(int interrupted);
 
@@ -827,7 +827,7 @@ typedef struct {
     void (*completion)(int error, vartype *result);
 } mul_cc_data_struct;
 
-static mul_cc_data_struct *mul_cc_data;
+static CORE_TLS mul_cc_data_struct *mul_cc_data;
 
 static int matrix_mul_cc_worker(int interrupted);
 
@@ -977,8 +977,8 @@ int linalg_mul(const vartype *left, const vartype *right,
 /***** Matrix inverse *****/
 /**************************/
 
-static void (*linalg_inv_completion)(int error, vartype *det);
-static vartype *linalg_inv_result;
+static CORE_TLS void (*linalg_inv_completion)(int error, vartype *det);
+static CORE_TLS vartype *linalg_inv_result;
 
 static int inv_r_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                 phloat det);
@@ -1104,8 +1104,8 @@ static void inv_c_completion2(int error, vartype_complexmatrix *a, int4 *perm,
 /***** Matrix determinant *****/
 /******************************/
 
-static void (*linalg_det_completion)(int error, vartype *det);
-static bool linalg_det_prev_sm_err;
+static CORE_TLS void (*linalg_det_completion)(int error, vartype *det);
+static CORE_TLS bool linalg_det_prev_sm_err;
 
 static int det_r_completion(int error, vartype_realmatrix *a, int4 *perm,
                                     phloat det);
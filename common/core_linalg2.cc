@@ -45,7 +45,7 @@ typedef struct {
     int (*completion)(int, vartype_realmatrix *, int4 *, phloat);
 } lu_r_data_struct;
 
-lu_r_data_struct *lu_r_data;
+CORE_TLS lu_r_data_struct *lu_r_data;
 
 static int lu_decomp_r_worker(int interrupted);
 
@@ -228,7 +228,7 @@ typedef struct {
     int (*completion)(int, vartype_complexmatrix *, int4 *, phloat, phloat);
 } lu_c_data_struct;
 
-lu_c_data_struct *lu_c_data;
+CORE_TLS lu_c_data_struct *lu_c_data;
 
 static int lu_decomp_c_worker(int interrupted);
 
@@ -451,7 +451,7 @@ typedef struct {
     void (*completion)(int, vartype_realmatrix *, int4 *, vartype_realmatrix *);
 } backsub_rr_data_struct;
 
-static backsub_rr_data_struct *backsub_rr_data;
+static CORE_TLS backsub_rr_data_struct *backsub_rr_data;
 
 static int lu_backsubst_rr_worker(int interrupted);
 
@@ -567,7 +567,7 @@ typedef struct {
                                             vartype_complexmatrix *);
 } backsub_rc_data_struct;
 
-static backsub_rc_data_struct *backsub_rc_data;
+static CORE_TLS backsub_rc_data_struct *backsub_rc_data;
 
 static int lu_backsubst_rc_worker(int interrupted);
 
@@ -704,7 +704,7 @@ typedef struct {
                                             vartype_complexmatrix *);
 } backsub_cc_data_struct;
 
-static backsub_cc_data_struct *backsub_cc_data;
+static CORE_TLS backsub_cc_data_struct *backsub_cc_data;
 
 static int lu_backsubst_cc_worker(int interrupted);
 
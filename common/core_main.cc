@@ -20,6 +20,14 @@
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#ifndef FREE42_SINGLE_INSTANCE
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "core_main.h"
 #include "core_commands2.h"
@@ -29,6 +37,7 @@
 #include "core_helpers.h"
 #include "core_keydown.h"
 #include "core_math1.h"
+#include "core_native.h"
 #include "core_sto_rcl.h"
 #include "core_tables.h"
 #include "core_variables.h"
@@ -50,16 +59,57 @@ static void set_shift(bool state) {
 }
 
 static void continue_running();
+static void profile_begin(int4 line_pc, int cmd);
+static void profile_end();
+static void profile_begin_worker();
+static void profile_worker(int *error);
 static void stop_interruptible();
+static void inject_close();
 static int handle_error(int error);
 
-int repeating = 0;
-int repeating_shift;
-int repeating_key;
+CORE_TLS int repeating = 0;
+CORE_TLS int repeating_shift;
+CORE_TLS int repeating_key;
+
+static CORE_TLS int4 oldpc;
+
+CORE_TLS core_settings_struct core_settings;
+
+/* Set by core_request_interrupt(), possibly from another thread or a signal
+ * handler; checked by continue_running() before every instruction. Each
+ * calculator has its own; 'default_instance' points to the one belonging to
+ * the thread that called core_init() most recently. Single-instance builds
+ * have only the one, and may be made with compilers that have no <atomic>,
+ * like MSVC 2008, so there it is a plain volatile flag.
+ */
+#ifdef FREE42_SINGLE_INSTANCE
+typedef volatile bool interrupt_flag;
+static interrupt_flag interrupt_requested = false;
+static inline bool get_interrupt(interrupt_flag *f) { return *f; }
+static inline void set_interrupt(interrupt_flag *f, bool v) { *f = v; }
+#else
+typedef std::atomic<bool> interrupt_flag;
+static CORE_TLS interrupt_flag interrupt_requested(false);
+static std::atomic<interrupt_flag *> default_instance(NULL);
+static inline bool get_interrupt(interrupt_flag *f) {
+    return f->load(std::memory_order_relaxed);
+}
+static inline void set_interrupt(interrupt_flag *f, bool v) {
+    f->store(v, std::memory_order_relaxed);
+}
+#endif
+
+#ifndef FREE42_SINGLE_INSTANCE
+/* The phloat constants are shared by all calculators */
+static std::once_flag phloat_init_flag;
+#endif
 
-static int4 oldpc;
+static CORE_TLS bool profiling = false;
 
-core_settings_struct core_settings;
+/* Number of lines continue_running() has executed; see
+ * core_program_steps()
+ */
+static CORE_TLS uint8 program_steps = 0;
 
 void core_init(int read_saved_state, int4 version, const char *state_file_name, int offset) {
 
@@ -69,7 +119,16 @@ void core_init(int read_saved_state, int4 version, const char *state_file_name,
      * 2: state file present but not OK (State File Corrupt)
      */
 
+#ifdef FREE42_SINGLE_INSTANCE
     phloat_init();
+#else
+    std::call_once(phloat_init_flag, phloat_init);
+#endif
+    set_interrupt(&interrupt_requested, false);
+#ifndef FREE42_SINGLE_INSTANCE
+    default_instance.store(&interrupt_requested);
+#endif
+    program_steps = 0;
 
     #if defined(ANDROID) || defined(IPHONE)
         core_settings.enable_ext_accel = true;
@@ -180,6 +239,11 @@ void core_cleanup() {
         vars_capacity = 0;
     }
     clean_vartype_pools();
+    inject_close();
+#ifndef FREE42_SINGLE_INSTANCE
+    interrupt_flag *instance = &interrupt_requested;
+    default_instance.compare_exchange_strong(instance, NULL);
+#endif
 }
 
 void core_repaint_display() {
@@ -259,7 +323,10 @@ int core_keydown(int key, int *enqueued, int *repeat) {
             }
             set_shift(false);
         }
-        error = mode_interruptible(0);
+        if (profiling)
+            profile_worker(&error);
+        else
+            error = mode_interruptible(0);
         if (error == ERR_INTERRUPTIBLE)
             /* Still not done */
             return 1;
@@ -309,6 +376,8 @@ int core_keydown(int key, int *enqueued, int *repeat) {
             set_shift(false);
         }
         continue_running();
+        if (profiling)
+            profile_end();
         if ((mode_running && !mode_getkey && !mode_pause) || keybuf_tail != keybuf_head)
             return 1;
         else {
@@ -747,9 +816,9 @@ char *core_list_programs() {
 // This would have been a lot cleaner using fmemopen(), but that's only supported
 // in iOS 11 and later, and I'm not ready to give up on iOS 8 through 10 yet.
 
-static char *raw_buf;
-static size_t raw_size;
-static size_t raw_pos;
+static CORE_TLS char *raw_buf;
+static CORE_TLS size_t raw_size;
+static CORE_TLS size_t raw_pos;
 
 static int raw_getc() {
     if (raw_buf == NULL)
@@ -2157,8 +2226,7 @@ void core_import_programs(int num_progs, const char *raw_file_name) {
     }
 
     done:
-    rebuild_label_table();
-    update_catalog();
+    mark_catalog_dirty();
 
     flags.f.trace_print = saved_trace;
     flags.f.normal_print = saved_normal;
@@ -3817,11 +3885,350 @@ void do_interactive(int command) {
     }
 }
 
+uint8 core_program_steps() {
+    return program_steps;
+}
+
+void *core_instance() {
+    return (void *) &interrupt_requested;
+}
+
+void core_request_interrupt() {
+#ifdef FREE42_SINGLE_INSTANCE
+    set_interrupt(&interrupt_requested, true);
+#else
+    interrupt_flag *instance = default_instance.load();
+    if (instance != NULL)
+        set_interrupt(instance, true);
+#endif
+}
+
+void core_request_interrupt_of(void *instance) {
+    set_interrupt((interrupt_flag *) instance, true);
+}
+
+/* Keystroke injection queue. It is a linked list of fixed-size segments,
+ * with a single producer appending at the tail, and the calculator's thread
+ * consuming from the head; 'count' is the only thing they share, and the
+ * producer only bumps it after the entries it covers have been written.
+ * A command is stored as a malloc()ed copy of its name, and looked up only
+ * when it is delivered, since find_builtin() depends on the calculator's
+ * settings.
+ */
+#define INJECT_SEGMENT_SIZE 256
+#define INJECT_DEFAULT_LIMIT 65536
+#define INJECT_BATCH 1024
+
+struct inject_entry {
+    int key;
+    char *name;
+};
+
+struct inject_segment {
+    inject_entry entries[INJECT_SEGMENT_SIZE];
+    inject_segment *next;
+};
+
+/* The queue's length is shared between the thread that injects and the
+ * calculator's thread. Single-instance builds may not have <atomic> (MSVC
+ * 2008 doesn't), so they use the compiler's own primitives.
+ */
+#if !defined(FREE42_SINGLE_INSTANCE)
+typedef std::atomic<int4> inject_count;
+static inline int4 count_load(inject_count *c) {
+    return c->load(std::memory_order_acquire);
+}
+static inline int4 count_add(inject_count *c, int4 n) {
+    return c->fetch_add(n, std::memory_order_release);
+}
+static inline void count_sub(inject_count *c, int4 n) {
+    c->fetch_sub(n, std::memory_order_relaxed);
+}
+#elif defined(_MSC_VER)
+/* Volatile reads have acquire semantics in MSVC */
+typedef volatile long inject_count;
+static inline int4 count_load(inject_count *c) {
+    return *c;
+}
+static inline int4 count_add(inject_count *c, int4 n) {
+    return _InterlockedExchangeAdd(c, n);
+}
+static inline void count_sub(inject_count *c, int4 n) {
+    _InterlockedExchangeAdd(c, -n);
+}
+#else
+typedef int4 inject_count;
+static inline int4 count_load(inject_count *c) {
+    return __atomic_load_n(c, __ATOMIC_ACQUIRE);
+}
+static inline int4 count_add(inject_count *c, int4 n) {
+    return __atomic_fetch_add(c, n, __ATOMIC_RELEASE);
+}
+static inline void count_sub(inject_count *c, int4 n) {
+    __atomic_fetch_sub(c, n, __ATOMIC_RELAXED);
+}
+#endif
+
+struct inject_queue {
+    bool open;
+    inject_segment *head_seg;
+    int head_pos;
+    inject_segment *tail_seg;
+    int tail_pos;
+    inject_count count;
+    int4 limit;
+    void (*notify)(void *);
+    void *notify_data;
+    interrupt_flag *interrupt;
+};
+
+static CORE_TLS inject_queue injectq;
+
+void *core_inject_open(int limit, void (*notify)(void *), void *notify_data) {
+    inject_queue *q = &injectq;
+    if (!q->open) {
+        inject_segment *seg = (inject_segment *) malloc(sizeof(inject_segment));
+        if (seg == NULL)
+            return NULL;
+        seg->next = NULL;
+        q->head_seg = q->tail_seg = seg;
+        q->head_pos = q->tail_pos = 0;
+        q->count = 0;
+        q->interrupt = &interrupt_requested;
+        q->open = true;
+    }
+    q->limit = limit > 0 ? limit : INJECT_DEFAULT_LIMIT;
+    q->notify = notify;
+    q->notify_data = notify_data;
+    return q;
+}
+
+static bool inject_push(inject_queue *q, int key, char *name) {
+    if (q->tail_pos == INJECT_SEGMENT_SIZE) {
+        inject_segment *seg = (inject_segment *) malloc(sizeof(inject_segment));
+        if (seg == NULL)
+            return false;
+        seg->next = NULL;
+        q->tail_seg->next = seg;
+        q->tail_seg = seg;
+        q->tail_pos = 0;
+    }
+    inject_entry *e = q->tail_seg->entries + q->tail_pos++;
+    e->key = key;
+    e->name = name;
+    return true;
+}
+
+static void inject_pushed(inject_queue *q, int n) {
+    if (n == 0)
+        return;
+    if (count_add(&q->count, n) != 0)
+        /* The consumer already knows there's work */
+        return;
+    set_interrupt(q->interrupt, true);
+    if (q->notify != NULL)
+        q->notify(q->notify_data);
+}
+
+int core_inject_keys(void *queue, const int *keys, int count) {
+    inject_queue *q = (inject_queue *) queue;
+    int4 room = q->limit - count_load(&q->count);
+    if (count > room)
+        count = room < 0 ? 0 : (int) room;
+    int n;
+    for (n = 0; n < count; n++)
+        if (!inject_push(q, keys[n], NULL))
+            break;
+    inject_pushed(q, n);
+    return n;
+}
+
+int core_inject_command(void *queue, const char *name) {
+    inject_queue *q = (inject_queue *) queue;
+    if (count_load(&q->count) >= q->limit)
+        return 0;
+    char *copy = (char *) malloc(strlen(name) + 1);
+    if (copy == NULL)
+        return 0;
+    strcpy(copy, name);
+    if (!inject_push(q, 0, copy)) {
+        free(copy);
+        return 0;
+    }
+    inject_pushed(q, 1);
+    return 1;
+}
+
+int core_inject_pending(void *queue) {
+    return count_load(&((inject_queue *) queue)->count);
+}
+
+int core_inject_ready() {
+    inject_queue *q = &injectq;
+    return q->open && count_load(&q->count) != 0
+            && ((keybuf_head + 1) & 15) != keybuf_tail;
+}
+
+static inject_entry *inject_front(inject_queue *q) {
+    if (q->head_pos == INJECT_SEGMENT_SIZE) {
+        inject_segment *next = q->head_seg->next;
+        free(q->head_seg);
+        q->head_seg = next;
+        q->head_pos = 0;
+    }
+    return q->head_seg->entries + q->head_pos;
+}
+
+int core_inject_deliver(int *enqueued) {
+    inject_queue *q = &injectq;
+    *enqueued = 0;
+    if (!q->open)
+        return 0;
+    int4 n = count_load(&q->count);
+    if (n > INJECT_BATCH)
+        n = INJECT_BATCH;
+    int keep_running = (mode_running && !mode_getkey && !mode_pause)
+                        || mode_interruptible != NULL
+                        || keybuf_head != keybuf_tail;
+    hold_display(true);
+    while (n-- > 0) {
+        /* Don't hand core_keydown() more than the type-ahead buffer can
+         * take; it would just drop the rest. What's left stays queued, and
+         * gets delivered after the buffer has been drained by the
+         * core_keydown(0) calls the shell makes while keep_running is set.
+         */
+        if (((keybuf_head + 1) & 15) == keybuf_tail)
+            break;
+        inject_entry *e = inject_front(q);
+        int key = e->key;
+        char *name = e->name;
+        q->head_pos++;
+        count_sub(&q->count, 1);
+        int enq, repeat;
+        if (name != NULL) {
+            keep_running = core_keydown_command(name, &enq, &repeat);
+            free(name);
+        } else
+            keep_running = core_keydown(key, &enq, &repeat);
+        if (enq)
+            *enqueued = 1;
+        else
+            keep_running = core_keyup();
+    }
+    hold_display(false);
+    return keep_running;
+}
+
+static void inject_close() {
+    inject_queue *q = &injectq;
+    if (!q->open)
+        return;
+    int4 n = count_load(&q->count);
+    while (n-- > 0) {
+        inject_entry *e = inject_front(q);
+        free(e->name);
+        q->head_pos++;
+    }
+    free(q->head_seg);
+    q->open = false;
+}
+
+/* Default run slice: poll for events every RUN_SLICE_INSTRUCTIONS
+ * instructions or every RUN_SLICE_MILLIS milliseconds, whichever comes first.
+ * The clock is only read every RUN_SLICE_CLOCK_MASK + 1 instructions, so the
+ * worst-case EXIT/R/S latency is RUN_SLICE_MILLIS plus that many slow
+ * instructions.
+ */
+#define RUN_SLICE_INSTRUCTIONS 10000
+#define RUN_SLICE_MILLIS 20
+#define RUN_SLICE_CLOCK_MASK 15
+
+/* Executes the decoded line dc, or, if fuse_decoded() marked it as the start
+ * of a superinstruction, the whole sequence of lines. Each line still runs
+ * its own command handler, and gets the same stack lift bookkeeping
+ * handle_error() does between lines, so the results are exactly those of
+ * running the lines one by one; what is saved is the per-line overhead of
+ * continue_running(), and for conditional GTOs, docmd_gto() itself. The
+ * caller sets oldpc for the first line; on return, oldpc and pc are set as if
+ * the lines had been executed one at a time, and the return value is the
+ * error code of the last line executed, to be passed to handle_error().
+ * At most max_lines lines are executed, and 'lines' is set to the number
+ * that were. Single-stepping, tracing, and profiling never use this; they
+ * always execute one line at a time.
+ */
+static int run_decoded(decoded_cmd_struct *dc, int max_lines, int *lines) {
+    prgm_struct *prgm = prgms + current_prgm;
+    int n = dc->fused;
+    if (n > max_lines)
+        n = max_lines;
+    *lines = 0;
+    while (true) {
+        pc = dc->next_pc;
+        resolve_decoded_target(dc);
+        arg_struct arg = dc->arg;
+        mode_disable_stack_lift = false;
+        ind_cache = dc->ind;
+        int error = cmdlist(dc->cmd)->handler(&arg);
+        ind_cache = NULL;
+        ++*lines;
+        if (--n == 0)
+            return error;
+        if (error == ERR_NO) {
+            /* Failed test; skip the GTO that follows it */
+            pc = dc[1].next_pc;
+            prgm->decoded_line++;
+            return ERR_NONE;
+        }
+        if (error != ERR_NONE && error != ERR_YES)
+            return error;
+        flags.f.stack_lift_disable = mode_disable_stack_lift;
+        /* Keep get_decoded_command()'s hint on the line being executed */
+        dc++;
+        prgm->decoded_line++;
+        oldpc = pc;
+        if (dc->cmd == CMD_GTO) {
+            /* Successful test; what docmd_gto() does for local labels */
+            ++*lines;
+            pc = dc->next_pc;
+            resolve_decoded_target(dc);
+            mode_disable_stack_lift = false;
+            if (dc->arg.target == -2)
+                return ERR_LABEL_NOT_FOUND;
+            pc = dc->arg.target;
+            prgm_highlight_row = 1;
+            return ERR_NONE;
+        }
+    }
+}
+
 static void continue_running() {
     int error;
-    while (!shell_wants_cpu()) {
+    int slice_instructions = core_settings.run_slice_instructions;
+    int slice_millis = core_settings.run_slice_millis;
+    if (slice_instructions <= 0)
+        slice_instructions = RUN_SLICE_INSTRUCTIONS;
+    if (slice_millis <= 0)
+        slice_millis = RUN_SLICE_MILLIS;
+    int budget = slice_instructions;
+    uint4 slice_start = shell_milliseconds();
+    bool profile_on = profiling;
+    if (shell_wants_cpu())
+        return;
+    while (true) {
         int cmd;
         arg_struct arg;
+        if (get_interrupt(&interrupt_requested)) {
+            set_interrupt(&interrupt_requested, false);
+            return;
+        }
+        if (--budget == 0
+                || (budget & RUN_SLICE_CLOCK_MASK) == 0
+                    && shell_milliseconds() - slice_start >= (uint4) slice_millis) {
+            if (shell_wants_cpu())
+                return;
+            budget = slice_instructions;
+            slice_start = shell_milliseconds();
+        }
         oldpc = pc;
         if (pc == -1)
             pc = 0;
@@ -3830,17 +4237,47 @@ static void continue_running() {
             set_running(false);
             return;
         }
-        get_next_command(&pc, &cmd, &arg, 1);
-        if (flags.f.trace_print && flags.f.printer_exists)
-            print_program_line(current_prgm, oldpc);
-        mode_disable_stack_lift = false;
-        error = cmdlist(cmd)->handler(&arg);
+        decoded_cmd_struct *dc = NULL;
+        if (!profile_on && !core_settings.no_fusion
+                && !(flags.f.trace_print && flags.f.printer_exists))
+            dc = get_decoded_command(pc);
+        if (dc != NULL) {
+            /* Several lines may be executed at once; the budget is counted
+             * in lines, so don't go past the next point where it would be
+             * looked at.
+             */
+            int max_lines = budget & RUN_SLICE_CLOCK_MASK;
+            if (max_lines == 0)
+                max_lines = RUN_SLICE_CLOCK_MASK + 1;
+            int lines;
+            const native_prgm_struct *native = prgms[current_prgm].native;
+            error = NATIVE_MISS;
+            if (native != NULL && !core_settings.no_native)
+                error = native->run(prgms[current_prgm].decoded, &oldpc,
+                                    max_lines, &lines);
+            if (error == NATIVE_MISS)
+                error = run_decoded(dc, max_lines, &lines);
+            budget -= lines - 1;
+            program_steps += lines;
+        } else {
+            program_steps++;
+            get_next_decoded_command(&pc, &cmd, &arg);
+            if (profile_on)
+                profile_begin(oldpc == -1 ? 0 : oldpc, cmd);
+            if (flags.f.trace_print && flags.f.printer_exists)
+                print_program_line(current_prgm, oldpc);
+            mode_disable_stack_lift = false;
+            error = cmdlist(cmd)->handler(&arg);
+        }
         if (mode_pause) {
             shell_request_timeout3(1000);
             return;
         }
-        if (error == ERR_INTERRUPTIBLE)
+        if (error == ERR_INTERRUPTIBLE) {
+            if (profile_on)
+                profile_begin_worker();
             return;
+        }
         if (!handle_error(error))
             return;
         if (mode_getkey)
@@ -3848,6 +4285,385 @@ static void continue_running() {
     }
 }
 
+/* Profiler. The line being timed is kept as a (program, line index) pair
+ * rather than a pointer, since the command it executes may edit or delete
+ * programs; data that no longer matches a program line is simply dropped.
+ */
+
+static CORE_TLS uint4 profile_cmd_hits[CMD_SENTINEL];
+static CORE_TLS uint8 profile_cmd_ticks[CMD_SENTINEL];
+
+/* The line started most recently by continue_running() */
+static CORE_TLS int profile_prgm = -1;
+static CORE_TLS int4 profile_line;
+static CORE_TLS int profile_cmd;
+static CORE_TLS uint8 profile_start;
+
+/* The line that started the current mode_interruptible worker */
+static CORE_TLS int profile_worker_prgm = -1;
+static CORE_TLS int4 profile_worker_line;
+static CORE_TLS int profile_worker_cmd;
+
+/* Single-instance builds may be made with compilers that have no <chrono>,
+ * like MSVC 2008; they fall back on the shell's millisecond clock, which is
+ * good enough to calibrate the time stamp counter against, but not to time
+ * individual lines with.
+ */
+static uint8 profile_nanos() {
+#ifdef FREE42_SINGLE_INSTANCE
+    return shell_milliseconds() * (uint8) 1000000;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/* The clock is read once per instruction, so use the x86 time stamp counter
+ * where we can; it is several times cheaper than the steady clock. Ticks are
+ * converted to nanoseconds when the report is generated, by comparing both
+ * clocks against the readings taken when profiling was turned on.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define profile_clock() __builtin_ia32_rdtsc()
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define profile_clock() __rdtsc()
+#else
+#define profile_clock() profile_nanos()
+#endif
+
+static CORE_TLS uint8 profile_ref_ticks;
+static CORE_TLS uint8 profile_ref_nanos;
+
+static double profile_nanos_per_tick() {
+    uint8 ticks = profile_clock() - profile_ref_ticks;
+    uint8 nanos = profile_nanos() - profile_ref_nanos;
+    if (ticks == 0 || nanos == 0)
+        return 1;
+    return (double) nanos / ticks;
+}
+
+static void profile_charge(int prgm_index, int4 line, int cmd,
+                           uint8 ticks, bool hit) {
+    if (hit)
+        profile_cmd_hits[cmd]++;
+    profile_cmd_ticks[cmd] += ticks;
+    if (prgm_index >= prgms_count)
+        return;
+    prgm_struct *prgm = prgms + prgm_index;
+    if (prgm->lines_invalid || line < 0 || line >= prgm->lines_count)
+        return;
+    if (prgm->profile == NULL) {
+        prgm->profile = (profile_line_struct *)
+                calloc(prgm->lines_count, sizeof(profile_line_struct));
+        if (prgm->profile == NULL)
+            return;
+    }
+    if (hit)
+        prgm->profile[line].hits++;
+    prgm->profile[line].ticks += ticks;
+}
+
+/* Returns the index in line_pcs of the current program's line at line_pc.
+ * get_next_decoded_command() has normally just looked it up, so this is
+ * where the decoded instruction cache's hint points.
+ */
+static int4 profile_line_index(int4 line_pc) {
+    prgm_struct *prgm = prgms + current_prgm;
+    if (prgm->decoded != NULL && !prgm->lines_invalid
+            && prgm->decoded_line < prgm->lines_count
+            && prgm->line_pcs[prgm->decoded_line] == line_pc)
+        return prgm->decoded_line;
+    return pc2line(line_pc) - 1;
+}
+
+static void profile_begin(int4 line_pc, int cmd) {
+    uint8 now = profile_clock();
+    if (profile_prgm != -1)
+        profile_charge(profile_prgm, profile_line, profile_cmd,
+                       now - profile_start, true);
+    profile_prgm = current_prgm;
+    profile_line = profile_line_index(line_pc);
+    profile_cmd = cmd;
+    profile_start = now;
+}
+
+static void profile_end() {
+    if (profile_prgm == -1)
+        return;
+    profile_charge(profile_prgm, profile_line, profile_cmd,
+                   profile_clock() - profile_start, true);
+    profile_prgm = -1;
+}
+
+static void profile_begin_worker() {
+    profile_worker_prgm = profile_prgm;
+    profile_worker_line = profile_line;
+    profile_worker_cmd = profile_cmd;
+}
+
+static void profile_worker(int *error) {
+    if (profile_worker_prgm == -1) {
+        *error = mode_interruptible(0);
+        return;
+    }
+    uint8 start = profile_clock();
+    *error = mode_interruptible(0);
+    profile_charge(profile_worker_prgm, profile_worker_line, profile_worker_cmd,
+                   profile_clock() - start, false);
+    if (*error != ERR_INTERRUPTIBLE)
+        profile_worker_prgm = -1;
+}
+
+void core_profile(int enable) {
+    if (enable) {
+        for (int i = 0; i < prgms_count; i++)
+            if (prgms[i].profile != NULL) {
+                free(prgms[i].profile);
+                prgms[i].profile = NULL;
+            }
+        memset(profile_cmd_hits, 0, sizeof(profile_cmd_hits));
+        memset(profile_cmd_ticks, 0, sizeof(profile_cmd_ticks));
+        profile_ref_ticks = profile_clock();
+        profile_ref_nanos = profile_nanos();
+    } else
+        profile_end();
+    profile_prgm = -1;
+    profile_worker_prgm = -1;
+    profiling = enable != 0;
+}
+
+typedef struct {
+    int prgm;
+    int4 pc;
+    int4 line;
+    int cmd;
+    uint4 hits;
+    uint8 ticks;
+} profile_entry;
+
+static int profile_entry_compare(const void *a, const void *b) {
+    const profile_entry *pa = (const profile_entry *) a;
+    const profile_entry *pb = (const profile_entry *) b;
+    if (pa->ticks != pb->ticks)
+        return pa->ticks < pb->ticks ? 1 : -1;
+    if (pa->hits != pb->hits)
+        return pa->hits < pb->hits ? 1 : -1;
+    if (pa->prgm != pb->prgm)
+        return pa->prgm < pb->prgm ? -1 : 1;
+    return pa->pc < pb->pc ? -1 : pa->pc > pb->pc;
+}
+
+/* Writes the name of the program's first global label, or a program
+ * number if it doesn't have one.
+ */
+static int profile_prgm_name(char *buf, int prgm_index) {
+    for (int i = 0; i < labels_count; i++) {
+        if (labels[i].prgm > prgm_index)
+            break;
+        if (labels[i].prgm == prgm_index && labels[i].length > 0) {
+            int len = 0;
+            buf[len++] = '"';
+            len += hp2ascii(buf + len, labels[i].name, labels[i].length);
+            buf[len++] = '"';
+            buf[len] = 0;
+            return len;
+        }
+    }
+    return sprintf(buf, "prgm %d", prgm_index + 1);
+}
+
+/* Formats a program line as text, using UTF-8 */
+static int profile_line_text(char *buf, int cmd, const arg_struct *arg) {
+    char hpbuf[100];
+    int len;
+    if (cmd == CMD_NUMBER) {
+        char *num = phloat2program(arg->val_d);
+        len = (int) strlen(num);
+        memcpy(hpbuf, num, len);
+    } else if (cmd == CMD_STRING) {
+        len = 0;
+        hpbuf[len++] = '"';
+        memcpy(hpbuf + len, arg->val.text, arg->length);
+        len += arg->length;
+        hpbuf[len++] = '"';
+    } else
+        len = command2buf(hpbuf, 100, cmd, arg);
+    for (int i = 0; i < len; i++)
+        if (hpbuf[i] == 10)
+            hpbuf[i] = (char) 138;
+    len = hp2ascii(buf, hpbuf, len);
+    buf[len] = 0;
+    return len;
+}
+
+char *core_profile_report(int listing) {
+    textbuf tb;
+    tb.buf = NULL;
+    tb.size = 0;
+    tb.capacity = 0;
+    tb.fail = false;
+    char buf[1024];
+    char name[100];
+    char text[500];
+    int saved_prgm = current_prgm;
+    double ns = profile_nanos_per_tick();
+    int i;
+
+    if (profiling)
+        profile_end();
+
+    if (listing) {
+        for (i = 0; i < prgms_count; i++) {
+            prgm_struct *prgm = prgms + i;
+            if (prgm->profile == NULL || prgm->lines_invalid)
+                continue;
+            profile_prgm_name(name, i);
+            int len = sprintf(buf, "%s\n      hits         ms  line\n", name);
+            tb_write(&tb, buf, len);
+            current_prgm = i;
+            int4 pc2 = 0;
+            int4 line = 1;
+            while (line <= prgm->lines_count) {
+                int cmd;
+                arg_struct arg;
+                get_next_command(&pc2, &cmd, &arg, 0);
+                profile_line_text(text, cmd, &arg);
+                profile_line_struct *pl = prgm->profile + line - 1;
+                if (pl->hits == 0 && pl->ticks == 0)
+                    len = sprintf(buf, "                       %02d %s\n",
+                                  line, text);
+                else
+                    len = sprintf(buf, "%10u %10.3f  %02d %s\n", pl->hits,
+                                  pl->ticks * ns / 1e6, line, text);
+                tb_write(&tb, buf, len);
+                line++;
+                if (cmd == CMD_END)
+                    break;
+            }
+            tb_write(&tb, "\n", 1);
+        }
+        current_prgm = saved_prgm;
+        tb_write_null(&tb);
+        if (tb.fail) {
+            free(tb.buf);
+            return NULL;
+        }
+        return tb.buf;
+    }
+
+    /* Commands */
+    uint4 total_hits = 0;
+    uint8 total_ticks = 0;
+    int ncmds = 0;
+    for (i = 0; i < CMD_SENTINEL; i++) {
+        total_hits += profile_cmd_hits[i];
+        total_ticks += profile_cmd_ticks[i];
+        if (profile_cmd_hits[i] != 0 || profile_cmd_ticks[i] != 0)
+            ncmds++;
+    }
+    int len = sprintf(buf, "%u lines executed in %.3f ms\n\n"
+                           "      hits         ms     ns/hit  command\n",
+                      total_hits, total_ticks * ns / 1e6);
+    tb_write(&tb, buf, len);
+    profile_entry *entries = (profile_entry *)
+            malloc((ncmds > 0 ? ncmds : 1) * sizeof(profile_entry));
+    if (entries == NULL) {
+        free(tb.buf);
+        return NULL;
+    }
+    int n = 0;
+    for (i = 0; i < CMD_SENTINEL; i++)
+        if (profile_cmd_hits[i] != 0 || profile_cmd_ticks[i] != 0) {
+            entries[n].prgm = 0;
+            entries[n].pc = i;
+            entries[n].line = 0;
+            entries[n].cmd = i;
+            entries[n].hits = profile_cmd_hits[i];
+            entries[n].ticks = profile_cmd_ticks[i];
+            n++;
+        }
+    qsort(entries, n, sizeof(profile_entry), profile_entry_compare);
+    for (i = 0; i < n; i++) {
+        int cmd = entries[i].cmd;
+        if (cmd == CMD_NUMBER)
+            strcpy(text, "(number)");
+        else if (cmd == CMD_STRING)
+            strcpy(text, "(string)");
+        else {
+            const command_spec *cs = cmdlist(cmd);
+            int namelen = hp2ascii(text, cs->name, cs->name_length);
+            text[namelen] = 0;
+        }
+        len = sprintf(buf, "%10u %10.3f %10.0f  %s\n", entries[i].hits,
+                      entries[i].ticks * ns / 1e6, entries[i].hits == 0 ? 0.0
+                            : entries[i].ticks * ns / entries[i].hits,
+                      text);
+        tb_write(&tb, buf, len);
+    }
+    free(entries);
+
+    /* Lines */
+    int4 nlines = 0;
+    for (i = 0; i < prgms_count; i++) {
+        prgm_struct *prgm = prgms + i;
+        if (prgm->profile == NULL || prgm->lines_invalid)
+            continue;
+        for (int4 l = 0; l < prgm->lines_count; l++)
+            if (prgm->profile[l].hits != 0 || prgm->profile[l].ticks != 0)
+                nlines++;
+    }
+    entries = (profile_entry *)
+            malloc((nlines > 0 ? nlines : 1) * sizeof(profile_entry));
+    if (entries == NULL) {
+        free(tb.buf);
+        return NULL;
+    }
+    n = 0;
+    for (i = 0; i < prgms_count; i++) {
+        prgm_struct *prgm = prgms + i;
+        if (prgm->profile == NULL || prgm->lines_invalid)
+            continue;
+        for (int4 l = 0; l < prgm->lines_count; l++) {
+            profile_line_struct *pl = prgm->profile + l;
+            if (pl->hits != 0 || pl->ticks != 0) {
+                entries[n].prgm = i;
+                entries[n].pc = prgm->line_pcs[l];
+                entries[n].line = l + 1;
+                entries[n].hits = pl->hits;
+                entries[n].ticks = pl->ticks;
+                n++;
+            }
+        }
+    }
+    qsort(entries, n, sizeof(profile_entry), profile_entry_compare);
+    len = sprintf(buf, "\n      hits         ms     ns/hit  line\n");
+    tb_write(&tb, buf, len);
+    for (i = 0; i < n; i++) {
+        int cmd;
+        arg_struct arg;
+        int4 pc2 = entries[i].pc;
+        current_prgm = entries[i].prgm;
+        get_next_command(&pc2, &cmd, &arg, 0);
+        profile_prgm_name(name, entries[i].prgm);
+        profile_line_text(text, cmd, &arg);
+        len = sprintf(buf, "%10u %10.3f %10.0f  %s %02d %s\n",
+                      entries[i].hits, entries[i].ticks * ns / 1e6,
+                      entries[i].hits == 0 ? 0.0
+                            : entries[i].ticks * ns / entries[i].hits,
+                      name, entries[i].line, text);
+        tb_write(&tb, buf, len);
+    }
+    free(entries);
+    current_prgm = saved_prgm;
+
+    tb_write_null(&tb);
+    if (tb.fail) {
+        free(tb.buf);
+        return NULL;
+    }
+    return tb.buf;
+}
+
 typedef struct {
     char name[7];
     bool is_orig;
@@ -4256,6 +5072,8 @@ void finish_alpha_prgm_line() {
 }
 
 static void stop_interruptible() {
+    if (profiling)
+        profile_end();
     int error = mode_interruptible(1);
     handle_error(error);
     mode_interruptible = NULL;
@@ -35,6 +35,11 @@
  * If the read_state parameter is 1, the 'version' parameter should contain the
  * state file version number; otherwise its value is not used.
  * This is guaranteed to be the first function called on the emulator core.
+ * All core state is thread-local (see CORE_TLS in free42.h): each thread that
+ * calls core_init() gets an independent calculator, which only that thread
+ * may use, and which it deletes with core_cleanup(). Note that the shell_*()
+ * callbacks are shared, so a shell that runs several calculators must tell
+ * them apart itself, e.g. using thread-local data of its own.
  */
 void core_init(int read_state, int4 version, const char *state_file_name, int offset);
 
@@ -291,11 +296,152 @@ char *core_copy();
  */
 void core_paste(const char *s);
 
+/* core_profile()
+ *
+ * Turns the execution profiler on (enable = 1) or off (enable = 0). While it
+ * is on, every program line that is executed is counted and timed, both per
+ * line and per command. Time spent in long-running commands, like SOLVE and
+ * INTEG, which keep working in between calls to core_keydown(), is charged to
+ * the line that started them. Turning the profiler on discards any data
+ * collected earlier; data for a program is also discarded when it is edited.
+ */
+void core_profile(int enable);
+
+/* core_profile_report()
+ *
+ * Returns the data collected by the profiler as text. With listing = 0, this
+ * is a report of commands and program lines, sorted by the time spent in
+ * them; with listing = 1, it is a listing of every profiled program, with the
+ * hit count and time shown next to each line.
+ * The caller should free the returned text using free(3). Returns NULL if
+ * there is not enough memory.
+ */
+char *core_profile_report(int listing);
+
+/* core_request_interrupt()
+ *
+ * Asks a running program to give the CPU back to the shell as soon as
+ * possible; the active core_keydown() or core_keyup() will return 1 after the
+ * instruction that is currently executing has finished. This is meant to be
+ * called from the shell's event sources, e.g. an input handler running on a
+ * different thread, or a signal handler; it is safe to call at any time, and
+ * it does not touch any other core state.
+ * This interrupts the calculator that was initialized most recently; with
+ * several calculators, use core_instance() on the thread that runs one, and
+ * pass the result to core_request_interrupt_of() to interrupt that one.
+ */
+void core_request_interrupt();
+void *core_instance();
+void core_request_interrupt_of(void *instance);
+
+/* core_program_steps()
+ *
+ * Returns the number of program lines this calculator has executed since
+ * core_init(), counting every line of a superinstruction or of a compiled
+ * program (see core_native.h) separately, so the count doesn't depend on
+ * how the lines were executed. Given the same state and the same sequence of
+ * calls, the count at any point is always the same, so a shell can make a
+ * program run for exactly as many steps as it did some other time, by setting
+ * core_settings.run_slice_instructions to the number of steps still to go,
+ * and having shell_wants_cpu() return 1 once they're done. This is how
+ * recorded sessions are replayed.
+ */
+uint8 core_program_steps();
+
+/* core_inject_open()
+ *
+ * Keystroke injection, for driving the calculator from automation that
+ * sends keystrokes and commands much faster than anyone could type. Injected
+ * input goes into a queue that grows as needed, up to 'limit' entries (0
+ * means 65536); unlike keystrokes passed to core_keydown() while a program is
+ * running, which are dropped once the 16-key type-ahead buffer is full,
+ * injected input is never discarded. When the queue is full, the producer is
+ * told so, and should try again later.
+ * core_inject_open() must be called on the thread that runs the calculator;
+ * the handle it returns is for the producer, which may be running on any
+ * thread, but only one thread may be producing at a time. The handle stays
+ * valid until core_cleanup(). 'notify', if not NULL, is called by the
+ * producer, with 'notify_data', when it has added input to an empty queue, so
+ * the shell can wake up the calculator's thread. Adding input to an empty
+ * queue also interrupts a running program (see core_request_interrupt()).
+ * Calling core_inject_open() again returns the same handle, with the new
+ * limit and notify function.
+ */
+void *core_inject_open(int limit, void (*notify)(void *), void *notify_data);
+
+/* core_inject_keys()
+ *
+ * Adds 'count' keystrokes to the injection queue. Each one is a complete
+ * press and release of a key, with the key codes as for core_keydown(); to
+ * press a shifted key, precede it with KEY_SHIFT (28). Returns the number of
+ * keystrokes that fit in the queue; if that is less than 'count', the caller
+ * should try to add the rest later.
+ * Called by the producer; thread-safe.
+ */
+int core_inject_keys(void *queue, const int *keys, int count);
+
+/* core_inject_command()
+ *
+ * Adds a command to the injection queue, to be executed as by
+ * core_keydown_command() followed by core_keyup(). Returns 1 if the command
+ * was added, or 0 if the queue is full (or out of memory), in which case the
+ * caller should try again later.
+ * Called by the producer; thread-safe.
+ */
+int core_inject_command(void *queue, const char *name);
+
+/* core_inject_pending()
+ *
+ * Returns the number of keystrokes and commands in the injection queue.
+ * Thread-safe; meant for the shell, to see if it should call
+ * core_inject_deliver(), and for the producer, to watch the backlog.
+ */
+int core_inject_pending(void *queue);
+
+/* core_inject_ready()
+ *
+ * Returns nonzero if core_inject_deliver() has something to deliver right
+ * now, that is, if the injection queue is not empty, and the type-ahead
+ * buffer is not full. Meant for shell_wants_cpu(): a running program should
+ * make way for injected input when it can be taken, but not when it can't,
+ * since then the program has to keep going to make room for it.
+ * Call this on the calculator's thread.
+ */
+int core_inject_ready();
+
+/* core_inject_deliver()
+ *
+ * Feeds keystrokes and commands from the injection queue to core_keydown()
+ * or core_keydown_command(), and core_keyup(), in a batch, without repainting
+ * the display until the end of the batch. While a program is running, input
+ * is only taken from the queue as long as the type-ahead buffer has room for
+ * it; the rest is left for later.
+ * The return value and 'enqueued' are as for core_keydown(); injected
+ * keystrokes never auto-repeat.
+ * The shell should call this, on the calculator's thread, whenever
+ * core_inject_pending() is nonzero, and treat the return value like that of
+ * core_keydown(): as long as it is nonzero, keep calling core_keydown(0), so
+ * that the type-ahead buffer gets drained and the next batch can go in.
+ */
+int core_inject_deliver(int *enqueued);
+
 /* core_settings
  *
  * This is a struct that stores user-configurable core settings. The shell
  * should provide the appropriate controls in a "Preferences" dialog box to
  * allow the user to view and change these settings.
+ * The run_slice_* settings control how often a running program polls
+ * shell_wants_cpu(): it does so after executing run_slice_instructions
+ * instructions, or after run_slice_millis milliseconds, whichever comes first.
+ * Zero means use the default. These are not normally exposed to the user.
+ * Setting no_fusion makes running programs execute one line at a time, even
+ * where continue_running() would normally fuse lines into superinstructions;
+ * setting no_native makes them interpret programs that have a compiled
+ * version (see core_native.h); no_fusion implies no_native.
+ * Setting no_map_arrays makes map_unary() and map_binary() apply the
+ * per-element operators to real matrices, even where there is an array
+ * version (see core_sto_rcl.h). These are meant for benchmarking and
+ * debugging.
  */
 typedef struct {
     bool matrix_singularmatrix;
@@ -307,18 +453,23 @@ typedef struct {
     bool enable_ext_time;
     bool enable_ext_fptest;
     bool enable_ext_prog;
+    int run_slice_instructions;
+    int run_slice_millis;
+    bool no_fusion;
+    bool no_native;
+    bool no_map_arrays;
 } core_settings_struct;
 
-extern core_settings_struct core_settings;
+extern CORE_TLS core_settings_struct core_settings;
 
 
 /*******************/
 /* Keyboard repeat */
 /*******************/
 
-extern int repeating;
-extern int repeating_shift;
-extern int repeating_key;
+extern CORE_TLS int repeating;
+extern CORE_TLS int repeating_shift;
+extern CORE_TLS int repeating_key;
 
 
 /*******************/
@@ -65,7 +65,7 @@ typedef struct {
     uint4 last_disp_time;
 } solve_state;
 
-static solve_state solve;
+static CORE_TLS_PHLOAT solve_state solve;
 
 #define ROMB_K 5
 // 1/2 million evals max!
@@ -97,7 +97,7 @@ typedef struct {
     phloat prev_res;
 } integ_state;
 
-static integ_state integ;
+static CORE_TLS_PHLOAT integ_state integ;
 
 
 static void reset_solve();
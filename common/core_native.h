@@ -0,0 +1,141 @@
+/*****************************************************************************
+ * Free42 -- an HP-42S calculator simulator
+ * Copyright (C) 2004-2020  Thomas Okken
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses/.
+ *****************************************************************************/
+
+#ifndef CORE_NATIVE_H
+#define CORE_NATIVE_H 1
+
+/* Compiled programs. A program can be translated ahead of time into C++
+ * (see focal2cc in the gtk directory), which calls the same command handlers
+ * the interpreter does, in the same order, with the same bookkeeping between
+ * lines, but with the dispatch, and local GTOs, compiled into direct calls
+ * and jumps. The generated module is linked into the shell, and registered
+ * with core_register_native() before core_init(). Whenever the decoded
+ * instruction cache is built for a program whose text is identical to that
+ * of a registered one, continue_running() uses the compiled version; any
+ * other program, or the same program after it has been edited, is
+ * interpreted as usual.
+ *
+ * This header is included by the generated code, so it pulls in everything
+ * a compiled program needs.
+ */
+
+#include "core_globals.h"
+#include "core_commands1.h"
+#include "core_commands2.h"
+#include "core_commands3.h"
+#include "core_commands4.h"
+#include "core_commands5.h"
+#include "core_commands6.h"
+#include "core_commands7.h"
+#include "core_helpers.h"
+
+/* Returned by a compiled program when it has no code for the current pc */
+#define NATIVE_MISS -1
+
+/* 'run' executes lines of the current program, starting at pc, which must
+ * be the start of a line; 'decoded' is the program's decoded instruction
+ * cache, which supplies the arguments. It stops after at most 'max_lines'
+ * lines, or as soon as a line does something that continue_running() has
+ * to look at, such as pausing, stopping, leaving the program, or returning
+ * an error, and returns that line's error code, with 'lines' set to the
+ * number of lines executed, and pc and 'line_pc' (the interpreter's oldpc)
+ * set as if the lines had been executed one at a time; see run_decoded().
+ */
+struct native_prgm_struct {
+    const char *name;
+    int4 size;
+    uint4 hash;
+    const unsigned char *text;
+    int (*run)(decoded_cmd_struct *decoded, int4 *line_pc, int max_lines,
+               int *lines);
+};
+
+/* Registers 'count' compiled programs. The table is shared by all
+ * calculators, so this must be called before any of them starts running.
+ */
+void core_register_native(const native_prgm_struct *table, int count);
+/* FNV-1a hash of a program's text; find_native() compares the text itself
+ * as well */
+uint4 program_hash(int prgm);
+/* The registered program matching prgms[prgm], or NULL */
+const native_prgm_struct *find_native(int prgm);
+
+/* True if the compiled code may go on to the next line after one that
+ * returned 'error': the line must have left the pc at 'next_pc', without
+ * leaving the program or invalidating its decoded instruction cache, and
+ * without stopping, pausing, waiting for a key, starting an interruptible
+ * command, or turning on TRACE printing.
+ */
+static inline bool native_continue(int error, int4 next_pc, int prgm,
+                                   decoded_cmd_struct *decoded) {
+    return (error == ERR_NONE || error == ERR_YES || error == ERR_NO)
+            && pc == next_pc && current_prgm == prgm
+            && prgms[prgm].decoded == decoded
+            && mode_running && !mode_pause && !mode_getkey
+            && mode_interruptible == NULL
+            && !(flags.f.trace_print && flags.f.printer_exists);
+}
+
+/* The generated code for one line, labeled L<pc>, is
+ *     NATIVE_LINE(line, next_pc);
+ *     error = docmd_xxx(&arg);
+ *     NATIVE_DONE(next_pc);
+ *     NATIVE_SKIP(pc of the line after next);
+ * and a local GTO whose target was found at translation time is
+ * NATIVE_GTO(target) followed by NATIVE_DONE(target) and a jump.
+ * These do exactly what continue_running(), handle_error(), and docmd_gto()
+ * do; line_pc is set before each jump, and by NATIVE_DONE() for the line
+ * that follows, so it is left alone for the first line, as in
+ * run_decoded().
+ */
+#define NATIVE_LINE(line, next_pc) \
+    pc = next_pc; \
+    arg = decoded[line].arg; \
+    ind_cache = decoded[line].ind; \
+    mode_disable_stack_lift = false
+
+/* For GTO and XEQ lines, whose local label targets are resolved the way
+ * get_next_decoded_command() does it */
+#define NATIVE_LINE_TARGET(line, next_pc) \
+    pc = next_pc; \
+    resolve_decoded_target(decoded + line); \
+    arg = decoded[line].arg; \
+    ind_cache = decoded[line].ind; \
+    mode_disable_stack_lift = false
+
+#define NATIVE_GTO(target) \
+    pc = target; \
+    mode_disable_stack_lift = false; \
+    prgm_highlight_row = 1; \
+    error = ERR_NONE
+
+#define NATIVE_DONE(next_pc) \
+    ind_cache = NULL; \
+    if (++*lines == max_lines \
+            || !native_continue(error, next_pc, prgm, decoded)) \
+        return error; \
+    flags.f.stack_lift_disable = mode_disable_stack_lift; \
+    *line_pc = next_pc
+
+/* Failed test: skip the next line */
+#define NATIVE_SKIP(skip_pc) \
+    if (error == ERR_NO) { \
+        *line_pc = skip_pc; \
+        goto L##skip_pc; \
+    }
+
+#endif
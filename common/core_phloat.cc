@@ -178,6 +178,90 @@ int string2phloat(const char *buf, int buflen, phloat *d) {
     return 0;
 }
 
+/* Small-integer fast path. Loop counters, indices, and most of the other
+ * numbers programs work with are integers, which the library represents
+ * with an exponent of 0 and, if they are small enough, a coefficient that
+ * fits in the low word. For those, the constructors, +, -, *, and the
+ * comparisons use native integer arithmetic, checked for overflow, and
+ * produce exactly the bits the library would; anything else, including sums
+ * and products that don't fit in 64 bits, goes to the library.
+ * Rounding is always to nearest, so an exact zero sum is +0 unless both
+ * operands are -0.
+ */
+
+#define SMALL_INT_HIGH 0x3040000000000000ULL
+#define SIGN_BIT 0x8000000000000000ULL
+
+static inline bool small_int(const BID_UINT128 &x) {
+    return (x.w[BID_HIGH_128W] & ~SIGN_BIT) == SMALL_INT_HIGH;
+}
+
+static inline bool small_int_neg(const BID_UINT128 &x) {
+    return (x.w[BID_HIGH_128W] & SIGN_BIT) != 0;
+}
+
+static inline void make_small_int(BID_UINT128 *r, bool neg, uint8 coeff) {
+    r->w[BID_HIGH_128W] = neg ? SMALL_INT_HIGH | SIGN_BIT : SMALL_INT_HIGH;
+    r->w[BID_LOW_128W] = coeff;
+}
+
+static inline void make_small_int(BID_UINT128 *r, int8 i) {
+    if (i < 0)
+        make_small_int(r, true, 0 - (uint8) i);
+    else
+        make_small_int(r, false, (uint8) i);
+}
+
+/* x + y, or x - y if 'sub' is set; returns false if either operand isn't a
+ * small integer, or if the result wouldn't be one */
+static inline bool small_int_add(BID_UINT128 *r, const BID_UINT128 &x,
+                                 const BID_UINT128 &y, bool sub) {
+    if (!small_int(x) || !small_int(y))
+        return false;
+    bool xneg = small_int_neg(x);
+    bool yneg = small_int_neg(y) != sub;
+    uint8 a = x.w[BID_LOW_128W];
+    uint8 b = y.w[BID_LOW_128W];
+    if (xneg == yneg) {
+        uint8 sum = a + b;
+        if (sum < a)
+            return false;
+        make_small_int(r, xneg, sum);
+    } else if (a > b)
+        make_small_int(r, xneg, a - b);
+    else if (a < b)
+        make_small_int(r, yneg, b - a);
+    else
+        make_small_int(r, false, 0);
+    return true;
+}
+
+static inline bool small_int_mul(BID_UINT128 *r, const BID_UINT128 &x,
+                                 const BID_UINT128 &y) {
+    if (!small_int(x) || !small_int(y))
+        return false;
+    uint8 a = x.w[BID_LOW_128W];
+    uint8 b = y.w[BID_LOW_128W];
+    if (((a | b) >> 32) != 0 && a != 0 && b > 0xffffffffffffffffULL / a)
+        return false;
+    make_small_int(r, small_int_neg(x) != small_int_neg(y), a * b);
+    return true;
+}
+
+/* -1, 0, or 1, for x < y, x == y, and x > y; both must be small integers */
+static inline int small_int_cmp(const BID_UINT128 &x, const BID_UINT128 &y) {
+    uint8 a = x.w[BID_LOW_128W];
+    uint8 b = y.w[BID_LOW_128W];
+    // -0 == +0
+    bool xneg = a != 0 && small_int_neg(x);
+    bool yneg = b != 0 && small_int_neg(y);
+    if (xneg != yneg)
+        return xneg ? -1 : 1;
+    if (a == b)
+        return 0;
+    return (a < b) != xneg ? -1 : 1;
+}
+
 /* public */
 Phloat::Phloat(const char *str) {
     bid128_from_string(&val, (char *) str);
@@ -201,17 +285,17 @@ Phloat::Phloat(int8 numer, int8 denom) {
 
 /* public */
 Phloat::Phloat(int i) {
-    bid128_from_int32(&val, &i);
+    make_small_int(&val, i);
 }
 
 /* public */
 Phloat::Phloat(int8 i) {
-    bid128_from_int64(&val, &i);
+    make_small_int(&val, i);
 }
 
 /* public */
 Phloat::Phloat(uint8 i) {
-    bid128_from_uint64(&val, &i);
+    make_small_int(&val, false, i);
 }
 
 /* public */
@@ -222,30 +306,25 @@ Phloat::Phloat(double d) {
 }
 
 /* public */
-Phloat::Phloat(const Phloat &p) {
-    val = p.val;
-}
-
-/* public */
-Phloat Phloat::operator=(int i) {
-    bid128_from_int32(&val, &i);
+Phloat &Phloat::operator=(int i) {
+    make_small_int(&val, i);
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator=(int8 i) {
-    bid128_from_int64(&val, &i);
+Phloat &Phloat::operator=(int8 i) {
+    make_small_int(&val, i);
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator=(uint8 i) {
-    bid128_from_uint64(&val, &i);
+Phloat &Phloat::operator=(uint8 i) {
+    make_small_int(&val, false, i);
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator=(double d) {
+Phloat &Phloat::operator=(double d) {
     BID_UINT64 tmp;
     binary64_to_bid64(&tmp, &d);
     bid64_to_bid128(&val, &tmp);
@@ -253,50 +332,56 @@ Phloat Phloat::operator=(double d) {
 }
 
 /* public */
-Phloat Phloat::operator=(Phloat p) {
-    val = p.val;
-    return *this;
-}
-
-/* public */
-bool Phloat::operator==(Phloat p) const {
+bool Phloat::operator==(const Phloat &p) const {
+    if (small_int(val) && small_int(p.val))
+        return small_int_cmp(val, p.val) == 0;
     int r;
-    bid128_quiet_equal(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
 /* public */
-bool Phloat::operator!=(Phloat p) const {
+bool Phloat::operator!=(const Phloat &p) const {
+    if (small_int(val) && small_int(p.val))
+        return small_int_cmp(val, p.val) != 0;
     int r;
-    bid128_quiet_not_equal(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_not_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
 /* public */
-bool Phloat::operator<(Phloat p) const {
+bool Phloat::operator<(const Phloat &p) const {
+    if (small_int(val) && small_int(p.val))
+        return small_int_cmp(val, p.val) < 0;
     int r;
-    bid128_quiet_less(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_less(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
 /* public */
-bool Phloat::operator<=(Phloat p) const {
+bool Phloat::operator<=(const Phloat &p) const {
+    if (small_int(val) && small_int(p.val))
+        return small_int_cmp(val, p.val) <= 0;
     int r;
-    bid128_quiet_less_equal(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_less_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
 /* public */
-bool Phloat::operator>(Phloat p) const {
+bool Phloat::operator>(const Phloat &p) const {
+    if (small_int(val) && small_int(p.val))
+        return small_int_cmp(val, p.val) > 0;
     int r;
-    bid128_quiet_greater(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_greater(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
 /* public */
-bool Phloat::operator>=(Phloat p) const {
+bool Phloat::operator>=(const Phloat &p) const {
+    if (small_int(val) && small_int(p.val))
+        return small_int_cmp(val, p.val) >= 0;
     int r;
-    bid128_quiet_greater_equal(&r, (BID_UINT128 *) &val, &p.val);
+    bid128_quiet_greater_equal(&r, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return r != 0;
 }
 
@@ -308,73 +393,79 @@ Phloat Phloat::operator-() const {
 }
 
 /* public */
-Phloat Phloat::operator*(Phloat p) const {
+Phloat Phloat::operator*(const Phloat &p) const {
     BID_UINT128 res;
-    bid128_mul(&res, (BID_UINT128 *) &val, &p.val);
+    if (!small_int_mul(&res, val, p.val))
+        bid128_mul(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
 /* public */
-Phloat Phloat::operator/(Phloat p) const {
+Phloat Phloat::operator/(const Phloat &p) const {
     BID_UINT128 res;
-    bid128_div(&res, (BID_UINT128 *) &val, &p.val);
+    bid128_div(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
 /* public */
-Phloat Phloat::operator+(Phloat p) const {
+Phloat Phloat::operator+(const Phloat &p) const {
     BID_UINT128 res;
-    bid128_add(&res, (BID_UINT128 *) &val, &p.val);
+    if (!small_int_add(&res, val, p.val, false))
+        bid128_add(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
 /* public */
-Phloat Phloat::operator-(Phloat p) const {
+Phloat Phloat::operator-(const Phloat &p) const {
     BID_UINT128 res;
-    bid128_sub(&res, (BID_UINT128 *) &val, &p.val);
+    if (!small_int_add(&res, val, p.val, true))
+        bid128_sub(&res, (BID_UINT128 *) &val, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
 /* public */
-Phloat Phloat::operator*=(Phloat p) {
+Phloat &Phloat::operator*=(const Phloat &p) {
     BID_UINT128 res;
-    bid128_mul(&res, &val, &p.val);
+    if (!small_int_mul(&res, val, p.val))
+        bid128_mul(&res, &val, (BID_UINT128 *) &p.val);
     val = res;
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator/=(Phloat p) {
+Phloat &Phloat::operator/=(const Phloat &p) {
     BID_UINT128 res;
-    bid128_div(&res, &val, &p.val);
+    bid128_div(&res, &val, (BID_UINT128 *) &p.val);
     val = res;
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator+=(Phloat p) {
+Phloat &Phloat::operator+=(const Phloat &p) {
     BID_UINT128 res;
-    bid128_add(&res, &val, &p.val);
+    if (!small_int_add(&res, val, p.val, false))
+        bid128_add(&res, &val, (BID_UINT128 *) &p.val);
     val = res;
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator-=(Phloat p) {
+Phloat &Phloat::operator-=(const Phloat &p) {
     BID_UINT128 res;
-    bid128_sub(&res, &val, &p.val);
+    if (!small_int_add(&res, val, p.val, true))
+        bid128_sub(&res, &val, (BID_UINT128 *) &p.val);
     val = res;
     return *this;
 }
 
 /* public */
-Phloat Phloat::operator++() {
+Phloat &Phloat::operator++() {
     // prefix
     BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
+    make_small_int(&one, false, 1);
     BID_UINT128 temp;
-    bid128_add(&temp, &val, &one);
+    if (!small_int_add(&temp, val, one, false))
+        bid128_add(&temp, &val, &one);
     val = temp;
     return *this;
 }
@@ -384,20 +475,20 @@ Phloat Phloat::operator++(int) {
     // postfix
     Phloat old = *this;
     BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    bid128_add(&val, &old.val, &one);
+    make_small_int(&one, false, 1);
+    if (!small_int_add(&val, old.val, one, false))
+        bid128_add(&val, &old.val, &one);
     return old;
 }
 
 /* public */
-Phloat Phloat::operator--() {
+Phloat &Phloat::operator--() {
     // prefix
     BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
+    make_small_int(&one, false, 1);
     BID_UINT128 temp;
-    bid128_sub(&temp, &val, &one);
+    if (!small_int_add(&temp, val, one, true))
+        bid128_sub(&temp, &val, &one);
     val = temp;
     return *this;
 }
@@ -407,34 +498,34 @@ Phloat Phloat::operator--(int) {
     // postfix
     Phloat old = *this;
     BID_UINT128 one;
-    int d1 = 1;
-    bid128_from_int32(&one, &d1);
-    bid128_sub(&val, &old.val, &one);
+    make_small_int(&one, false, 1);
+    if (!small_int_add(&val, old.val, one, true))
+        bid128_sub(&val, &old.val, &one);
     return old;
 }
 
-int p_isinf(Phloat p) {
+int p_isinf(const Phloat &p) {
     int r;
-    if (bid128_isInf(&r, &p.val), r)
-        return (bid128_isSigned(&r, &p.val), r) ? -1 : 1;
+    if (bid128_isInf(&r, (BID_UINT128 *) &p.val), r)
+        return (bid128_isSigned(&r, (BID_UINT128 *) &p.val), r) ? -1 : 1;
     else
         return 0;
 }
 
-int p_isnan(Phloat p) {
+int p_isnan(const Phloat &p) {
     int r;
-    bid128_isNaN(&r, &p.val);
+    bid128_isNaN(&r, (BID_UINT128 *) &p.val);
     return r;
 }
 
-int to_digit(Phloat p) {
+int to_digit(const Phloat &p) {
     BID_UINT128 ten, res;
     int d10 = 10;
     int ires;
     bid128_from_int32(&ten, &d10);
-    bid128_rem(&res, &p.val, &ten);
+    bid128_rem(&res, (BID_UINT128 *) &p.val, &ten);
     int numer_sign, res_sign;
-    bid128_isSigned(&numer_sign, &p.val);
+    bid128_isSigned(&numer_sign, (BID_UINT128 *) &p.val);
     bid128_isSigned(&res_sign, &res);
     if (numer_sign ^ res_sign) {
         BID_UINT128 r2;
@@ -448,205 +539,208 @@ int to_digit(Phloat p) {
     return ires;
 }
 
-char to_char(Phloat p) {
+char to_char(const Phloat &p) {
     int4 res;
-    bid128_to_int32_xint(&res, &p.val);
+    bid128_to_int32_xint(&res, (BID_UINT128 *) &p.val);
     return (char) res;
 }
 
-int to_int(Phloat p) {
+int to_int(const Phloat &p) {
     int4 res;
-    bid128_to_int32_xint(&res, &p.val);
+    bid128_to_int32_xint(&res, (BID_UINT128 *) &p.val);
     return (int) res;
 }
 
-int4 to_int4(Phloat p) {
+int4 to_int4(const Phloat &p) {
     int4 res;
-    bid128_to_int32_xint(&res, &p.val);
+    bid128_to_int32_xint(&res, (BID_UINT128 *) &p.val);
     return res;
 }
 
-int8 to_int8(Phloat p) {
+int8 to_int8(const Phloat &p) {
     int8 res;
-    bid128_to_int64_xint(&res, &p.val);
+    bid128_to_int64_xint(&res, (BID_UINT128 *) &p.val);
     return res;
 }
 
-uint8 to_uint8(Phloat p) {
+uint8 to_uint8(const Phloat &p) {
     uint8 res;
-    bid128_to_uint64_xint(&res, &p.val);
+    bid128_to_uint64_xint(&res, (BID_UINT128 *) &p.val);
     return res;
 }
 
-double to_double(Phloat p) {
+double to_double(const Phloat &p) {
     double res;
-    bid128_to_binary64(&res, &p.val);
+    bid128_to_binary64(&res, (BID_UINT128 *) &p.val);
     return res;
 }
 
-Phloat sin(Phloat p) {
+Phloat sin(const Phloat &p) {
     BID_UINT128 res;
-    bid128_sin(&res, &p.val);
+    bid128_sin(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat cos(Phloat p) {
+Phloat cos(const Phloat &p) {
     BID_UINT128 res;
-    bid128_cos(&res, &p.val);
+    bid128_cos(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat tan(Phloat p) {
+Phloat tan(const Phloat &p) {
     BID_UINT128 res;
-    bid128_tan(&res, &p.val);
+    bid128_tan(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat asin(Phloat p) {
+Phloat asin(const Phloat &p) {
     BID_UINT128 res;
-    bid128_asin(&res, &p.val);
+    bid128_asin(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat acos(Phloat p) {
+Phloat acos(const Phloat &p) {
     if (p == -1)
         // Intel library bug work-around
         return PI;
     BID_UINT128 res;
-    bid128_acos(&res, &p.val);
+    bid128_acos(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat atan(Phloat p) {
+Phloat atan(const Phloat &p) {
     BID_UINT128 res;
-    bid128_atan(&res, &p.val);
+    bid128_atan(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-void p_sincos(Phloat phi, Phloat *s, Phloat *c) {
-    bid128_sin(&s->val, &phi.val);
-    bid128_cos(&c->val, &phi.val);
+void p_sincos(const Phloat &phi, Phloat *s, Phloat *c) {
+    // phi may be *s or *c
+    BID_UINT128 sres;
+    bid128_sin(&sres, (BID_UINT128 *) &phi.val);
+    bid128_cos(&c->val, (BID_UINT128 *) &phi.val);
+    s->val = sres;
 }
 
-Phloat hypot(Phloat x, Phloat y) {
+Phloat hypot(const Phloat &x, const Phloat &y) {
     BID_UINT128 res;
-    bid128_hypot(&res, &x.val, &y.val);
+    bid128_hypot(&res, (BID_UINT128 *) &x.val, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-Phloat atan2(Phloat x, Phloat y) {
+Phloat atan2(const Phloat &x, const Phloat &y) {
     BID_UINT128 res;
-    bid128_atan2(&res, &x.val, &y.val);
+    bid128_atan2(&res, (BID_UINT128 *) &x.val, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-Phloat sinh(Phloat p) {
+Phloat sinh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_sinh(&res, &p.val);
+    bid128_sinh(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat cosh(Phloat p) {
+Phloat cosh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_cosh(&res, &p.val);
+    bid128_cosh(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat tanh(Phloat p) {
+Phloat tanh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_tanh(&res, &p.val);
+    bid128_tanh(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat asinh(Phloat p) {
+Phloat asinh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_asinh(&res, &p.val);
+    bid128_asinh(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat acosh(Phloat p) {
+Phloat acosh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_acosh(&res, &p.val);
+    bid128_acosh(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat atanh(Phloat p) {
+Phloat atanh(const Phloat &p) {
     BID_UINT128 res;
-    bid128_atanh(&res, &p.val);
+    bid128_atanh(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat log(Phloat p) {
+Phloat log(const Phloat &p) {
     BID_UINT128 res;
-    bid128_log(&res, &p.val);
+    bid128_log(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat log1p(Phloat p) {
+Phloat log1p(const Phloat &p) {
     BID_UINT128 res;
-    bid128_log1p(&res, &p.val);
+    bid128_log1p(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat log10(Phloat p) {
+Phloat log10(const Phloat &p) {
     BID_UINT128 res;
-    bid128_log10(&res, &p.val);
+    bid128_log10(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat exp(Phloat p) {
+Phloat exp(const Phloat &p) {
     BID_UINT128 res;
-    bid128_exp(&res, &p.val);
+    bid128_exp(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat expm1(Phloat p) {
+Phloat expm1(const Phloat &p) {
     BID_UINT128 res;
-    bid128_expm1(&res, &p.val);
+    bid128_expm1(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat tgamma(Phloat p) {
+Phloat tgamma(const Phloat &p) {
     BID_UINT128 res;
-    bid128_tgamma(&res, &p.val);
+    bid128_tgamma(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat sqrt(Phloat p) {
+Phloat sqrt(const Phloat &p) {
     BID_UINT128 res;
-    bid128_sqrt(&res, &p.val);
+    bid128_sqrt(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat fmod(Phloat x, Phloat y) {
+Phloat fmod(const Phloat &x, const Phloat &y) {
     BID_UINT128 res;
-    bid128_rem(&res, &x.val, &y.val);
+    bid128_rem(&res, (BID_UINT128 *) &x.val, (BID_UINT128 *) &y.val);
     int numer_sign, denom_sign, res_sign;
-    bid128_isSigned(&numer_sign, &x.val);
-    bid128_isSigned(&denom_sign, &y.val);
+    bid128_isSigned(&numer_sign, (BID_UINT128 *) &x.val);
+    bid128_isSigned(&denom_sign, (BID_UINT128 *) &y.val);
     bid128_isSigned(&res_sign, &res);
     if (numer_sign ^ res_sign) {
         BID_UINT128 r2;
         if (denom_sign ^ res_sign)
-            bid128_add(&r2, &res, &y.val);
+            bid128_add(&r2, &res, (BID_UINT128 *) &y.val);
         else
-            bid128_sub(&r2, &res, &y.val);
+            bid128_sub(&r2, &res, (BID_UINT128 *) &y.val);
         return Phloat(r2);
     } else
         return Phloat(res);
 }
 
-Phloat fabs(Phloat p) {
+Phloat fabs(const Phloat &p) {
     BID_UINT128 res;
-    bid128_abs(&res, &p.val);
+    bid128_abs(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat pow(Phloat y, Phloat x) {
+Phloat pow(const Phloat &y, const Phloat &x) {
     BID_UINT128 temp, res;
-    bid128_round_integral_negative(&temp, &x.val);
+    bid128_round_integral_negative(&temp, (BID_UINT128 *) &x.val);
     int r;
-    bid128_quiet_equal(&r, &temp, &x.val);
+    bid128_quiet_equal(&r, &temp, (BID_UINT128 *) &x.val);
     if (r != 0) {
         // Integral power. bid128_pow doesn't handle these very well,
         // so I'm using repeated squaring instead. This way at least
@@ -659,7 +753,7 @@ Phloat pow(Phloat y, Phloat x) {
             goto noninteger_exponent;
         int4 ex = to_int4(x);
         bool exp_even = (ex & 1) == 0;
-        bid128_isZero(&r, &y.val);
+        bid128_isZero(&r, (BID_UINT128 *) &y.val);
         if (r != 0) {
             if (ex < 0) {
                 BID_UINT128 zero;
@@ -676,7 +770,7 @@ Phloat pow(Phloat y, Phloat x) {
         bid128_from_int32(&res, &ione);
         BID_UINT128 yy;
         if (ex < 0) {
-            bid128_div(&yy, &res, &y.val);
+            bid128_div(&yy, &res, (BID_UINT128 *) &y.val);
             ex = -ex;
         } else
             yy = y.val;
@@ -698,7 +792,7 @@ Phloat pow(Phloat y, Phloat x) {
                         } else
                             return res;
                     } else {
-                        bid128_isSigned(&r, &y.val);
+                        bid128_isSigned(&r, (BID_UINT128 *) &y.val);
                         if (((r != 0) ^ (inf < 0)) != 0) {
                             bid128_negate(&tmp, &res);
                             return tmp;
@@ -718,59 +812,64 @@ Phloat pow(Phloat y, Phloat x) {
         }
     } else {
         noninteger_exponent:
-        bid128_pow(&res, &y.val, &x.val);
+        bid128_pow(&res, (BID_UINT128 *) &y.val, (BID_UINT128 *) &x.val);
         return Phloat(res);
     }
 }
 
-Phloat floor(Phloat p) {
+Phloat floor(const Phloat &p) {
     BID_UINT128 res;
-    bid128_round_integral_zero(&res, &p.val);
+    bid128_round_integral_zero(&res, (BID_UINT128 *) &p.val);
     return Phloat(res);
 }
 
-Phloat operator*(int x, Phloat y) {
+Phloat operator*(int x, const Phloat &y) {
     BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_mul(&res, &xx, &y.val);
+    make_small_int(&xx, x);
+    if (!small_int_mul(&res, xx, y.val))
+        bid128_mul(&res, &xx, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-Phloat operator/(int x, Phloat y) {
+Phloat operator/(int x, const Phloat &y) {
     BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_div(&res, &xx, &y.val);
+    make_small_int(&xx, x);
+    bid128_div(&res, &xx, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-Phloat operator/(double x, Phloat y) {
+Phloat operator/(double x, const Phloat &y) {
     BID_UINT128 xx, res;
     BID_UINT64 tmp;
     binary64_to_bid64(&tmp, &x);
     bid64_to_bid128(&xx, &tmp);
-    bid128_div(&res, &xx, &y.val);
+    bid128_div(&res, &xx, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-Phloat operator+(int x, Phloat y) {
+Phloat operator+(int x, const Phloat &y) {
     BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_add(&res, &xx, &y.val);
+    make_small_int(&xx, x);
+    if (!small_int_add(&res, xx, y.val, false))
+        bid128_add(&res, &xx, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-Phloat operator-(int x, Phloat y) {
+Phloat operator-(int x, const Phloat &y) {
     BID_UINT128 xx, res;
-    bid128_from_int32(&xx, &x);
-    bid128_sub(&res, &xx, &y.val);
+    make_small_int(&xx, x);
+    if (!small_int_add(&res, xx, y.val, true))
+        bid128_sub(&res, &xx, (BID_UINT128 *) &y.val);
     return Phloat(res);
 }
 
-bool operator==(int4 x, Phloat y) {
+bool operator==(int4 x, const Phloat &y) {
     BID_UINT128 xx;
-    bid128_from_int32(&xx, &x);
+    make_small_int(&xx, x);
+    if (small_int(y.val))
+        return small_int_cmp(xx, y.val) == 0;
     int r;
-    bid128_quiet_equal(&r, &xx, &y.val);
+    bid128_quiet_equal(&r, &xx, (BID_UINT128 *) &y.val);
     return r != 0;
 }
 
@@ -985,8 +1084,9 @@ double decimal2double(void *data, bool pin_magnitude /* = false */) {
 #endif // BCD_MATH
 
 
-int phloat2string(phloat pd, char *buf, int buflen, int base_mode, int digits,
-                         int dispmode, int thousandssep, int max_mant_digits) {
+static int phloat2string_nocache(phloat pd, char *buf, int buflen,
+                                 int base_mode, int digits, int dispmode,
+                                 int thousandssep, int max_mant_digits) {
     if (pd == 0)
         pd = 0; // Suppress signed zero
 
@@ -1454,3 +1554,103 @@ int phloat2string(phloat pd, char *buf, int buflen, int base_mode, int digits,
         return chars_so_far;
     }
 }
+
+
+/* Cache for phloat2string(). Redisplaying the stack formats the same few
+ * numbers over and over, during program runs with VIEW and PSE, and while
+ * navigating menus, and that is a relatively expensive conversion in the
+ * decimal build. The most recent results are kept in a small table,
+ * keyed by the value's bits, the arguments, and the flags and word size that
+ * the formatting depends on; since the key covers all of those, entries never
+ * need to be invalidated. The table is searched linearly, comparing hashes
+ * first, and entries are replaced round-robin, so that the few numbers on
+ * the display can't keep evicting each other, as they could in a
+ * direct-mapped table. Results longer than P2S_TEXT_SIZE aren't cached.
+ */
+
+#define P2S_CACHE_SIZE 16
+#define P2S_TEXT_SIZE 50
+
+typedef struct {
+    char x[sizeof(phloat)];
+    int buflen;
+    char base_mode;
+    char digits;
+    char dispmode;
+    char thousandssep;
+    char max_mant_digits;
+    char decimal_point;
+    char base_signed;
+    char base_wrap;
+    char base;
+    char wsize;
+} p2s_key_struct;
+
+typedef struct {
+    p2s_key_struct key;
+    uint4 hash;
+    bool used;
+    int length;
+    char text[P2S_TEXT_SIZE];
+} p2s_entry_struct;
+
+static CORE_TLS p2s_entry_struct p2s_cache[P2S_CACHE_SIZE];
+static CORE_TLS int p2s_next;
+static CORE_TLS uint4 p2s_hits;
+static CORE_TLS uint4 p2s_misses;
+
+int phloat2string(phloat pd, char *buf, int buflen, int base_mode, int digits,
+                         int dispmode, int thousandssep, int max_mant_digits) {
+    p2s_key_struct key;
+    memset(&key, 0, sizeof(key));
+    memcpy(key.x, &pd, sizeof(phloat));
+    key.buflen = buflen;
+    key.base_mode = (char) base_mode;
+    key.digits = (char) digits;
+    key.dispmode = (char) dispmode;
+    key.thousandssep = thousandssep != 0;
+    key.max_mant_digits = (char) max_mant_digits;
+    key.decimal_point = flags.f.decimal_point;
+    key.base_signed = flags.f.base_signed;
+    key.base_wrap = flags.f.base_wrap;
+    key.base = (char) get_base();
+    key.wsize = (char) effective_wsize();
+
+    /* FNV-1a */
+    uint4 hash = 2166136261U;
+    const unsigned char *k = (const unsigned char *) &key;
+    for (unsigned int i = 0; i < sizeof(key); i++)
+        hash = (hash ^ k[i]) * 16777619U;
+
+    for (int i = 0; i < P2S_CACHE_SIZE; i++) {
+        p2s_entry_struct *e = p2s_cache + i;
+        if (e->used && e->hash == hash
+                && memcmp(&e->key, &key, sizeof(key)) == 0) {
+            p2s_hits++;
+            memcpy(buf, e->text, e->length);
+            return e->length;
+        }
+    }
+    p2s_misses++;
+    int len = phloat2string_nocache(pd, buf, buflen, base_mode, digits,
+                                    dispmode, thousandssep, max_mant_digits);
+    if (len <= P2S_TEXT_SIZE) {
+        p2s_entry_struct *e = p2s_cache + p2s_next;
+        p2s_next = (p2s_next + 1) % P2S_CACHE_SIZE;
+        e->key = key;
+        e->hash = hash;
+        e->used = true;
+        e->length = len;
+        memcpy(e->text, buf, len);
+    }
+    return len;
+}
+
+void phloat2string_stats(uint4 *hits, uint4 *misses, bool reset) {
+    *hits = p2s_hits;
+    *misses = p2s_misses;
+    if (reset) {
+        p2s_hits = 0;
+        p2s_misses = 0;
+    }
+}
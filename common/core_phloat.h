@@ -80,38 +80,36 @@ class Phloat {
         Phloat(int8 i);
         Phloat(uint8 i);
         Phloat(double d);
-        Phloat(const Phloat &p);
-        Phloat operator=(const BID_UINT128 &b) { val = b; return *this; }
-        Phloat operator=(int i);
-        Phloat operator=(int8 i);
-        Phloat operator=(uint8 i);
-        Phloat operator=(double d);
-        Phloat operator=(Phloat p);
-        bool operator==(Phloat p) const;
-        bool operator!=(Phloat p) const;
-        bool operator<(Phloat p) const;
-        bool operator<=(Phloat p) const;
-        bool operator>(Phloat p) const;
-        bool operator>=(Phloat p) const;
+        Phloat &operator=(const BID_UINT128 &b) { val = b; return *this; }
+        Phloat &operator=(int i);
+        Phloat &operator=(int8 i);
+        Phloat &operator=(uint8 i);
+        Phloat &operator=(double d);
+        bool operator==(const Phloat &p) const;
+        bool operator!=(const Phloat &p) const;
+        bool operator<(const Phloat &p) const;
+        bool operator<=(const Phloat &p) const;
+        bool operator>(const Phloat &p) const;
+        bool operator>=(const Phloat &p) const;
         Phloat operator-() const;
-        Phloat operator*(Phloat p) const;
-        Phloat operator/(Phloat p) const;
-        Phloat operator+(Phloat p) const;
-        Phloat operator-(Phloat p) const;
-        Phloat operator*=(Phloat p);
-        Phloat operator/=(Phloat p);
-        Phloat operator+=(Phloat p);
-        Phloat operator-=(Phloat p);
-        Phloat operator++(); // prefix
+        Phloat operator*(const Phloat &p) const;
+        Phloat operator/(const Phloat &p) const;
+        Phloat operator+(const Phloat &p) const;
+        Phloat operator-(const Phloat &p) const;
+        Phloat &operator*=(const Phloat &p);
+        Phloat &operator/=(const Phloat &p);
+        Phloat &operator+=(const Phloat &p);
+        Phloat &operator-=(const Phloat &p);
+        Phloat &operator++(); // prefix
         Phloat operator++(int); // postfix
-        Phloat operator--(); // prefix
+        Phloat &operator--(); // prefix
         Phloat operator--(int); // postfix
 };
 
 // I can't simply overload isinf() and isnan(), because the Linux math.h
 // defines them as macros.
-int p_isinf(Phloat p);
-int p_isnan(Phloat p);
+int p_isinf(const Phloat &p);
+int p_isnan(const Phloat &p);
 
 // We don't define type cast operators, because they just lead
 // to tons of ambiguities. Defining explicit conversions instead.
@@ -119,47 +117,47 @@ int p_isnan(Phloat p);
 // converted actually fits in the returned type; if not, the result
 // is undefined, except for to_char(), which will handle the range
 // -128..255 correctly.
-int to_digit(Phloat p); // Returns digit in units position
-char to_char(Phloat p);
-int to_int(Phloat p);
-int4 to_int4(Phloat p);
-int8 to_int8(Phloat p);
-uint8 to_uint8(Phloat p);
-double to_double(Phloat p);
-
-Phloat sin(Phloat p);
-Phloat cos(Phloat p);
-Phloat tan(Phloat p);
-Phloat asin(Phloat p);
-Phloat acos(Phloat p);
-Phloat atan(Phloat p);
-void p_sincos(Phloat phi, Phloat *s, Phloat *c);
-Phloat hypot(Phloat x, Phloat y);
-Phloat atan2(Phloat x, Phloat y);
-Phloat sinh(Phloat p);
-Phloat cosh(Phloat p);
-Phloat tanh(Phloat p);
-Phloat asinh(Phloat p);
-Phloat acosh(Phloat p);
-Phloat atanh(Phloat p);
-Phloat log(Phloat p);
-Phloat log1p(Phloat p);
-Phloat log10(Phloat p);
-Phloat exp(Phloat p);
-Phloat expm1(Phloat p);
-Phloat tgamma(Phloat p);
-Phloat sqrt(Phloat p);
-Phloat fmod(Phloat x, Phloat y);
-Phloat fabs(Phloat p);
-Phloat pow(Phloat x, Phloat y);
-Phloat floor(Phloat x);
-
-Phloat operator*(int x, Phloat y);
-Phloat operator/(int x, Phloat y);
-Phloat operator/(double x, Phloat y);
-Phloat operator+(int x, Phloat y);
-Phloat operator-(int x, Phloat y);
-bool operator==(int4 x, Phloat y);
+int to_digit(const Phloat &p); // Returns digit in units position
+char to_char(const Phloat &p);
+int to_int(const Phloat &p);
+int4 to_int4(const Phloat &p);
+int8 to_int8(const Phloat &p);
+uint8 to_uint8(const Phloat &p);
+double to_double(const Phloat &p);
+
+Phloat sin(const Phloat &p);
+Phloat cos(const Phloat &p);
+Phloat tan(const Phloat &p);
+Phloat asin(const Phloat &p);
+Phloat acos(const Phloat &p);
+Phloat atan(const Phloat &p);
+void p_sincos(const Phloat &phi, Phloat *s, Phloat *c);
+Phloat hypot(const Phloat &x, const Phloat &y);
+Phloat atan2(const Phloat &x, const Phloat &y);
+Phloat sinh(const Phloat &p);
+Phloat cosh(const Phloat &p);
+Phloat tanh(const Phloat &p);
+Phloat asinh(const Phloat &p);
+Phloat acosh(const Phloat &p);
+Phloat atanh(const Phloat &p);
+Phloat log(const Phloat &p);
+Phloat log1p(const Phloat &p);
+Phloat log10(const Phloat &p);
+Phloat exp(const Phloat &p);
+Phloat expm1(const Phloat &p);
+Phloat tgamma(const Phloat &p);
+Phloat sqrt(const Phloat &p);
+Phloat fmod(const Phloat &x, const Phloat &y);
+Phloat fabs(const Phloat &p);
+Phloat pow(const Phloat &x, const Phloat &y);
+Phloat floor(const Phloat &x);
+
+Phloat operator*(int x, const Phloat &y);
+Phloat operator/(int x, const Phloat &y);
+Phloat operator/(double x, const Phloat &y);
+Phloat operator+(int x, const Phloat &y);
+Phloat operator-(int x, const Phloat &y);
+bool operator==(int4 x, const Phloat &y);
 
 extern Phloat PI;
 
@@ -179,6 +177,9 @@ void phloat_init();
 int phloat2string(phloat d, char *buf, int buflen,
                   int base_mode, int digits, int dispmode,
                   int thousandssep, int max_mant_digits = 12);
+/* Hit and miss counts of the phloat2string() cache, since the calculator
+ * was started, or since the last call with reset = true. */
+void phloat2string_stats(uint4 *hits, uint4 *misses, bool reset);
 int string2phloat(const char *buf, int buflen, phloat *d);
 
 
@@ -19,6 +19,7 @@
 
 #include "core_helpers.h"
 #include "core_linalg1.h"
+#include "core_main.h"
 #include "core_sto_rcl.h"
 #include "core_variables.h"
 
@@ -26,7 +27,7 @@
 static int apply_sto_operation(char operation, vartype *oldval);
 static void generic_sto_completion(int error, vartype *res);
 
-static bool preserve_ij;
+static CORE_TLS bool preserve_ij;
 
 
 static int apply_sto_operation(char operation, vartype *oldval) {
@@ -65,7 +66,8 @@ int generic_div(const vartype *px, const vartype *py, void (*completion)(int, va
         return linalg_div(py, px, completion);
     } else {
         vartype *dst;
-        int error = map_binary(px, py, &dst, div_rr, div_rc, div_cr, div_cc);
+        int error = map_binary(px, py, &dst, div_rr, div_rc, div_cr, div_cc,
+                               div_rra);
         completion(error, dst);
         return error;
     }
@@ -80,7 +82,8 @@ int generic_mul(const vartype *px, const vartype *py, void (*completion)(int, va
         return linalg_mul(py, px, completion);
     } else {
         vartype *dst;
-        int error = map_binary(px, py, &dst, mul_rr, mul_rc, mul_cr, mul_cc);
+        int error = map_binary(px, py, &dst, mul_rr, mul_rc, mul_cr, mul_cc,
+                               mul_rra);
         completion(error, dst);
         return error;
     }
@@ -165,7 +168,8 @@ int generic_sub(const vartype *px, const vartype *py, vartype **dst) {
     } else if (px->type == TYPE_STRING || py->type == TYPE_STRING)
         return ERR_ALPHA_DATA_IS_INVALID;
     else
-        return map_binary(px, py, dst, sub_rr, sub_rc, sub_cr, sub_cc);
+        return map_binary(px, py, dst, sub_rr, sub_rc, sub_cr, sub_cc,
+                          sub_rra);
 }
 
 int generic_add(const vartype *px, const vartype *py, vartype **dst) {
@@ -246,7 +250,8 @@ int generic_add(const vartype *px, const vartype *py, vartype **dst) {
     } else if (px->type == TYPE_STRING || py->type == TYPE_STRING)
         return ERR_ALPHA_DATA_IS_INVALID;
     else
-        return map_binary(px, py, dst, add_rr, add_rc, add_cr, add_cc);
+        return map_binary(px, py, dst, add_rr, add_rc, add_cr, add_cc,
+                          add_rra);
 }
 
 int generic_rcl(arg_struct *arg, vartype **dst) {
@@ -260,7 +265,7 @@ int generic_rcl(arg_struct *arg, vartype **dst) {
     }
     switch (arg->type) {
         case ARGTYPE_NUM: {
-            vartype *regs = recall_var("REGS", 4);
+            vartype *regs = recall_regs();
             if (regs == NULL)
                 return ERR_SIZE_ERROR;
             else if (regs->type == TYPE_REALMATRIX) {
@@ -323,7 +328,7 @@ int generic_rcl(arg_struct *arg, vartype **dst) {
     }
 }
 
-static arg_struct temp_arg;
+static CORE_TLS_PHLOAT arg_struct temp_arg;
 
 static void generic_sto_completion(int error, vartype *res) {
     if (error != ERR_NONE)
@@ -380,7 +385,7 @@ int generic_sto(arg_struct *arg, char operation) {
 
     switch (arg->type) {
         case ARGTYPE_NUM: {
-            vartype *regs = recall_var("REGS", 4);
+            vartype *regs = recall_regs();
             if (regs == NULL)
                 return ERR_SIZE_ERROR;
             if (regs->type == TYPE_REALMATRIX) {
@@ -616,7 +621,56 @@ int generic_sto(arg_struct *arg, char operation) {
     }
 }
 
-int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
+/* Maps the real operators over real matrices: in blocks of MAP_BLOCK, if
+ * there is an array version of the operator, and one element at a time
+ * otherwise, or if core_settings.no_map_arrays is set. In map_rr_array(), an
+ * increment of 0 means a scalar operand.
+ */
+static int map_r_array(mappable_r mr, mappable_ra mra,
+                       const phloat *x, phloat *z, int4 size) {
+    int4 i, n;
+    int error;
+    if (mra == NULL || core_settings.no_map_arrays) {
+        for (i = 0; i < size; i++) {
+            error = mr(x[i], &z[i]);
+            if (error != ERR_NONE)
+                return error;
+        }
+        return ERR_NONE;
+    }
+    for (i = 0; i < size; i += n) {
+        n = size - i < MAP_BLOCK ? size - i : MAP_BLOCK;
+        error = mra(x + i, z + i, n);
+        if (error != ERR_NONE)
+            return error;
+    }
+    return ERR_NONE;
+}
+
+static int map_rr_array(mappable_rr mrr, mappable_rra mrra,
+                        const phloat *x, int xinc, const phloat *y, int yinc,
+                        phloat *z, int4 size) {
+    int4 i, n;
+    int error;
+    if (mrra == NULL || core_settings.no_map_arrays) {
+        for (i = 0; i < size; i++) {
+            error = mrr(x[i * xinc], y[i * yinc], &z[i]);
+            if (error != ERR_NONE)
+                return error;
+        }
+        return ERR_NONE;
+    }
+    for (i = 0; i < size; i += n) {
+        n = size - i < MAP_BLOCK ? size - i : MAP_BLOCK;
+        error = mrra(x + i * xinc, xinc, y + i * yinc, yinc, z + i, n);
+        if (error != ERR_NONE)
+            return error;
+    }
+    return ERR_NONE;
+}
+
+int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc,
+              mappable_ra mra) {
     int error;
     switch (src->type) {
         case TYPE_REAL: {
@@ -655,12 +709,11 @@ int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
                     return ERR_ALPHA_DATA_IS_INVALID;
                 }
             }
-            for (i = 0; i < size; i++) {
-                error = mr(sm->array->data[i], &dm->array->data[i]);
-                if (error != ERR_NONE) {
-                    free_vartype((vartype *) dm);
-                    return error;
-                }
+            error = map_r_array(mr, mra, sm->array->data, dm->array->data,
+                                size);
+            if (error != ERR_NONE) {
+                free_vartype((vartype *) dm);
+                return error;
             }
             *dst = (vartype *) dm;
             return ERR_NONE;
@@ -693,7 +746,8 @@ int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc) {
 }
 
 int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
-        mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc) {
+        mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc,
+        mappable_rra mrra) {
     int error;
     switch (src1->type) {
         case TYPE_REAL:
@@ -737,14 +791,13 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                             free_vartype((vartype *) dm);
                             return ERR_ALPHA_DATA_IS_INVALID;
                         }
-                    for (i = 0; i < size; i++) {
-                        error = mrr(((vartype_real *) src1)->x,
-                                    sm->array->data[i],
-                                    &dm->array->data[i]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    error = map_rr_array(mrr, mrra,
+                                         &((vartype_real *) src1)->x, 0,
+                                         sm->array->data, 1,
+                                         dm->array->data, size);
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -879,14 +932,13 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                             free_vartype((vartype *) dm);
                             return ERR_ALPHA_DATA_IS_INVALID;
                         }
-                    for (i = 0; i < size; i++) {
-                        error = mrr(sm->array->data[i],
-                                    ((vartype_real *) src2)->x,
-                                    &dm->array->data[i]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    error = map_rr_array(mrr, mrra,
+                                         sm->array->data, 1,
+                                         &((vartype_real *) src2)->x, 0,
+                                         dm->array->data, size);
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -939,14 +991,13 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
                             free_vartype((vartype *) dm);
                             return ERR_ALPHA_DATA_IS_INVALID;
                         }
-                    for (i = 0; i < size; i++) {
-                        error = mrr(sm1->array->data[i],
-                                    sm2->array->data[i],
-                                    &dm->array->data[i]);
-                        if (error != ERR_NONE) {
-                            free_vartype((vartype *) dm);
-                            return error;
-                        }
+                    error = map_rr_array(mrr, mrra,
+                                         sm1->array->data, 1,
+                                         sm2->array->data, 1,
+                                         dm->array->data, size);
+                    if (error != ERR_NONE) {
+                        free_vartype((vartype *) dm);
+                        return error;
                     }
                     *dst = (vartype *) dm;
                     return ERR_NONE;
@@ -1105,6 +1156,64 @@ int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
     }
 }
 
+int range_check_array(phloat *z, int4 n) {
+    int4 i;
+    int inf;
+    for (i = 0; i < n; i++)
+        if (p_isinf(z[i]))
+            break;
+    if (i == n)
+        return ERR_NONE;
+    if (!flags.f.range_error_ignore)
+        return ERR_OUT_OF_RANGE;
+    for (; i < n; i++)
+        if ((inf = p_isinf(z[i])) != 0)
+            z[i] = inf == 1 ? POS_HUGE_PHLOAT : NEG_HUGE_PHLOAT;
+    return ERR_NONE;
+}
+
+/* The array versions of the real operators compute a whole span, and then
+ * range-check it in one go; div_rra() first looks for the first zero
+ * divisor, so that it reports the same error the element-by-element version
+ * would, in case there is also an overflow ahead of it.
+ */
+
+int div_rra(const phloat *x, int xinc, const phloat *y, int yinc,
+                                    phloat *z, int4 n) {
+    int4 i, k;
+    int error;
+    for (k = 0; k < n; k++)
+        if (x[k * xinc] == 0)
+            break;
+    for (i = 0; i < k; i++)
+        z[i] = y[i * yinc] / x[i * xinc];
+    error = range_check_array(z, k);
+    if (error != ERR_NONE)
+        return error;
+    return k < n ? ERR_DIVIDE_BY_0 : ERR_NONE;
+}
+
+int mul_rra(const phloat *x, int xinc, const phloat *y, int yinc,
+                                    phloat *z, int4 n) {
+    for (int4 i = 0; i < n; i++)
+        z[i] = y[i * yinc] * x[i * xinc];
+    return range_check_array(z, n);
+}
+
+int sub_rra(const phloat *x, int xinc, const phloat *y, int yinc,
+                                    phloat *z, int4 n) {
+    for (int4 i = 0; i < n; i++)
+        z[i] = y[i * yinc] - x[i * xinc];
+    return range_check_array(z, n);
+}
+
+int add_rra(const phloat *x, int xinc, const phloat *y, int yinc,
+                                    phloat *z, int4 n) {
+    for (int4 i = 0; i < n; i++)
+        z[i] = y[i * yinc] + x[i * xinc];
+    return range_check_array(z, n);
+}
+
 int div_rr(phloat x, phloat y, phloat *z) {
     phloat r;
     int inf;
@@ -45,6 +45,32 @@ typedef int (*mappable_cc)(phloat xre, phloat xim, phloat yre, phloat yim,
                                                 phloat *zre, phloat *zim);
 
 
+/*****************************************************************/
+/* Array versions of mappable_r and mappable_rr, for real matrix */
+/* operands                                                      */
+/*****************************************************************/
+
+/* These apply an operator to the 'n' elements of a contiguous span, so that
+ * they can check the angle mode, range_error_ignore, etc., once for the whole
+ * span, instead of once per element. They return the error code that the
+ * first failing element would have returned from the corresponding mappable,
+ * if any; the contents of 'z' are undefined in that case. The spans passed in
+ * by map_unary() and map_binary() are at most MAP_BLOCK elements long, and a
+ * scalar operand of map_binary() is passed with an increment of 0.
+ */
+#define MAP_BLOCK 128
+
+typedef int (*mappable_ra)(const phloat *x, phloat *z, int4 n);
+typedef int (*mappable_rra)(const phloat *x, int xinc, const phloat *y,
+                                            int yinc, phloat *z, int4 n);
+
+/* Range check for the results of an array operator: if any element of 'z'
+ * is infinite, returns ERR_OUT_OF_RANGE, or, when range errors are ignored,
+ * replaces the infinities with the largest finite value of the same sign.
+ */
+int range_check_array(phloat *z, int4 n);
+
+
 /****************************************************************/
 /* Generic arithmetic operators, for use in the implementations */
 /* of +, -, *, /, STO+, STO-, etc...                            */
@@ -65,33 +91,46 @@ int generic_sto(arg_struct *arg, char operation);
 /* to arbitrary parameter types               */
 /**********************************************/
 
-int map_unary(const vartype *src, vartype **dst, mappable_r, mappable_c mc);
+/* The array operators are optional; without them, real matrices are mapped
+ * one element at a time. */
+
+int map_unary(const vartype *src, vartype **dst, mappable_r, mappable_c mc,
+            mappable_ra mra = NULL);
 int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
-            mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc);
+            mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc,
+            mappable_rra mrra = NULL);
 
 /**************************************************************/
 /* Operators that can be used by the mapping functions, above */
 /**************************************************************/
 
 int div_rr(phloat x, phloat y, phloat *z);
+int div_rra(const phloat *x, int xinc, const phloat *y, int yinc,
+                                    phloat *z, int4 n);
 int div_rc(phloat x, phloat yre, phloat yim, phloat *zre, phloat *zim);
 int div_cr(phloat xre, phloat xim, phloat y, phloat *zre, phloat *zim);
 int div_cc(phloat xre, phloat xim, phloat yre, phloat yim,
                                     phloat *zre, phloat *zim);
 
 int mul_rr(phloat x, phloat y, phloat *z);
+int mul_rra(const phloat *x, int xinc, const phloat *y, int yinc,
+                                    phloat *z, int4 n);
 int mul_rc(phloat x, phloat yre, phloat yim, phloat *zre, phloat *zim);
 int mul_cr(phloat xre, phloat xim, phloat y, phloat *zre, phloat *zim);
 int mul_cc(phloat xre, phloat xim, phloat yre, phloat yim,
                                     phloat *zre, phloat *zim);
 
 int sub_rr(phloat x, phloat y, phloat *z);
+int sub_rra(const phloat *x, int xinc, const phloat *y, int yinc,
+                                    phloat *z, int4 n);
 int sub_rc(phloat x, phloat yre, phloat yim, phloat *zre, phloat *zim);
 int sub_cr(phloat xre, phloat xim, phloat y, phloat *zre, phloat *zim);
 int sub_cc(phloat xre, phloat xim, phloat yre, phloat yim,
                                     phloat *zre, phloat *zim);
 
 int add_rr(phloat x, phloat y, phloat *z);
+int add_rra(const phloat *x, int xinc, const phloat *y, int yinc,
+                                    phloat *z, int4 n);
 int add_rc(phloat x, phloat yre, phloat yim, phloat *zre, phloat *zim);
 int add_cr(phloat xre, phloat xim, phloat y, phloat *zre, phloat *zim);
 int add_cc(phloat xre, phloat xim, phloat yre, phloat yim,
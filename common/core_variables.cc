@@ -16,6 +16,7 @@
  *****************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "core_globals.h"
 #include "core_helpers.h"
@@ -31,21 +32,21 @@ typedef struct pool_real {
     struct pool_real *next;
 } pool_real;
 
-static pool_real *realpool = NULL;
+static CORE_TLS pool_real *realpool = NULL;
 
 typedef struct pool_complex {
     vartype_complex c;
     struct pool_complex *next;
 } pool_complex;
 
-static pool_complex *complexpool = NULL;
+static CORE_TLS pool_complex *complexpool = NULL;
 
 typedef struct pool_string {
     vartype_string s;
     struct pool_string *next;
 } pool_string;
 
-static pool_string *stringpool = NULL;
+static CORE_TLS pool_string *stringpool = NULL;
 
 vartype *new_real(phloat value) {
     pool_real *r;
@@ -369,8 +370,180 @@ int disentangle(vartype *v) {
     }
 }
 
+/* Variable index. Named variables live in vars[], in creation order, which is
+ * also the order used by the catalog and in state files. To avoid linear
+ * searches, vars[] is indexed by a hash table whose chains are linked through
+ * var_hash_next[], which runs parallel to vars[]. Chains are kept in
+ * descending index order, so the first visible match in a chain is the one
+ * lookup_var() wants, and appending a variable is a push onto its chain.
+ * Local variables are also listed in local_vars[], in ascending index order.
+ * Locals can only be created at the current return level, and all locals at
+ * deeper levels have been removed by the time the program gets back to it,
+ * so their levels are nondecreasing along local_vars[], and remove_locals()
+ * only has to pop a suffix of it.
+ * The index is rebuilt lazily, after bulk changes to vars[].
+ */
+
+#define VAR_HASH_MIN_SIZE 64
+
+static CORE_TLS bool var_index_valid = false;
+static CORE_TLS int var_hash_size = 0;
+static CORE_TLS int *var_hash = NULL;
+static CORE_TLS int *var_hash_next = NULL;
+static CORE_TLS int var_hash_next_capacity = 0;
+static CORE_TLS int *local_vars = NULL;
+static CORE_TLS int local_vars_count = 0;
+static CORE_TLS int local_vars_capacity = 0;
+
+static int var_hash_code(const char *name, int namelength) {
+    unsigned int h = 0;
+    for (int i = 0; i < namelength; i++)
+        h = h * 31 + (unsigned char) name[i];
+    return h & (var_hash_size - 1);
+}
+
+static void link_var(int varindex) {
+    int h = var_hash_code(vars[varindex].name, vars[varindex].length);
+    var_hash_next[varindex] = var_hash[h];
+    var_hash[h] = varindex;
+}
+
+static bool grow_var_hash_next() {
+    if (vars_count <= var_hash_next_capacity)
+        return true;
+    int nc = var_hash_next_capacity * 2;
+    if (nc < vars_capacity)
+        nc = vars_capacity;
+    int *new_next = (int *) realloc(var_hash_next, nc * sizeof(int));
+    if (new_next == NULL)
+        return false;
+    var_hash_next = new_next;
+    var_hash_next_capacity = nc;
+    return true;
+}
+
+static bool rebuild_var_index() {
+    int size = var_hash_size == 0 ? VAR_HASH_MIN_SIZE : var_hash_size;
+    while (size < vars_count)
+        size <<= 1;
+    if (size != var_hash_size) {
+        int *new_hash = (int *) realloc(var_hash, size * sizeof(int));
+        if (new_hash == NULL)
+            return false;
+        var_hash = new_hash;
+        var_hash_size = size;
+    }
+    if (!grow_var_hash_next())
+        return false;
+    int nlocals = 0;
+    for (int i = 0; i < vars_count; i++)
+        if (vars[i].level != -1)
+            nlocals++;
+    if (local_vars_capacity < nlocals) {
+        int *new_locals = (int *) realloc(local_vars, nlocals * sizeof(int));
+        if (new_locals == NULL)
+            return false;
+        local_vars = new_locals;
+        local_vars_capacity = nlocals;
+    }
+    for (int h = 0; h < var_hash_size; h++)
+        var_hash[h] = -1;
+    local_vars_count = 0;
+    for (int i = 0; i < vars_count; i++) {
+        link_var(i);
+        if (vars[i].level != -1)
+            local_vars[local_vars_count++] = i;
+    }
+    var_index_valid = true;
+    return true;
+}
+
+static bool check_var_index() {
+    return var_index_valid || rebuild_var_index();
+}
+
+/* The visible "REGS", as found by recall_var(), cached for the numbered
+ * register commands. It is dropped whenever a variable named REGS is stored
+ * or purged, whenever locals are removed, which may uncover a hidden REGS,
+ * and by invalidate_var_index(), which is called after bulk changes to
+ * vars[]. Changes to the matrix itself, such as resizing or disentangling,
+ * are done in place, so they don't affect it.
+ */
+static CORE_TLS vartype *regs_cache = NULL;
+static CORE_TLS bool regs_cache_valid = false;
+
+void invalidate_var_index() {
+    var_index_valid = false;
+    regs_cache_valid = false;
+    bump_lookup_generation();
+}
+
+/* Adds the variable just appended at vars[vars_count - 1] to the index */
+static void index_new_var() {
+    if (!var_index_valid)
+        return;
+    int varindex = vars_count - 1;
+    if (vars_count > var_hash_size) {
+        // Grow the hash table
+        rebuild_var_index();
+        return;
+    }
+    if (!grow_var_hash_next()) {
+        var_index_valid = false;
+        return;
+    }
+    link_var(varindex);
+    if (vars[varindex].level != -1) {
+        if (local_vars_count == local_vars_capacity) {
+            int nc = local_vars_capacity + 16;
+            int *new_locals = (int *) realloc(local_vars, nc * sizeof(int));
+            if (new_locals == NULL) {
+                var_index_valid = false;
+                return;
+            }
+            local_vars = new_locals;
+            local_vars_capacity = nc;
+        }
+        local_vars[local_vars_count++] = varindex;
+    }
+}
+
+/* Removes vars[varindex], shifting the variables above it down, and updates
+ * the index to match. The variables from varindex up have the highest
+ * indexes in vars[], so, as in remove_locals(), they form a prefix of each
+ * hash chain; they are unlinked, and the survivors are re-linked after the
+ * shift, so the work is proportional to the number of variables moved.
+ */
+static void remove_var(int varindex) {
+    bool indexed = var_index_valid;
+    if (indexed) {
+        for (int i = vars_count - 1; i >= varindex; i--)
+            var_hash[var_hash_code(vars[i].name, vars[i].length)] = var_hash_next[i];
+        int k = local_vars_count;
+        while (k > 0 && local_vars[k - 1] > varindex)
+            local_vars[--k]--;
+        if (k > 0 && local_vars[k - 1] == varindex) {
+            memmove(local_vars + k - 1, local_vars + k,
+                    (local_vars_count - k) * sizeof(int));
+            local_vars_count--;
+        }
+    }
+    for (int i = varindex; i < vars_count - 1; i++)
+        vars[i] = vars[i + 1];
+    vars_count--;
+    if (indexed)
+        for (int i = varindex; i < vars_count; i++)
+            link_var(i);
+}
+
 int lookup_var(const char *name, int namelength) {
     int i, j;
+    if (check_var_index()) {
+        for (i = var_hash[var_hash_code(name, namelength)]; i != -1; i = var_hash_next[i])
+            if (!vars[i].hidden && string_equals(vars[i].name, vars[i].length, name, namelength))
+                return i;
+        return -1;
+    }
     for (i = vars_count - 1; i >= 0; i--) {
         if (vars[i].hidden)
             continue;
@@ -385,6 +558,22 @@ int lookup_var(const char *name, int namelength) {
     return -1;
 }
 
+/* Finds the variable hidden by the local variable vars[varindex] */
+static int find_hidden_var(int varindex) {
+    const char *name = vars[varindex].name;
+    int namelength = vars[varindex].length;
+    if (check_var_index()) {
+        for (int i = var_hash_next[varindex]; i != -1; i = var_hash_next[i])
+            if (vars[i].hidden && string_equals(vars[i].name, vars[i].length, name, namelength))
+                return i;
+        return -1;
+    }
+    for (int i = varindex - 1; i >= 0; i--)
+        if (vars[i].hidden && string_equals(vars[i].name, vars[i].length, name, namelength))
+            return i;
+    return -1;
+}
+
 vartype *recall_var(const char *name, int namelength) {
     int varindex = lookup_var(name, namelength);
     if (varindex == -1)
@@ -393,6 +582,14 @@ vartype *recall_var(const char *name, int namelength) {
         return vars[varindex].value;
 }
 
+vartype *recall_regs() {
+    if (!regs_cache_valid) {
+        regs_cache = recall_var("REGS", 4);
+        regs_cache_valid = true;
+    }
+    return regs_cache;
+}
+
 bool ensure_var_space(int n) {
     int nc = vars_count + n;
     if (nc > vars_capacity) {
@@ -405,18 +602,26 @@ bool ensure_var_space(int n) {
     return true;
 }
 
+static bool grow_vars() {
+    if (vars_count < vars_capacity)
+        return true;
+    int nc = vars_capacity + 25;
+    if (nc < vars_capacity * 3 / 2)
+        nc = vars_capacity * 3 / 2;
+    var_struct *nv = (var_struct *) realloc(vars, nc * sizeof(var_struct));
+    if (nv == NULL)
+        return false;
+    vars_capacity = nc;
+    vars = nv;
+    return true;
+}
+
 int store_var(const char *name, int namelength, vartype *value, bool local) {
     int varindex = lookup_var(name, namelength);
     int i;
     if (varindex == -1) {
-        if (vars_count == vars_capacity) {
-            int nc = vars_capacity + 25;
-            var_struct *nv = (var_struct *) realloc(vars, nc * sizeof(var_struct));
-            if (nv == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            vars_capacity = nc;
-            vars = nv;
-        }
+        if (!grow_vars())
+            return ERR_INSUFFICIENT_MEMORY;
         varindex = vars_count++;
         vars[varindex].length = namelength;
         for (i = 0; i < namelength; i++)
@@ -424,15 +629,10 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
         vars[varindex].level = local ? get_rtn_level() : -1;
         vars[varindex].hidden = false;
         vars[varindex].hiding = false;
+        index_new_var();
     } else if (local && vars[varindex].level < get_rtn_level()) {
-        if (vars_count == vars_capacity) {
-            int nc = vars_capacity + 25;
-            var_struct *nv = (var_struct *) realloc(vars, nc * sizeof(var_struct));
-            if (nv == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            vars_capacity = nc;
-            vars = nv;
-        }
+        if (!grow_vars())
+            return ERR_INSUFFICIENT_MEMORY;
         vars[varindex].hidden = true;
         varindex = vars_count++;
         vars[varindex].length = namelength;
@@ -441,6 +641,7 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
         vars[varindex].level = get_rtn_level();
         vars[varindex].hidden = false;
         vars[varindex].hiding = true;
+        index_new_var();
         push_indexed_matrix(name, namelength);
     } else {
         if (matedit_mode == 1 &&
@@ -453,7 +654,10 @@ int store_var(const char *name, int namelength, vartype *value, bool local) {
         free_vartype(vars[varindex].value);
     }
     vars[varindex].value = value;
-    update_catalog();
+    if (string_equals(name, namelength, "REGS", 4))
+        regs_cache_valid = false;
+    bump_lookup_generation();
+    mark_catalog_dirty();
     return ERR_NONE;
 }
 
@@ -468,17 +672,110 @@ void purge_var(const char *name, int namelength) {
         matedit_mode = 0;
     free_vartype(vars[varindex].value);
     if (vars[varindex].hiding) {
-        for (int i = varindex - 1; i >= 0; i--)
-            if (vars[i].hidden && string_equals(vars[i].name, vars[i].length, name, namelength)) {
-                vars[i].hidden = false;
-                break;
-            }
+        int i = find_hidden_var(varindex);
+        if (i != -1)
+            vars[i].hidden = false;
         pop_indexed_matrix(name, namelength);
     }
-    for (int i = varindex; i < vars_count - 1; i++)
-        vars[i] = vars[i + 1];
-    vars_count--;
-    update_catalog();
+    remove_var(varindex);
+    // This may have been REGS, or uncovered a hidden one
+    if (string_equals(name, namelength, "REGS", 4))
+        regs_cache_valid = false;
+    bump_lookup_generation();
+    mark_catalog_dirty();
+}
+
+static void end_matedit_of_local(int varindex) {
+    if ((matedit_mode == 1 || matedit_mode == 3)
+            && string_equals(vars[varindex].name, vars[varindex].length, matedit_name, matedit_length)) {
+        if (matedit_mode == 3) {
+            set_appmenu_exitcallback(0);
+            set_menu(MENULEVEL_APP, MENU_NONE);
+        }
+        matedit_mode = 0;
+    }
+}
+
+/* Used when there isn't enough memory for the index */
+static void remove_locals_slow(int level) {
+    int last = -1;
+    for (int i = vars_count - 1; i >= 0; i--) {
+        if (vars[i].level == -1)
+            continue;
+        if (vars[i].level < level)
+            break;
+        end_matedit_of_local(i);
+        if (vars[i].hiding) {
+            int j = find_hidden_var(i);
+            if (j != -1)
+                vars[j].hidden = false;
+        }
+        free_vartype(vars[i].value);
+        vars[i].length = 100;
+        last = i;
+    }
+    if (last == -1)
+        return;
+    int from = last;
+    int to = last;
+    while (from < vars_count) {
+        if (vars[from].length != 100)
+            vars[to++] = vars[from];
+        from++;
+    }
+    vars_count = to;
+    regs_cache_valid = false;
+    bump_lookup_generation();
+    mark_catalog_dirty();
+}
+
+void remove_locals(int level) {
+    if (!check_var_index()) {
+        remove_locals_slow(level);
+        return;
+    }
+
+    int n = local_vars_count;
+    while (n > 0 && vars[local_vars[n - 1]].level >= level)
+        n--;
+    if (n == local_vars_count)
+        return;
+    int last = local_vars[n];
+
+    for (int k = local_vars_count - 1; k >= n; k--) {
+        int i = local_vars[k];
+        end_matedit_of_local(i);
+        if (vars[i].hiding) {
+            int j = find_hidden_var(i);
+            if (j != -1)
+                vars[j].hidden = false;
+        }
+    }
+
+    // Everything from 'last' up has the highest indexes in vars[], so it
+    // forms a prefix of each hash chain; unlink it, compact, and re-link the
+    // survivors, which can only be globals created after 'last'.
+    for (int i = vars_count - 1; i >= last; i--)
+        var_hash[var_hash_code(vars[i].name, vars[i].length)] = var_hash_next[i];
+    for (int k = n; k < local_vars_count; k++) {
+        int i = local_vars[k];
+        free_vartype(vars[i].value);
+        vars[i].length = 100;
+    }
+    local_vars_count = n;
+    int from = last;
+    int to = last;
+    while (from < vars_count) {
+        if (vars[from].length != 100)
+            vars[to++] = vars[from];
+        from++;
+    }
+    vars_count = to;
+    for (int i = last; i < vars_count; i++)
+        link_var(i);
+    regs_cache_valid = false;
+    bump_lookup_generation();
+    mark_catalog_dirty();
 }
 
 void purge_all_vars() {
@@ -486,6 +783,19 @@ void purge_all_vars() {
     for (i = 0; i < vars_count; i++)
         free_vartype(vars[i].value);
     vars_count = 0;
+    free(var_hash);
+    var_hash = NULL;
+    var_hash_size = 0;
+    free(var_hash_next);
+    var_hash_next = NULL;
+    var_hash_next_capacity = 0;
+    free(local_vars);
+    local_vars = NULL;
+    local_vars_count = 0;
+    local_vars_capacity = 0;
+    var_index_valid = false;
+    regs_cache_valid = false;
+    bump_lookup_generation();
 }
 
 int vars_exist(int real, int cpx, int matrix) {
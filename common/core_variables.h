@@ -32,10 +32,14 @@ vartype *dup_vartype(const vartype *v);
 int disentangle(vartype *v);
 int lookup_var(const char *name, int namelength);
 vartype *recall_var(const char *name, int namelength);
+/* Same as recall_var("REGS", 4), but cached */
+vartype *recall_regs();
 bool ensure_var_space(int n);
 int store_var(const char *name, int namelength, vartype *value, bool local = false);
 void purge_var(const char *name, int namelength);
+void remove_locals(int level);
 void purge_all_vars();
+void invalidate_var_index();
 int vars_exist(int real, int cpx, int matrix);
 int contains_no_strings(const vartype_realmatrix *rm);
 int matrix_copy(vartype *dst, const vartype *src);
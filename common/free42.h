@@ -32,6 +32,37 @@
 #define uint8 unsigned long long
 #define uint unsigned int
 
+/* All mutable core state is declared CORE_TLS, which makes it thread-local:
+ * every thread that calls core_init() gets a calculator of its own, so one
+ * process can host several independent calculators, one per thread. Where
+ * available, __thread is used rather than thread_local, since it compiles to
+ * plain segment-relative accesses, while thread_local variables that are
+ * shared between translation units are reached through wrapper functions;
+ * __thread only works for types without constructors, though, so variables
+ * that contain phloats, which are classes in BCD builds, use CORE_TLS_PHLOAT.
+ * Builds that only ever run one calculator can define FREE42_SINGLE_INSTANCE
+ * to make all this plain global data again.
+ */
+#if !defined(FREE42_SINGLE_INSTANCE) && (defined(ANDROID) || defined(IPHONE) \
+        || defined(WINDOWS) && !defined(__GNUC__))
+/* The mobile apps only ever run one calculator, and build the core into a
+ * shared library, where thread-local data is slower to get at; MSVC 2008
+ * doesn't support thread_local at all.
+ */
+#define FREE42_SINGLE_INSTANCE 1
+#endif
+
+#if defined(FREE42_SINGLE_INSTANCE)
+#define CORE_TLS
+#define CORE_TLS_PHLOAT
+#elif defined(__GNUC__)
+#define CORE_TLS __thread
+#define CORE_TLS_PHLOAT thread_local
+#else
+#define CORE_TLS thread_local
+#define CORE_TLS_PHLOAT thread_local
+#endif
+
 #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 /* I have tested big-endian state file compatibility in Fedora 12
  * running on qemu-system-ppc. I found that I needed to explicitly
@@ -153,7 +153,7 @@ typedef struct {
     int height;
 } gif_data;
 
-static gif_data *g;
+static CORE_TLS gif_data *g;
 
 
 int shell_start_gif(file_writer writer, int width, int provisional_height) {
@@ -0,0 +1,171 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Stack arithmetic microbenchmark. Times + - * / on real and complex stacks,
+// comparing the allocation-free scalar path in docmd_add() etc. with the
+// generic path, i.e. generic_add() etc. followed by binary_result(). It then
+// runs an arithmetic-heavy FOCAL loop through the interpreter.
+//
+// Usage: arithbench [operations [loop_iterations]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "shell.h"
+#include "core_commands1.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_sto_rcl.h"
+#include "core_variables.h"
+
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void fill_stack(bool complex) {
+    vartype **regs[] = { &reg_t, &reg_z, &reg_y, &reg_x, &reg_lastx };
+    for (int i = 0; i < 5; i++) {
+        free_vartype(*regs[i]);
+        *regs[i] = complex ? new_complex(1.5, 0.5) : new_real(1.5);
+    }
+}
+
+/* The generic path, as docmd_add() etc. used to do it */
+
+static void generic_completion(int error, vartype *res) {
+    if (error == ERR_NONE)
+        binary_result(res);
+}
+
+static int generic_op(int op) {
+    vartype *res;
+    int error;
+    switch (op) {
+        case 0:
+            error = generic_add(reg_x, reg_y, &res);
+            break;
+        case 1:
+            error = generic_sub(reg_x, reg_y, &res);
+            break;
+        case 2:
+            return generic_mul(reg_x, reg_y, generic_completion);
+        default:
+            return generic_div(reg_x, reg_y, generic_completion);
+    }
+    if (error == ERR_NONE)
+        binary_result(res);
+    return error;
+}
+
+static int fast_op(int op) {
+    switch (op) {
+        case 0: return docmd_add(NULL);
+        case 1: return docmd_sub(NULL);
+        case 2: return docmd_mul(NULL);
+        default: return docmd_div(NULL);
+    }
+}
+
+/* Each round is X+Y, X-Y, X*Y, X/Y with Y, Z, and T all 1.5, so the
+ * values stay bounded and the stack keeps refilling from T.
+ */
+static double time_ops(int (*op)(int), bool complex, int n) {
+    fill_stack(complex);
+    double t = now();
+    for (int i = 0; i < n; i++)
+        if (op(i & 3) != ERR_NONE) {
+            fprintf(stderr, "arithmetic error\n");
+            exit(1);
+        }
+    return now() - t;
+}
+
+static const char *loop_listing =
+    "01 LBL \"ARITH\"\n"
+    "02 STO 00\n"
+    "03 1.5\n"
+    "04 ENTER\n"
+    "05 ENTER\n"
+    "06 ENTER\n"
+    "07 LBL 01\n"
+    "08 2\n"
+    "09 \xc3\x97\n"
+    "10 3\n"
+    "11 +\n"
+    "12 4\n"
+    "13 -\n"
+    "14 2\n"
+    "15 \xc3\xb7\n"
+    "16 DSE 00\n"
+    "17 GTO 01\n"
+    "18 END\n";
+
+static double time_loop(int iterations) {
+    arg_struct arg;
+    int prgm, enqueued, repeat;
+    int4 lblpc;
+
+    arg.type = ARGTYPE_STR;
+    arg.length = 5;
+    memcpy(arg.val.text, "ARITH", 5);
+    if (!find_global_label(&arg, &prgm, &lblpc)) {
+        fprintf(stderr, "label not found\n");
+        exit(1);
+    }
+    vartype *v = new_real(iterations);
+    recall_result(v);
+    clear_all_rtns();
+    current_prgm = prgm;
+    pc = lblpc;
+    double t = now();
+    set_running(true);
+    while (core_keydown(0, &enqueued, &repeat));
+    return now() - t;
+}
+
+int main(int argc, char *argv[]) {
+    int nops = argc > 1 ? atoi(argv[1]) : 10000000;
+    int niter = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    core_init(0, 0, NULL, 0);
+
+    for (int c = 0; c < 2; c++) {
+        bool complex = c == 1;
+        double t_generic = time_ops(generic_op, complex, nops);
+        double t_fast = time_ops(fast_op, complex, nops);
+        printf("%s:  fast %7.2f ns/op, generic %7.2f ns/op, speedup %.2fx\n",
+                complex ? "complex" : "real   ",
+                t_fast * 1e9 / nops, t_generic * 1e9 / nops,
+                t_generic / t_fast);
+    }
+
+    flags.f.prgm_mode = true;
+    core_paste(loop_listing);
+    flags.f.prgm_mode = false;
+    double t = time_loop(niter);
+    printf("loop:     %d iterations, %.3f s, %.2f M arithmetic ops/s\n",
+            niter, t, niter * 4 / t / 1e6);
+
+    core_cleanup();
+    return 0;
+}
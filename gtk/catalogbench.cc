@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Catalog refresh benchmark. Runs a loop that calls a subroutine which
+// creates three local variables with LSTO, and so deletes them again when it
+// returns, first with no menu showing, and then with the REAL section of the
+// CATALOG menu showing. Every LSTO and every RTN changes what that catalog
+// should show; since the catalog is only brought up to date when the display
+// is redrawn (see mark_catalog_dirty()), and not once per change, the two
+// runs should take about equally long.
+//
+// Usage: catalogbench [loop_iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "shell.h"
+#include "core_display.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_variables.h"
+
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Shell override; the rest of the shell is in headless_shell.cc */
+
+uint4 shell_milliseconds() { return (uint4) (now() * 1000); }
+
+
+static const char *loop_listing =
+    "01 LBL \"CLOOP\"\n"
+    "02 STO 00\n"
+    "03 LBL 01\n"
+    "04 XEQ 02\n"
+    "05 DSE 00\n"
+    "06 GTO 01\n"
+    "07 RTN\n"
+    "08 LBL 02\n"
+    "09 1\n"
+    "10 LSTO \"A\"\n"
+    "11 2\n"
+    "12 LSTO \"B\"\n"
+    "13 3\n"
+    "14 LSTO \"C\"\n"
+    "15 END\n";
+
+static double time_loop(int iterations) {
+    int enqueued, repeat;
+    arg_struct arg;
+    int prgm;
+    int4 lblpc;
+    arg.type = ARGTYPE_STR;
+    arg.length = 5;
+    memcpy(arg.val.text, "CLOOP", 5);
+    if (!find_global_label(&arg, &prgm, &lblpc))
+        return 0;
+    recall_result(new_real(iterations));
+    clear_all_rtns();
+    current_prgm = prgm;
+    pc = lblpc;
+    set_running(true);
+    double t = now();
+    while (core_keydown(0, &enqueued, &repeat));
+    redisplay();
+    return now() - t;
+}
+
+int main(int argc, char *argv[]) {
+    int niter = argc > 1 ? atoi(argv[1]) : 200000;
+
+    core_init(0, 0, NULL, 0);
+
+    flags.f.prgm_mode = true;
+    core_paste(loop_listing);
+    flags.f.prgm_mode = false;
+    // A global, so that the REAL section isn't empty when the locals are gone
+    store_var("G", 1, new_real(0));
+
+    set_menu(MENULEVEL_PLAIN, MENU_NONE);
+    double t_hidden = time_loop(niter);
+    set_menu(MENULEVEL_PLAIN, MENU_CATALOG);
+    set_cat_section(CATSECT_REAL);
+    redisplay();
+    double t_shown = time_loop(niter);
+    bool still_shown = mode_plainmenu == MENU_CATALOG
+                        && get_cat_section() == CATSECT_REAL;
+
+    printf("LSTO loop:  no menu %7.3f s, CATALOG REAL %7.3f s, ratio %.2f%s\n",
+            t_hidden, t_shown, t_shown / t_hidden,
+            still_shown ? "" : " (catalog was closed!)");
+
+    core_cleanup();
+    return still_shown ? 0 : 1;
+}
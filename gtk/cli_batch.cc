@@ -0,0 +1,308 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "cli_batch.h"
+#include "core_commands1.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_variables.h"
+
+
+// The records that have been read but not yet written are kept in a ring of
+// slots, which is a few times bigger than the number of workers, so the
+// workers never have to wait for the reader, but a slow record can't make
+// the rest of the input pile up in memory. Records run for milliseconds at
+// least, so a single mutex for the whole pool costs nothing worth worrying
+// about.
+
+struct batch_slot {
+    batch_record rec;
+    batch_result res;
+    bool done;
+};
+
+struct batch_pool {
+    const batch_job *job;
+    batch_writer write;
+    void *data;
+    char **snapshots;           // state after loading the programs, per worker
+    bool loaded;
+    int nslots;
+    batch_slot *slots;
+    std::mutex lock;
+    std::condition_variable work;   // a record was read, or the input ended
+    std::condition_variable room;   // a slot was freed
+    // Records [0, nread) have been read, [0, nrun) have been taken by a
+    // worker, and [0, nwritten) have been written
+    int8 nread, nrun, nwritten;
+    bool eof;
+    bool writing;
+    bool ok;
+};
+
+static bool load_programs(const batch_job *job) {
+    for (int i = 0; i < job->nraw; i++) {
+        FILE *f = fopen(job->raw_files[i], "rb");
+        if (f == NULL)
+            return false;
+        fclose(f);
+        core_import_programs(0, job->raw_files[i]);
+    }
+    bool saved_prgm_mode = flags.f.prgm_mode;
+    flags.f.prgm_mode = true;
+    for (int i = 0; i < job->nlistings; i++)
+        core_paste(job->listings[i]);
+    flags.f.prgm_mode = saved_prgm_mode;
+    return true;
+}
+
+static void load_record(const batch_record *rec) {
+    // Variables first, since storing them goes through the stack
+    for (int i = 0; i < rec->nfields; i++) {
+        const char *field = rec->fields[i];
+        const char *eq = strchr(field, '=');
+        if (eq == NULL || eq == field || eq - field > 7)
+            continue;
+        core_paste(eq + 1);
+        vartype *v = dup_vartype(reg_x);
+        if (v != NULL && store_var(field, eq - field, v) != ERR_NONE)
+            free_vartype(v);
+    }
+
+    docmd_clst(NULL);
+    free_vartype(reg_lastx);
+    reg_lastx = new_real(0);
+    reg_alpha_length = 0;
+
+    for (int i = 0; i < rec->nfields; i++) {
+        const char *field = rec->fields[i];
+        const char *eq = strchr(field, '=');
+        if (eq == NULL || eq == field || eq - field > 7)
+            core_paste(field);
+    }
+}
+
+static char *format_reg(vartype *reg) {
+    // core_copy() formats X; point it at the register we want
+    vartype *saved_x = reg_x;
+    reg_x = reg;
+    char *text = core_copy();
+    reg_x = saved_x;
+    return text;
+}
+
+// Writes the results that are next in line, if they're there, and if no
+// other worker is writing them already. Called with the pool locked; the
+// lock is let go while write() runs.
+static void write_results(batch_pool *pool,
+                          std::unique_lock<std::mutex> &guard) {
+    if (pool->writing)
+        return;
+    pool->writing = true;
+    while (pool->nwritten < pool->nrun) {
+        batch_slot *slot = pool->slots + pool->nwritten % pool->nslots;
+        if (!slot->done)
+            break;
+        // The slot stays ours until nwritten moves past it
+        guard.unlock();
+        pool->write(pool->data, &slot->rec, &slot->res);
+        guard.lock();
+        pool->nwritten++;
+        pool->room.notify_one();
+    }
+    pool->writing = false;
+}
+
+static void worker(batch_pool *pool, int me) {
+    const batch_job *job = pool->job;
+    const char *snapshot = pool->snapshots[me];
+    bool fresh = false;
+    std::unique_lock<std::mutex> guard(pool->lock);
+    while (true) {
+        while (pool->nrun == pool->nread && !pool->eof)
+            pool->work.wait(guard);
+        if (pool->nrun == pool->nread)
+            break;
+        batch_slot *slot = pool->slots + pool->nrun++ % pool->nslots;
+        guard.unlock();
+
+        // Every record starts from the snapshot; the previous one may have
+        // changed anything
+        if (fresh)
+            core_cleanup();
+        core_init(1, 26, snapshot, 0);
+        fresh = true;
+        load_record(&slot->rec);
+        batch_result *res = &slot->res;
+        bool ran = pool->loaded && batch_run_label(job->label);
+        if (ran) {
+            vartype *regs[] = { reg_t, reg_z, reg_y, reg_x };
+            for (int j = 0; j < 4; j++)
+                res->stack[j] = format_reg(regs[j]);
+        } else {
+            for (int j = 0; j < 4; j++)
+                res->stack[j] = NULL;
+        }
+
+        guard.lock();
+        if (!ran)
+            pool->ok = false;
+        slot->done = true;
+        write_results(pool, guard);
+    }
+    guard.unlock();
+    if (fresh)
+        core_cleanup();
+}
+
+bool batch_run_label(const char *label) {
+    arg_struct arg;
+    int prgm;
+    int4 lblpc;
+    int enqueued, repeat;
+
+    int len = strlen(label);
+    if (len > 7)
+        return false;
+    arg.type = ARGTYPE_STR;
+    arg.length = len;
+    memcpy(arg.val.text, label, len);
+    if (!find_global_label(&arg, &prgm, &lblpc))
+        return false;
+
+    clear_all_rtns();
+    current_prgm = prgm;
+    pc = lblpc;
+    set_running(true);
+    while (true) {
+        if (core_keydown(0, &enqueued, &repeat))
+            continue;
+        // PSE: resume right away, rather than waiting for the timeout
+        if (mode_pause && core_timeout3(1))
+            continue;
+        break;
+    }
+    return true;
+}
+
+// Loads the program set in a calculator of its own, and saves the state to
+// a temporary file for each worker, which it starts every record from. Each
+// worker needs a file of its own, since core_init() renames the file while
+// it reads it. Returns false if the files can't be created.
+static bool make_snapshots(const batch_job *job, int n, char **names,
+                           bool *loaded) {
+    const char *dir = getenv("TMPDIR");
+    if (dir == NULL || dir[0] == 0)
+        dir = "/tmp";
+    int i;
+    for (i = 0; i < n; i++) {
+        names[i] = (char *) malloc(strlen(dir) + 20);
+        if (names[i] == NULL)
+            break;
+        sprintf(names[i], "%s/free42batchXXXXXX", dir);
+        int fd = mkstemp(names[i]);
+        if (fd == -1) {
+            free(names[i]);
+            break;
+        }
+        close(fd);
+    }
+    if (i < n) {
+        while (--i >= 0) {
+            remove(names[i]);
+            free(names[i]);
+        }
+        return false;
+    }
+
+    FILE *f;
+    if (job->state_file != NULL && (f = fopen(job->state_file, "rb")) != NULL) {
+        fclose(f);
+        core_init(1, 26, job->state_file, 0);
+    } else
+        core_init(0, 0, NULL, 0);
+    *loaded = load_programs(job);
+    for (i = 0; i < n; i++)
+        core_save_state(names[i]);
+    core_cleanup();
+    return true;
+}
+
+bool batch_run(const batch_job *job, batch_reader read, batch_writer write,
+               void *data) {
+    batch_pool pool;
+    pool.job = job;
+    pool.write = write;
+    pool.data = data;
+    int n = job->threads;
+    if (n <= 0)
+        n = std::thread::hardware_concurrency();
+    if (n <= 0)
+        n = 1;
+    pool.snapshots = new char *[n];
+    if (!make_snapshots(job, n, pool.snapshots, &pool.loaded)) {
+        delete[] pool.snapshots;
+        return false;
+    }
+    pool.nslots = 4 * n;
+    pool.slots = new batch_slot[pool.nslots];
+    pool.nread = pool.nrun = pool.nwritten = 0;
+    pool.eof = false;
+    pool.writing = false;
+    pool.ok = true;
+
+    std::thread *threads = new std::thread[n];
+    for (int i = 0; i < n; i++)
+        threads[i] = std::thread(worker, &pool, i);
+
+    while (true) {
+        batch_record rec;
+        bool more = read(data, &rec);
+        std::unique_lock<std::mutex> guard(pool.lock);
+        if (!more) {
+            pool.eof = true;
+            pool.work.notify_all();
+            break;
+        }
+        while (pool.nread - pool.nwritten == pool.nslots)
+            pool.room.wait(guard);
+        batch_slot *slot = pool.slots + pool.nread++ % pool.nslots;
+        slot->rec = rec;
+        slot->done = false;
+        pool.work.notify_one();
+    }
+
+    for (int i = 0; i < n; i++)
+        threads[i].join();
+    delete[] threads;
+    delete[] pool.slots;
+    for (int i = 0; i < n; i++) {
+        remove(pool.snapshots[i]);
+        free(pool.snapshots[i]);
+    }
+    delete[] pool.snapshots;
+    return pool.ok;
+}
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef CLI_BATCH_H
+#define CLI_BATCH_H 1
+
+// Batch evaluation: runs one global label on many input records, using a
+// pool of worker threads that each have a calculator of their own (the core
+// state is thread-local; see core_init()). The program set is loaded once,
+// and the resulting state is saved to temporary files; every record then
+// starts from that state, so the results don't depend on which worker ran
+// which records, or in what order. Records are read and handed out one at a
+// time, as workers become free, and the results are written in input order
+// as soon as they are all there, so the input can be a stream.
+//
+// The shell must not do anything in its callbacks that assumes a single
+// calculator; in particular, shell_print() may be called from any worker.
+
+// A program set, and the label to run
+typedef struct {
+    const char *state_file;     // core state to start from, or NULL
+    int nraw;
+    const char **raw_files;     // .raw files, for core_import_programs()
+    int nlistings;
+    const char **listings;      // program listings, as text, for core_paste()
+    const char *label;          // the global label to run on each record
+    int threads;                // number of workers; 0 means one per CPU
+} batch_job;
+
+// One input record. Each field of the form NAME=value is stored in the
+// named variable, and the other fields are pushed onto the stack, in order,
+// so the last one ends up in X. Values are parsed as by core_paste().
+// Before the fields are loaded, the stack, LASTX, and ALPHA are cleared;
+// everything else is as it was after the program set was loaded.
+typedef struct {
+    int nfields;
+    char **fields;
+} batch_record;
+
+// The result for one record: T, Z, Y, and X after the program stopped,
+// formatted as by core_copy(), or NULL if the record could not be run,
+// because the label doesn't exist, or the program set could not be loaded.
+// The strings are allocated with malloc().
+typedef struct {
+    char *stack[4];
+} batch_result;
+
+// Supplies the next record; returns false at the end of the input. Called
+// from the thread that called batch_run() only.
+typedef bool (*batch_reader)(void *data, batch_record *rec);
+
+// Takes the result for a record, in the order the records were read. The
+// record and the result are the writer's to free. Called from the workers,
+// but never from more than one at a time.
+typedef void (*batch_writer)(void *data, batch_record *rec, batch_result *res);
+
+// Runs job->label on every record that read() supplies, and passes each
+// result to write(). Returns false if any record could not be run.
+bool batch_run(const batch_job *job, batch_reader read, batch_writer write,
+               void *data);
+
+// Runs a global label in the calling thread's calculator until the program
+// stops; PSE is resumed right away. Returns false if the label doesn't exist.
+bool batch_run_label(const char *label);
+
+#endif
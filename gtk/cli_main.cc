@@ -0,0 +1,433 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Headless command-line runner. Links the emulator core against a minimal
+// shell that has no display, keyboard, or event loop, so programs run at full
+// speed; meant for batch jobs and CI.
+//
+// Usage: free42cli [options] [label [value ...]]
+//        free42cli [options] -b [-j threads] label
+//
+//   -s file   Load core state from 'file' (a Free42 .f42 state file)
+//   -w file   Save core state to 'file' when done
+//   -r file   Import programs from a raw (.raw) file; may be repeated
+//   -l file   Import programs from a text listing; may be repeated
+//   -p        Enable printing; printer output goes to standard output
+//   -a        Print the whole stack (T, Z, Y, X), not just X
+//   -P        Profile the program, and write a report to standard error
+//   -A        Profile the program, and write an annotated listing to
+//             standard error
+//   -b        Batch mode: read input records from standard input, one per
+//             line, run the label on each, and print one line per record
+//   -j n      Number of threads to use in batch mode; the default is one
+//             per CPU
+//   -t file   Replay a session recorded through shell_trace.h, as fast
+//             as possible, and report how long it took and whether it ended in
+//             the same state; all other options are ignored
+//
+// The values are pushed onto the stack in the order given, using the same
+// parsing as Paste, so the last one ends up in X. Then the global label is
+// executed, and when the program stops, X (or the stack) is printed.
+// Without a label, the values are pushed and the stack is printed right away.
+//
+// In batch mode, each input line is a record of whitespace-separated fields:
+// NAME=value stores the value in the variable NAME, and any other field is
+// pushed onto the stack, as above. The output has one line per record, in
+// input order: X, or T, Z, Y, and X separated by tabs with -a. Printer output
+// is discarded, and -w, -P, and -A are ignored. See cli_batch.h for details.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "shell.h"
+#include "cli_batch.h"
+#include "core_main.h"
+#include "core_globals.h"
+#include "shell_spool.h"
+#include "shell_trace.h"
+
+
+static bool batch_mode = false;
+
+/* Shell interface; the parts that do nothing here are in headless_shell.cc */
+
+const char *shell_platform() {
+    return VERSION " " VERSION_PLATFORM " CLI";
+}
+
+int shell_wants_cpu() {
+    if (trace_active())
+        return trace_wants_cpu();
+    // Nothing else to do; never interrupt a running program
+    return 0;
+}
+
+uint4 shell_get_mem() {
+    FILE *meminfo = fopen("/proc/meminfo", "r");
+    char line[1024];
+    uint4 bytes = 0;
+    if (meminfo == NULL)
+        return 0;
+    while (fgets(line, 1024, meminfo) != NULL) {
+        if (strncmp(line, "MemFree:", 8) == 0) {
+            unsigned int kbytes;
+            if (sscanf(line + 8, "%u", &kbytes) == 1)
+                bytes = 1024 * kbytes;
+            break;
+        }
+    }
+    fclose(meminfo);
+    return bytes;
+}
+
+int8 shell_random_seed() {
+    if (trace_active())
+        return trace_random_seed();
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+uint4 shell_milliseconds() {
+    if (trace_active())
+        return trace_milliseconds();
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint4) (ts.tv_sec * 1000L + ts.tv_nsec / 1000000);
+}
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {
+    if (batch_mode)
+        // Called from the worker threads; the output would be a jumble
+        return;
+    if (trace_active())
+        // Replaying; the output would swamp the report
+        return;
+    char buf[1024];
+    int len = hp2ascii(buf, text, length < 200 ? length : 200);
+    fwrite(buf, 1, len, stdout);
+    fputc('\n', stdout);
+}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    if (trace_active()) {
+        trace_time_date(time, date, weekday);
+        return;
+    }
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    struct tm tms;
+    localtime_r(&tv.tv_sec, &tms);
+    if (time != NULL)
+        *time = ((tms.tm_hour * 100 + tms.tm_min) * 100 + tms.tm_sec) * 100 + tv.tv_usec / 10000;
+    if (date != NULL)
+        *date = ((tms.tm_year + 1900) * 100 + tms.tm_mon + 1) * 100 + tms.tm_mday;
+    if (weekday != NULL)
+        *weekday = tms.tm_wday;
+}
+
+
+/* Runner */
+
+static void usage() {
+    fprintf(stderr, "Usage: free42cli [-s state] [-w state] [-r file.raw] [-l listing.txt]\n"
+                    "                 [-p] [-a] [-P] [-A] [label [value ...]]\n"
+                    "       free42cli [-s state] [-r file.raw] [-l listing.txt] [-a]\n"
+                    "                 -b [-j threads] label\n"
+                    "       free42cli -t trace\n");
+    exit(2);
+}
+
+static char *read_file(const char *name) {
+    FILE *f = fopen(name, "rb");
+    if (f == NULL)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = (char *) malloc(size + 1);
+    if (buf == NULL || fread(buf, 1, size, f) != (size_t) size) {
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+    buf[size] = 0;
+    fclose(f);
+    return buf;
+}
+
+static bool file_exists(const char *name) {
+    FILE *f = fopen(name, "r");
+    if (f == NULL)
+        return false;
+    fclose(f);
+    return true;
+}
+
+static void print_reg(const char *name, vartype *reg) {
+    // core_copy() formats X; point it at the register we want
+    vartype *saved_x = reg_x;
+    reg_x = reg;
+    char *text = core_copy();
+    reg_x = saved_x;
+    if (name != NULL)
+        printf("%s: ", name);
+    printf("%s\n", text == NULL ? "" : text);
+    free(text);
+}
+
+// Reads one line of standard input, and splits it into a record. The fields
+// are copied into the same block as the array that points to them, so
+// freeing rec->fields frees the lot.
+static bool read_record(void *data, batch_record *rec) {
+    static char *line = NULL;
+    static size_t cap = 0;
+    ssize_t len = getline(&line, &cap, stdin);
+    if (len == -1) {
+        free(line);
+        line = NULL;
+        cap = 0;
+        return false;
+    }
+    int nfields = 0;
+    char *tok, *save;
+    for (tok = strtok_r(line, " \t\r\n", &save); tok != NULL;
+            tok = strtok_r(NULL, " \t\r\n", &save))
+        nfields++;
+    // strtok_r() left a 0 after each field; copy the whole line
+    char **fields = (char **) malloc(nfields * sizeof(char *) + len + 1);
+    char *text = (char *) (fields + nfields);
+    memcpy(text, line, len + 1);
+    char *p = text;
+    for (int i = 0; i < nfields; i++) {
+        while (*p == 0 || strchr(" \t\r\n", *p) != NULL)
+            p++;
+        fields[i] = p;
+        p += strlen(p);
+    }
+    rec->nfields = nfields;
+    rec->fields = fields;
+    return true;
+}
+
+// Prints X, or the whole stack, for one record, as soon as it's done, so
+// the output can be consumed as a stream too.
+static void write_result(void *data, batch_record *rec, batch_result *res) {
+    bool print_stack = *(bool *) data;
+    for (int j = print_stack ? 0 : 3; j < 4; j++) {
+        const char *text = res->stack[j];
+        printf("%s%c", text == NULL ? "" : text, j == 3 ? '\n' : '\t');
+        free(res->stack[j]);
+    }
+    fflush(stdout);
+    free(rec->fields);
+}
+
+static int run_batch(int argc, char *argv[], int first_arg,
+                     const char *state_in, int threads, bool print_stack) {
+    if (first_arg != argc - 1)
+        usage();
+    int nopts = first_arg;
+    const char **raw_files = (const char **) malloc(nopts * sizeof(char *));
+    const char **listings = (const char **) malloc(nopts * sizeof(char *));
+    batch_job job;
+    job.state_file = state_in;
+    job.nraw = 0;
+    job.raw_files = raw_files;
+    job.nlistings = 0;
+    job.listings = listings;
+    job.label = argv[first_arg];
+    job.threads = threads;
+    int ret = 0;
+
+    for (int i = 1; i < first_arg; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            i++;
+            if (!file_exists(argv[i])) {
+                fprintf(stderr, "Can't open \"%s\"\n", argv[i]);
+                ret = 1;
+                goto done;
+            }
+            raw_files[job.nraw++] = argv[i];
+        } else if (strcmp(argv[i], "-l") == 0) {
+            i++;
+            char *text = read_file(argv[i]);
+            if (text == NULL) {
+                fprintf(stderr, "Can't read \"%s\"\n", argv[i]);
+                ret = 1;
+                goto done;
+            }
+            listings[job.nlistings++] = text;
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-w") == 0
+                || strcmp(argv[i], "-j") == 0)
+            i++;
+    }
+
+    batch_mode = true;
+    if (!batch_run(&job, read_record, write_result, &print_stack)) {
+        fprintf(stderr, "Label \"%s\" not found\n", job.label);
+        ret = 1;
+    }
+
+    done:
+    for (int i = 0; i < job.nlistings; i++)
+        free((char *) listings[i]);
+    free(listings);
+    free(raw_files);
+    return ret;
+}
+
+static int run_replay(const char *trace) {
+    trace_stats stats;
+    if (!trace_replay(trace, &stats))
+        return 1;
+    printf("events:   %d\n", stats.events);
+    printf("time:     %.3f s\n", stats.seconds);
+    printf("latency:  p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+            stats.p50, stats.p90, stats.p99, stats.max);
+    if (stats.checksum == stats.recorded_checksum) {
+        printf("checksum: %016llx (same as recorded)\n",
+                (unsigned long long) stats.checksum);
+        return 0;
+    } else {
+        printf("checksum: %016llx (recorded: %016llx)\n",
+                (unsigned long long) stats.checksum,
+                (unsigned long long) stats.recorded_checksum);
+        return 1;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *state_in = NULL;
+    const char *state_out = NULL;
+    bool print_stack = false;
+    bool printer = false;
+    bool batch = false;
+    int threads = 0;
+    int profile = -1;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != 0; i++) {
+        const char *opt = argv[i];
+        if (strcmp(opt, "-a") == 0)
+            print_stack = true;
+        else if (strcmp(opt, "-p") == 0)
+            printer = true;
+        else if (strcmp(opt, "-P") == 0)
+            profile = 0;
+        else if (strcmp(opt, "-A") == 0)
+            profile = 1;
+        else if (strcmp(opt, "-b") == 0)
+            batch = true;
+        else if (strcmp(opt, "-j") == 0) {
+            if (++i == argc)
+                usage();
+            threads = atoi(argv[i]);
+        } else if (strcmp(opt, "-t") == 0) {
+            if (++i == argc)
+                usage();
+            return run_replay(argv[i]);
+        } else if (strcmp(opt, "-s") == 0 || strcmp(opt, "-w") == 0
+                || strcmp(opt, "-r") == 0 || strcmp(opt, "-l") == 0) {
+            if (++i == argc)
+                usage();
+            if (opt[1] == 's')
+                state_in = argv[i];
+            else if (opt[1] == 'w')
+                state_out = argv[i];
+        } else
+            usage();
+    }
+    int first_arg = i;
+
+    if (batch)
+        return run_batch(argc, argv, first_arg, state_in, threads, print_stack);
+
+    if (state_in != NULL && file_exists(state_in))
+        core_init(1, 26, state_in, 0);
+    else
+        core_init(0, 0, NULL, 0);
+    if (printer) {
+        // PRON, and flag 21 so running programs print too
+        flags.f.printer_exists = 1;
+        flags.f.printer_enable = 1;
+    }
+
+    // Second pass over the options, now that the core is up
+    for (i = 1; i < first_arg; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            i++;
+            if (!file_exists(argv[i])) {
+                fprintf(stderr, "Can't open \"%s\"\n", argv[i]);
+                return 1;
+            }
+            core_import_programs(0, argv[i]);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            i++;
+            char *text = read_file(argv[i]);
+            if (text == NULL) {
+                fprintf(stderr, "Can't read \"%s\"\n", argv[i]);
+                return 1;
+            }
+            bool saved_prgm_mode = flags.f.prgm_mode;
+            flags.f.prgm_mode = true;
+            core_paste(text);
+            flags.f.prgm_mode = saved_prgm_mode;
+            free(text);
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-w") == 0
+                || strcmp(argv[i], "-j") == 0)
+            i++;
+    }
+
+    const char *label = first_arg < argc ? argv[first_arg] : NULL;
+    for (i = first_arg + 1; i < argc; i++)
+        core_paste(argv[i]);
+
+    int ret = 0;
+    if (profile != -1)
+        core_profile(1);
+    if (label != NULL && !batch_run_label(label)) {
+        fprintf(stderr, "Label \"%s\" not found\n", label);
+        ret = 1;
+    }
+    if (profile != -1) {
+        core_profile(0);
+        char *report = core_profile_report(profile);
+        if (report != NULL) {
+            fputs(report, stderr);
+            free(report);
+        }
+    }
+
+    if (print_stack || label == NULL) {
+        print_reg("T", reg_t);
+        print_reg("Z", reg_z);
+        print_reg("Y", reg_y);
+        print_reg("X", reg_x);
+    } else
+        print_reg(NULL, reg_x);
+
+    if (state_out != NULL)
+        core_save_state(state_out);
+    core_cleanup();
+    return ret;
+}
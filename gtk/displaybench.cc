@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Display refresh benchmark. Calls redisplay() repeatedly with the same
+// stack, in a few display modes, with and without a menu, and with a complex
+// number in X; and once more with a new number in X every time, which is the
+// worst case for the phloat2string() cache. Reports the time per redisplay,
+// the cache's hit and miss counts, and a checksum of everything that was sent
+// to shell_blitter(), which depends only on the number mode, so it can be
+// compared between builds.
+//
+// Usage: displaybench [redisplays]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "shell.h"
+#include "core_display.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_variables.h"
+
+
+static uint4 checksum;
+
+/* Shell override; shell_blitter() accumulates the checksum. The rest of the
+ * shell is in headless_shell.cc. */
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                   int width, int height) {
+    // FNV-1a over the whole display, since the dirty rectangle is in pixels
+    for (int i = 0; i < bytesperline * 16; i++)
+        checksum = (checksum ^ (unsigned char) bits[i]) * 16777619U;
+}
+
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// dispmode: 0=FIX, 1=SCI, 2=ENG, 3=ALL
+static void set_display_mode(int dispmode, int digits) {
+    flags.f.fix_or_all = dispmode == 0 || dispmode == 3;
+    flags.f.eng_or_all = dispmode == 2 || dispmode == 3;
+    flags.f.digits_bit3 = (digits & 8) != 0;
+    flags.f.digits_bit2 = (digits & 4) != 0;
+    flags.f.digits_bit1 = (digits & 2) != 0;
+    flags.f.digits_bit0 = (digits & 1) != 0;
+}
+
+static void set_reg(vartype **reg, vartype *v) {
+    free_vartype(*reg);
+    *reg = v;
+}
+
+static void bench(const char *name, int n, bool changing_x) {
+    uint4 hits, misses;
+    phloat2string_stats(&hits, &misses, true);
+    checksum = 2166136261U;
+    double t = now();
+    for (int i = 0; i < n; i++) {
+        if (changing_x)
+            set_reg(&reg_x, new_real(phloat(i) / 7));
+        redisplay();
+    }
+    t = now() - t;
+    phloat2string_stats(&hits, &misses, true);
+    printf("%-22s %9.1f ns/redisplay  hits %8u  misses %8u  checksum %08x\n",
+            name, t * 1e9 / n, hits, misses, checksum);
+}
+
+int main(int argc, char *argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 100000;
+
+    core_init(0, 0, NULL, 0);
+    // core_init() may have left a message up, which redisplay() keeps
+    flags.f.message = false;
+    flags.f.two_line_message = false;
+    set_reg(&reg_y, new_real(phloat(-22) / 7));
+    set_reg(&reg_x, new_real(phloat(1234567) / 9));
+
+    set_menu(MENULEVEL_PLAIN, MENU_NONE);
+    set_display_mode(0, 4);
+    bench("FIX 4", n, false);
+    set_display_mode(1, 6);
+    bench("SCI 6", n, false);
+    set_display_mode(2, 3);
+    bench("ENG 3", n, false);
+    set_display_mode(3, 0);
+    flags.f.thousands_separators = true;
+    bench("ALL, separators", n, false);
+    flags.f.thousands_separators = false;
+    set_display_mode(0, 4);
+    set_menu(MENULEVEL_PLAIN, MENU_TOP_FCN);
+    bench("FIX 4, menu", n, false);
+    set_menu(MENULEVEL_PLAIN, MENU_NONE);
+    set_reg(&reg_x, new_complex(phloat(1) / 3, phloat(-2) / 3));
+    bench("FIX 4, complex X", n, false);
+    bench("FIX 4, changing X", n, true);
+
+    core_cleanup();
+    return 0;
+}
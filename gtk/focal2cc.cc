@@ -0,0 +1,432 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Ahead-of-time translator from calculator programs to C++; see
+// core_native.h. The programs are loaded into a calculator, the same way
+// free42cli loads them, and every program that has a global label is
+// translated line by line, as decoded by get_next_command(): each line
+// becomes a direct call to its command's handler, and each GTO to a local
+// label becomes a jump. The generated module defines a function that
+// registers the compiled programs with core_register_native(); link it,
+// call that function before core_init(), and the compiled versions are used
+// whenever programs with exactly the same text are run.
+//
+// The names of the handlers are taken from cmd_array in core_tables.cc,
+// which is checked against the command table linked into this program, so
+// the two can't get out of step.
+//
+// Usage: focal2cc [-t core_tables.cc] [-n name] -o output.cc
+//                 [-s state] [-r file.raw] [-l listing.txt] ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shell.h"
+#include "shell_spool.h"
+#include "core_display.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_native.h"
+
+
+static void usage() {
+    fprintf(stderr, "Usage: focal2cc [-t core_tables.cc] [-n name] -o output.cc\n"
+                    "                [-s state] [-r file.raw] [-l listing.txt] ...\n");
+    exit(2);
+}
+
+static char *read_file(const char *name) {
+    FILE *f = fopen(name, "rb");
+    if (f == NULL)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = (char *) malloc(size + 1);
+    if (buf == NULL || fread(buf, 1, size, f) != (size_t) size) {
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+    buf[size] = 0;
+    fclose(f);
+    return buf;
+}
+
+
+/* Handler names */
+
+static char *handlers[CMD_SENTINEL];
+
+// Parses a C string literal starting at the opening quote, storing its
+// contents in 'buf', and returns a pointer past the closing quote, or NULL.
+static const char *parse_string(const char *p, char *buf, int *len) {
+    *len = 0;
+    p++;
+    while (*p != '"') {
+        int c;
+        if (*p == 0 || *p == '\n')
+            return NULL;
+        if (*p == '\\') {
+            p++;
+            if (*p >= '0' && *p <= '7') {
+                c = 0;
+                for (int i = 0; i < 3 && *p >= '0' && *p <= '7'; i++)
+                    c = c * 8 + *p++ - '0';
+            } else if (*p == 'n') {
+                c = '\n';
+                p++;
+            } else
+                c = *p++;
+        } else
+            c = (unsigned char) *p++;
+        if (*len < 12)
+            buf[*len] = (char) c;
+        ++*len;
+    }
+    return p + 1;
+}
+
+static char *copy_word(const char *p, const char **end) {
+    while (*p == ' ' || *p == '\t')
+        p++;
+    const char *q = p;
+    while (*q == '_' || *q >= 'a' && *q <= 'z' || *q >= 'A' && *q <= 'Z'
+            || *q >= '0' && *q <= '9')
+        q++;
+    if (end != NULL)
+        *end = q;
+    char *w = (char *) malloc(q - p + 1);
+    memcpy(w, p, q - p);
+    w[q - p] = 0;
+    return w;
+}
+
+// Reads the handler names from cmd_array. Each entry is on a line of its
+// own, as { /* ID */ "name", length, handler, ... }; the names are checked
+// against cmdlist(), and the docmd_xxx aliases #defined before the table are
+// applied, as they would be by the preprocessor on this platform.
+static bool read_handlers(const char *file_name) {
+    char *text = read_file(file_name);
+    if (text == NULL) {
+        fprintf(stderr, "Can't read \"%s\"\n", file_name);
+        return false;
+    }
+    const int max_aliases = 16;
+    char *alias_from[max_aliases], *alias_to[max_aliases];
+    int naliases = 0;
+    int n = 0;
+    bool in_table = false;
+    bool ok = true;
+    for (char *line = strtok(text, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        const char *p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (!in_table) {
+            if (strncmp(p, "#define docmd_", 14) == 0 && naliases < max_aliases) {
+                const char *q;
+                alias_from[naliases] = copy_word(p + 8, &q);
+                alias_to[naliases++] = copy_word(q, NULL);
+            } else if (strstr(p, "cmd_array[]") != NULL)
+                in_table = true;
+            continue;
+        }
+        if (*p == '}')
+            break;
+        if (*p != '{' || strstr(p, "/*") == NULL)
+            continue;
+        p = strchr(p, '"');
+        char name[12];
+        int len;
+        if (p == NULL || (p = parse_string(p, name, &len)) == NULL
+                || (p = strchr(p, ',')) == NULL
+                || (p = strchr(p + 1, ',')) == NULL) {
+            fprintf(stderr, "%s: can't parse \"%s\"\n", file_name, line);
+            ok = false;
+            break;
+        }
+        if (n == CMD_SENTINEL) {
+            n++;
+            break;
+        }
+        const command_spec *cs = cmdlist(n);
+        if (len != cs->name_length || memcmp(name, cs->name, len) != 0) {
+            fprintf(stderr, "%s: entry %d doesn't match the command table\n",
+                    file_name, n);
+            ok = false;
+            break;
+        }
+        char *h = copy_word(p + 1, NULL);
+        for (int i = 0; i < naliases; i++)
+            if (strcmp(h, alias_from[i]) == 0) {
+                free(h);
+                h = strdup(alias_to[i]);
+                break;
+            }
+        handlers[n++] = h;
+    }
+    if (ok && n != CMD_SENTINEL) {
+        fprintf(stderr, "%s: found %d commands, expected %d\n",
+                file_name, n, CMD_SENTINEL);
+        ok = false;
+    }
+    for (int i = 0; i < naliases; i++) {
+        free(alias_from[i]);
+        free(alias_to[i]);
+    }
+    free(text);
+    return ok;
+}
+
+
+/* Code generation */
+
+typedef struct {
+    int4 pc;
+    int4 next_pc;
+    int cmd;
+    arg_struct arg;
+    int4 target;        // local GTO target, or -1
+} line_info;
+
+// Writes the line as it would appear in a listing, as a comment
+static void write_line_comment(FILE *out, int lineno, int cmd,
+                               const arg_struct *arg) {
+    char buf[100], text[500];
+    int len;
+    if (cmd == CMD_NUMBER) {
+        strcpy(buf, phloat2program(arg->val_d));
+        len = (int) strlen(buf);
+    } else if (cmd == CMD_STRING) {
+        buf[0] = '"';
+        memcpy(buf + 1, arg->val.text, arg->length);
+        buf[arg->length + 1] = '"';
+        len = arg->length + 2;
+    } else
+        len = command2buf(buf, 100, cmd, arg);
+    len = hp2ascii(text, buf, len);
+    text[len] = 0;
+    fprintf(out, "    // %02d ", lineno);
+    for (char *p = text; *p != 0; p++)
+        // No line breaks, line splices, or trigraphs
+        if ((unsigned char) *p < 32 || *p == '\\' || *p == '?' && p[1] == '?')
+            fputc('.', out);
+        else
+            fputc(*p, out);
+    fputc('\n', out);
+}
+
+static void write_prgm(FILE *out, int prgm_index) {
+    prgm_struct *prgm = prgms + prgm_index;
+    int4 size = prgm->size;
+
+    fprintf(out, "static const unsigned char text_%d[] = {", prgm_index);
+    for (int4 i = 0; i < size; i++)
+        fprintf(out, "%s0x%02x,", i % 12 == 0 ? "\n    " : " ", prgm->text[i]);
+    fprintf(out, "\n};\n\n");
+
+    int nlines = 0;
+    int4 p2 = 0;
+    while (p2 < size) {
+        p2 += get_command_length(prgm_index, p2);
+        nlines++;
+    }
+    line_info *lines = (line_info *) malloc(nlines * sizeof(line_info));
+    int saved_prgm = current_prgm;
+    int4 saved_pc = pc;
+    current_prgm = prgm_index;
+    p2 = 0;
+    for (int i = 0; i < nlines; i++) {
+        line_info *li = lines + i;
+        li->pc = p2;
+        get_next_command(&p2, &li->cmd, &li->arg, 0);
+        li->next_pc = p2;
+        li->target = -1;
+        if (li->cmd == CMD_GTO && (li->arg.type == ARGTYPE_NUM
+                                   || li->arg.type == ARGTYPE_LCLBL
+                                   || li->arg.type == ARGTYPE_STK)) {
+            // Searching from the next line, as docmd_gto() does
+            pc = p2;
+            li->target = find_local_label(&li->arg);
+        }
+    }
+    current_prgm = saved_prgm;
+    pc = saved_pc;
+
+    fprintf(out, "static int run_%d(decoded_cmd_struct *decoded, int4 *line_pc,\n"
+                 "                 int max_lines, int *lines) {\n"
+                 "    int prgm = current_prgm;\n"
+                 "    arg_struct arg;\n"
+                 "    int error;\n"
+                 "    *lines = 0;\n"
+                 "    switch (pc) {\n", prgm_index);
+    for (int i = 0; i < nlines; i++)
+        fprintf(out, "        case %d: goto L%d;\n", lines[i].pc, lines[i].pc);
+    fprintf(out, "        default: return NATIVE_MISS;\n"
+                 "    }\n");
+
+    for (int i = 0; i < nlines; i++) {
+        line_info *li = lines + i;
+        fprintf(out, "\n    L%d:\n", li->pc);
+        write_line_comment(out, i + 1, li->cmd, &li->arg);
+        if (li->target >= 0) {
+            fprintf(out, "    NATIVE_GTO(%d);\n"
+                         "    NATIVE_DONE(%d);\n"
+                         "    goto L%d;\n", li->target, li->target, li->target);
+            continue;
+        }
+        bool has_target = li->cmd == CMD_GTO || li->cmd == CMD_XEQ;
+        fprintf(out, "    NATIVE_LINE%s(%d, %d);\n"
+                     "    error = %s(&arg);\n"
+                     "    NATIVE_DONE(%d);\n",
+                has_target ? "_TARGET" : "", i, li->next_pc,
+                handlers[li->cmd], li->next_pc);
+        if (i + 1 == nlines)
+            fprintf(out, "    return error;\n");
+        else if (lines[i + 1].cmd != CMD_END)
+            // Failed test: skip the next line, as handle_error() does
+            fprintf(out, "    NATIVE_SKIP(%d);\n", lines[i + 1].next_pc);
+    }
+    fprintf(out, "}\n\n");
+    free(lines);
+}
+
+static void write_label_name(FILE *out, const label_struct *lbl) {
+    char text[100];
+    int len = hp2ascii(text, lbl->name, lbl->length);
+    fputc('"', out);
+    for (int i = 0; i < len; i++) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\' || c == '?')
+            fprintf(out, "\\%c", c);
+        else if (c < 32 || c > 126)
+            fprintf(out, "\\%03o", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static bool write_module(const char *file_name, const char *name) {
+    FILE *out = fopen(file_name, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Can't write \"%s\"\n", file_name);
+        return false;
+    }
+    fprintf(out, "// Generated by focal2cc; do not edit.\n\n"
+                 "#include \"core_native.h\"\n\n");
+    int *first_label = (int *) malloc(prgms_count * sizeof(int));
+    for (int i = 0; i < prgms_count; i++)
+        first_label[i] = -1;
+    for (int i = 0; i < labels_count; i++)
+        if (labels[i].length > 0 && first_label[labels[i].prgm] == -1)
+            first_label[labels[i].prgm] = i;
+    int count = 0;
+    for (int i = 0; i < prgms_count; i++)
+        if (first_label[i] != -1) {
+            write_prgm(out, i);
+            count++;
+        }
+    fprintf(out, "static const native_prgm_struct table[] = {\n");
+    for (int i = 0; i < prgms_count; i++) {
+        if (first_label[i] == -1)
+            continue;
+        fprintf(out, "    { ");
+        write_label_name(out, labels + first_label[i]);
+        fprintf(out, ", %d, 0x%08xU, text_%d, run_%d },\n",
+                prgms[i].size, program_hash(i), i, i);
+    }
+    if (count == 0)
+        fprintf(out, "    { NULL, 0, 0, NULL, NULL }\n");
+    fprintf(out, "};\n\n"
+                 "void register_%s() {\n"
+                 "    core_register_native(table, %d);\n"
+                 "}\n", name, count);
+    free(first_label);
+    bool ok = !ferror(out);
+    if (fclose(out) != 0)
+        ok = false;
+    if (!ok)
+        fprintf(stderr, "Error writing \"%s\"\n", file_name);
+    return ok;
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *tables = "core_tables.cc";
+    const char *name = "native";
+    const char *output = NULL;
+    const char *state = NULL;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' || argv[i][1] == 0 || argv[i][2] != 0
+                || i + 1 == argc)
+            usage();
+        char opt = argv[i++][1];
+        if (opt == 't')
+            tables = argv[i];
+        else if (opt == 'n')
+            name = argv[i];
+        else if (opt == 'o')
+            output = argv[i];
+        else if (opt == 's')
+            state = argv[i];
+        else if (opt != 'r' && opt != 'l')
+            usage();
+    }
+    if (output == NULL)
+        usage();
+
+    if (state != NULL)
+        core_init(1, 26, state, 0);
+    else
+        core_init(0, 0, NULL, 0);
+    if (!read_handlers(tables))
+        return 1;
+
+    // Second pass over the options, now that the core is up
+    for (i = 1; i < argc; i += 2) {
+        if (strcmp(argv[i], "-r") == 0) {
+            FILE *f = fopen(argv[i + 1], "rb");
+            if (f == NULL) {
+                fprintf(stderr, "Can't open \"%s\"\n", argv[i + 1]);
+                return 1;
+            }
+            fclose(f);
+            core_import_programs(0, argv[i + 1]);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            char *text = read_file(argv[i + 1]);
+            if (text == NULL) {
+                fprintf(stderr, "Can't read \"%s\"\n", argv[i + 1]);
+                return 1;
+            }
+            flags.f.prgm_mode = true;
+            core_paste(text);
+            flags.f.prgm_mode = false;
+            free(text);
+        }
+    }
+
+    bool ok = write_module(output, name);
+    core_cleanup();
+    if (!ok)
+        remove(output);
+    return ok ? 0 : 1;
+}
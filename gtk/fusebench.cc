@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Superinstruction benchmark. Runs loop-heavy programs with and without
+// instruction fusion (core_settings.no_fusion), and compares their speed:
+// first a synthetic loop built from ISG/GTO, RCL/arithmetic, STO+, and
+// X<Y?/GTO idioms, then ComplexTest from util/ComplexTest.raw. The latter
+// takes far too long to run to completion, so it is run for a fixed amount of
+// time, and its progress is read from the loop counters in R00-R02.
+//
+// Usage: fusebench [loop_iterations [ComplexTest.raw [seconds]]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "shell.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_variables.h"
+
+
+static double deadline = 0;
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Shell overrides; shell_wants_cpu() is what ends the timed ComplexTest
+ * runs. The rest of the shell is in headless_shell.cc. */
+
+int shell_wants_cpu() { return deadline != 0 && now() >= deadline; }
+uint4 shell_milliseconds() { return (uint4) (now() * 1000); }
+
+
+static const char *loop_listing =
+    "01 LBL \"FLOOP\"\n"
+    "02 STO 00\n"
+    "03 CLX\n"
+    "04 STO 01\n"
+    "05 STO 02\n"
+    "06 LBL 01\n"
+    "07 RCL 00\n"
+    "08 IP\n"
+    "09 STO+ 01\n"
+    "10 RCL 01\n"
+    "11 2\n"
+    "12 \xc3\xb7\n"
+    "13 X<Y?\n"
+    "14 GTO 02\n"
+    "15 1\n"
+    "16 STO+ 02\n"
+    "17 LBL 02\n"
+    "18 DSE 00\n"
+    "19 GTO 01\n"
+    "20 END\n";
+
+static bool start(const char *label) {
+    arg_struct arg;
+    int prgm;
+    int4 lblpc;
+    arg.type = ARGTYPE_STR;
+    arg.length = strlen(label);
+    memcpy(arg.val.text, label, arg.length);
+    if (!find_global_label(&arg, &prgm, &lblpc))
+        return false;
+    clear_all_rtns();
+    current_prgm = prgm;
+    pc = lblpc;
+    set_running(true);
+    return true;
+}
+
+static double time_loop(int iterations) {
+    int enqueued, repeat;
+    vartype *v = new_real(iterations);
+    recall_result(v);
+    start("FLOOP");
+    double t = now();
+    while (core_keydown(0, &enqueued, &repeat));
+    return now() - t;
+}
+
+/* Number of function evaluations ComplexTest has done so far */
+static double complex_test_progress() {
+    vartype_realmatrix *regs = (vartype_realmatrix *) recall_var("REGS", 4);
+    phloat *r = regs->array->data;
+    int f = to_int(r[0]) - 80;
+    int a = to_int(r[1]) + 100;
+    int b = to_int(r[2]) + 100;
+    return ((double) f * 201 + a) * 201 + b;
+}
+
+static double time_complex_test(double seconds) {
+    int enqueued, repeat;
+    start("CT");
+    double t = now();
+    deadline = t + seconds;
+    while (core_keydown(0, &enqueued, &repeat))
+        if (now() >= deadline)
+            break;
+    t = now() - t;
+    deadline = 0;
+    set_running(false);
+    return complex_test_progress() / t;
+}
+
+int main(int argc, char *argv[]) {
+    int niter = argc > 1 ? atoi(argv[1]) : 1000000;
+    const char *raw = argc > 2 ? argv[2] : "../util/ComplexTest.raw";
+    double seconds = argc > 3 ? atof(argv[3]) : 5;
+
+    core_init(0, 0, NULL, 0);
+
+    flags.f.prgm_mode = true;
+    core_paste(loop_listing);
+    flags.f.prgm_mode = false;
+    core_settings.no_fusion = true;
+    double t_plain = time_loop(niter);
+    core_settings.no_fusion = false;
+    double t_fused = time_loop(niter);
+    printf("loop:         fused %7.3f s, unfused %7.3f s, speedup %.2fx\n",
+            t_fused, t_plain, t_plain / t_fused);
+
+    FILE *f = fopen(raw, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Can't open \"%s\"\n", raw);
+        return 1;
+    }
+    fclose(f);
+    core_import_programs(0, raw);
+    core_settings.no_fusion = true;
+    double r_plain = time_complex_test(seconds);
+    core_settings.no_fusion = false;
+    double r_fused = time_complex_test(seconds);
+    printf("ComplexTest:  fused %7.0f /s, unfused %7.0f /s, speedup %.2fx\n",
+            r_fused, r_plain, r_fused / r_plain);
+
+    core_cleanup();
+    return 0;
+}
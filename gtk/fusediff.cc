@@ -0,0 +1,442 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Differential test for superinstructions (see fuse_decoded() in
+// core_globals.cc). Runs programs once with instruction fusion and once with
+// core_settings.no_fusion set, so every line is looked up and executed on its
+// own, each time in a fresh calculator, and compares the complete saved
+// states and the number of lines executed afterwards. The programs are every
+// global label in the loaded files, run on random inputs, and randomly
+// generated programs, made mostly of the sequences fuse_decoded() looks for:
+// tests followed by local GTOs, to labels that may or may not exist, and runs
+// of stack, arithmetic, STO and RCL lines, with direct, indirect, and stack
+// arguments, mixed with lines that can't be fused. As in nativediff, each run
+// is also repeated for a random number of lines, to check stopping in the
+// middle of a superinstruction, and runs are capped at max_lines lines.
+// Reports any mismatches, and how many of the lines that were run had been
+// fused.
+//
+// Usage: fusediff [-r file.raw] [-l listing.txt] [runs [max_lines]]
+// With neither -r nor -l, nativetest.txt is loaded.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "shell.h"
+#include "shell_spool.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_variables.h"
+
+
+static uint8 step_limit;
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Shell override; shell_wants_cpu() is what enforces the line limit. The
+ * rest of the shell is in headless_shell.cc. */
+
+int shell_wants_cpu() { return core_program_steps() >= step_limit; }
+
+
+static int nsources;
+static const char **source_opts;
+static const char **source_files;
+
+static char *read_file(const char *name) {
+    FILE *f = fopen(name, "rb");
+    if (f == NULL)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = (char *) malloc(size + 1);
+    if (buf == NULL || fread(buf, 1, size, f) != (size_t) size) {
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+    buf[size] = 0;
+    fclose(f);
+    return buf;
+}
+
+static void paste_program(const char *text) {
+    flags.f.prgm_mode = true;
+    core_paste(text);
+    flags.f.prgm_mode = false;
+}
+
+// Starts a fresh calculator, with the programs loaded: the ones from the
+// command line, or, if listing isn't NULL, just that one.
+static bool start_core(bool fusion, const char *listing) {
+    core_init(0, 0, NULL, 0);
+    core_settings.no_fusion = !fusion;
+    if (listing != NULL) {
+        paste_program(listing);
+        return true;
+    }
+    for (int i = 0; i < nsources; i++) {
+        if (source_opts[i][1] == 'r') {
+            FILE *f = fopen(source_files[i], "rb");
+            if (f == NULL) {
+                fprintf(stderr, "Can't open \"%s\"\n", source_files[i]);
+                return false;
+            }
+            fclose(f);
+            core_import_programs(0, source_files[i]);
+        } else {
+            char *text = read_file(source_files[i]);
+            if (text == NULL) {
+                fprintf(stderr, "Can't read \"%s\"\n", source_files[i]);
+                return false;
+            }
+            paste_program(text);
+            free(text);
+        }
+    }
+    return true;
+}
+
+// FNV-1a hash of the saved state, minus the platform string
+static uint8 state_checksum() {
+    char name[] = "/tmp/fusediff.XXXXXX";
+    int fd = mkstemp(name);
+    if (fd == -1)
+        return 0;
+    close(fd);
+    core_save_state(name);
+    uint8 h = 14695981039346656037ULL;
+    FILE *f = fopen(name, "rb");
+    if (f != NULL) {
+        int c, pos = 0;
+        while ((c = getc(f)) != EOF) {
+            if (pos < 8) {
+                pos++;
+            } else if (pos == 8) {
+                if (c == 0)
+                    pos++;
+                continue;
+            }
+            h ^= (unsigned char) c;
+            h *= 1099511628211ULL;
+        }
+        fclose(f);
+    }
+    unlink(name);
+    return h;
+}
+
+// Number of lines in the program that start a superinstruction, and the
+// number of lines they span. Decodes the program, if that hadn't been done
+// yet.
+static int4 fused_starts;
+static int4 fused_lines;
+
+static void count_fused(int prgm_index) {
+    int saved_prgm = current_prgm;
+    current_prgm = prgm_index;
+    get_decoded_command(0);
+    current_prgm = saved_prgm;
+    prgm_struct *prgm = prgms + prgm_index;
+    if (prgm->decoded == NULL)
+        return;
+    for (int4 i = 0; i < prgm->lines_count; i++)
+        if (prgm->decoded[i].fused > 1) {
+            fused_starts++;
+            fused_lines += prgm->decoded[i].fused;
+        }
+}
+
+struct run_result {
+    uint8 checksum;
+    uint8 steps;
+};
+
+// Runs the label, with y and x on the stack, until it stops or has executed
+// 'lines' lines; 'seconds' is set to the time spent running.
+static run_result run_label(const char *listing, const label_struct *lbl,
+                            double y, double x, uint8 lines, bool fusion,
+                            double *seconds) {
+    if (!start_core(fusion, listing))
+        exit(1);
+    recall_result(new_real(y));
+    recall_result(new_real(x));
+    clear_all_rtns();
+    current_prgm = lbl->prgm;
+    pc = lbl->pc;
+    set_running(true);
+    double t = now();
+    while (true) {
+        uint8 steps = core_program_steps();
+        if (steps >= lines)
+            break;
+        step_limit = lines;
+        core_settings.run_slice_instructions = (int) (lines - steps + 1);
+        int enqueued, repeat;
+        if (core_keydown(0, &enqueued, &repeat))
+            continue;
+        if (mode_pause && core_timeout3(1))
+            continue;
+        break;
+    }
+    *seconds = now() - t;
+    run_result r;
+    r.steps = core_program_steps();
+    r.checksum = state_checksum();
+    core_cleanup();
+    return r;
+}
+
+static double random_value() {
+    switch (rand() % 4) {
+        case 0: return rand() % 10;
+        case 1: return rand() % 50 - 25;
+        case 2: return (rand() % 2000 - 1000) / 100.0;
+        default: return 0;
+    }
+}
+
+/* Random programs */
+
+static const char *straight_lines[] = {
+    "ENTER", "X<>Y", "+", "-", "\xc3\x97", "\xc3\xb7",
+    "STO %02d", "STO+ %02d", "STO- %02d", "STO\xc3\x97 %02d", "STO\xc3\xb7 %02d",
+    "RCL %02d", "RCL+ %02d", "RCL- %02d", "RCL\xc3\x97 %02d", "RCL\xc3\xb7 %02d",
+    "STO IND 09", "RCL IND 09", "RCL+ IND 09", "STO\xc3\x97 IND 09",
+    "RCL ST Y", "RCL\xc3\x97 ST Z", "STO ST T", "STO+ ST Y",
+    "0", "1", "2", "-1", "0.5", "3E2", "1E-3"
+};
+
+static const char *test_lines[] = {
+    "X=0?", "X\xe2\x89\xa0" "0?", "X<0?", "X>0?", "X\xe2\x89\xa4" "0?",
+    "X\xe2\x89\xa5" "0?", "X=Y?", "X\xe2\x89\xa0Y?", "X<Y?", "X>Y?",
+    "X\xe2\x89\xa4Y?", "X\xe2\x89\xa5Y?",
+    "FS? %02d", "FC? %02d", "FS?C %02d", "FC?C %02d",
+    "ISG %02d", "DSE %02d"
+};
+
+// Lines that fuse_decoded() doesn't fuse, including ones that change what
+// the fused lines do, like SF 25
+static const char *other_lines[] = {
+    "+/-", "ABS", "IP", "R\xe2\x86\x93", "CLX", "LASTX", "X^2",
+    "SF %02d", "CF %02d", "SF 25", "X<> %02d", "GTO IND 08"
+};
+
+#define ELEMS(a) ((int) (sizeof(a) / sizeof(a[0])))
+
+static char *add_line(char *p, int *n, const char *fmt) {
+    char line[32];
+    // Registers 00-07, for STO and RCL; flags 00-03; R08 and R09 are set
+    // up by the program's prologue, for the indirect arguments
+    int arg = strstr(fmt, "FS") || strstr(fmt, "FC") || strstr(fmt, "SF")
+            || strstr(fmt, "CF") ? rand() % 4 : rand() % 8;
+    snprintf(line, 32, fmt, arg);
+    return p + sprintf(p, "%02d %s\n", ++*n, line);
+}
+
+static char *add_gto(char *p, int *n) {
+    char fmt[16];
+    // Label 05 doesn't exist
+    snprintf(fmt, 16, "GTO %02d", 1 + rand() % 5);
+    return add_line(p, n, fmt);
+}
+
+// A program, named FZ, that consists mainly of superinstruction candidates;
+// the returned text must be freed by the caller
+static char *random_program() {
+    char *text = (char *) malloc(16384);
+    char *p = text;
+    int n = 0;
+    p = add_line(p, &n, "LBL \"FZ\"");
+    p = add_line(p, &n, "3");
+    p = add_line(p, &n, "STO 09");
+    p = add_line(p, &n, "99");
+    p = add_line(p, &n, "STO 08");
+    p = add_line(p, &n, "R\xe2\x86\x93");
+    p = add_line(p, &n, "R\xe2\x86\x93");
+    int units = 10 + rand() % 30;
+    int next_label = 1;
+    for (int u = 0; u < units; u++) {
+        if (next_label <= 4 && rand() % (units - u) < 5 - next_label) {
+            char fmt[16];
+            snprintf(fmt, 16, "LBL %02d", next_label++);
+            p = add_line(p, &n, fmt);
+        }
+        switch (rand() % 6) {
+            case 0:
+                p = add_line(p, &n, test_lines[rand() % ELEMS(test_lines)]);
+                p = add_gto(p, &n);
+                break;
+            case 1:
+                p = add_line(p, &n, straight_lines[rand() % ELEMS(straight_lines)]);
+                p = add_line(p, &n, test_lines[rand() % ELEMS(test_lines)]);
+                p = add_gto(p, &n);
+                break;
+            case 2:
+            case 3: {
+                int k = 2 + rand() % 3;
+                for (int i = 0; i < k; i++)
+                    p = add_line(p, &n, straight_lines[rand() % ELEMS(straight_lines)]);
+                break;
+            }
+            case 4:
+                p = add_line(p, &n, test_lines[rand() % ELEMS(test_lines)]);
+                p = add_line(p, &n, rand() % 2 == 0
+                        ? straight_lines[rand() % ELEMS(straight_lines)]
+                        : other_lines[rand() % ELEMS(other_lines)]);
+                break;
+            default:
+                p = add_line(p, &n, other_lines[rand() % ELEMS(other_lines)]);
+                break;
+        }
+    }
+    // Target of GTO IND 08
+    p = add_line(p, &n, "LBL 99");
+    if (rand() % 2 == 0)
+        p = add_gto(p, &n);
+    add_line(p, &n, "END");
+    return text;
+}
+
+// Runs lbl on 'runs' random inputs, to completion and to a random cut,
+// with and without fusion, and returns the number of mismatches
+static int check_label(const char *listing, const label_struct *lbl,
+                       const char *name, int runs, int max_lines,
+                       bool verbose, double *plain_time, double *fused_time) {
+    int bad = 0;
+    for (int r = 0; r < runs; r++) {
+        double y = random_value();
+        double x = random_value();
+        double t1, t2;
+        run_result a = run_label(listing, lbl, y, x, max_lines, false, &t1);
+        run_result b = run_label(listing, lbl, y, x, max_lines, true, &t2);
+        *plain_time += t1;
+        *fused_time += t2;
+        if (a.checksum != b.checksum || a.steps != b.steps) {
+            if (verbose || bad == 0)
+                printf("%-8s y=%g x=%g: %s differ after running\n", name, y, x,
+                        a.steps != b.steps ? "line counts" : "states");
+            bad++;
+        }
+        uint8 cut = 1 + rand() % 200;
+        a = run_label(listing, lbl, y, x, cut, false, &t1);
+        b = run_label(listing, lbl, y, x, cut, true, &t2);
+        if (a.checksum != b.checksum || a.steps != b.steps) {
+            if (verbose || bad == 0)
+                printf("%-8s y=%g x=%g: %s differ after %d lines\n", name, y, x,
+                        a.steps != b.steps ? "line counts" : "states", (int) cut);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+int main(int argc, char *argv[]) {
+    int runs = 20;
+    int max_lines = 100000;
+    source_opts = (const char **) malloc(argc * sizeof(char *));
+    source_files = (const char **) malloc(argc * sizeof(char *));
+    int i;
+    for (i = 1; i + 1 < argc && (strcmp(argv[i], "-r") == 0
+                                 || strcmp(argv[i], "-l") == 0); i += 2) {
+        source_opts[nsources] = argv[i];
+        source_files[nsources++] = argv[i + 1];
+    }
+    if (i < argc)
+        runs = atoi(argv[i++]);
+    if (i < argc)
+        max_lines = atoi(argv[i++]);
+    if (i < argc || runs <= 0 || max_lines <= 0) {
+        fprintf(stderr, "Usage: fusediff [-r file.raw] [-l listing.txt] [runs [max_lines]]\n");
+        return 2;
+    }
+    if (nsources == 0) {
+        source_opts[0] = "-l";
+        source_files[nsources++] = "nativetest.txt";
+    }
+
+    // Find the labels to test, in a calculator of our own
+    if (!start_core(true, NULL))
+        return 1;
+    int nlabels = 0;
+    label_struct *lbls = (label_struct *) malloc(labels_count * sizeof(label_struct));
+    for (i = 0; i < labels_count; i++)
+        if (labels[i].length != 0)
+            lbls[nlabels++] = labels[i];
+    for (i = 0; i < prgms_count; i++)
+        count_fused(i);
+    printf("loaded programs: %d superinstructions, spanning %d lines\n",
+            (int) fused_starts, (int) fused_lines);
+    core_cleanup();
+
+    srand(42);
+    int failures = 0;
+    for (i = 0; i < nlabels; i++) {
+        const label_struct *lbl = lbls + i;
+        char name[50];
+        name[hp2ascii(name, lbl->name, lbl->length)] = 0;
+        double plain_time = 0, fused_time = 0;
+        int bad = check_label(NULL, lbl, name, runs, max_lines, true,
+                              &plain_time, &fused_time);
+        printf("%-8s %4d runs, %s, unfused %8.3f ms, fused %8.3f ms (%.2fx)\n",
+                name, runs, bad == 0 ? "ok" : "FAILED",
+                plain_time * 1000, fused_time * 1000,
+                fused_time > 0 ? plain_time / fused_time : 0);
+        failures += bad;
+    }
+    free(lbls);
+
+    // Random programs, each with a few runs of its own, and capped lower,
+    // since most of them loop forever
+    int programs = runs * 25;
+    int random_max = max_lines < 2000 ? max_lines : 2000;
+    int bad_programs = 0;
+    fused_starts = fused_lines = 0;
+    double plain_time = 0, fused_time = 0;
+    for (i = 0; i < programs; i++) {
+        char *listing = random_program();
+        start_core(true, listing);
+        label_struct lbl = labels[0];
+        count_fused(lbl.prgm);
+        core_cleanup();
+        int bad = check_label(listing, &lbl, "FZ", 2, random_max, false,
+                              &plain_time, &fused_time);
+        if (bad != 0) {
+            if (bad_programs++ < 5)
+                printf("%s", listing);
+            failures += bad;
+        }
+        free(listing);
+    }
+    printf("random   %4d programs, %d superinstructions spanning %d lines, %s,"
+            " unfused %8.3f ms, fused %8.3f ms (%.2fx)\n",
+            programs, (int) fused_starts, (int) fused_lines,
+            bad_programs == 0 ? "ok" : "FAILED",
+            plain_time * 1000, fused_time * 1000,
+            fused_time > 0 ? plain_time / fused_time : 0);
+
+    return failures == 0 && nlabels > 0 ? 0 : 1;
+}
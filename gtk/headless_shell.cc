@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Shell interface for the headless targets: free42cli and the benchmark and
+// test tools, which link the emulator core without the GTK shell. There is
+// no display, keyboard, sound, or printer; the clock stands still, and the
+// time and date are fixed, so runs are repeatable.
+//
+// All of these are weak definitions. A tool that needs something different,
+// such as a shell_wants_cpu() that ends a timed run, or a shell_blitter()
+// that looks at the display, just defines its own version, which the linker
+// then uses instead.
+
+#include <stdio.h>
+
+#include "shell.h"
+
+#define HEADLESS_DEFAULT __attribute__((weak))
+
+
+HEADLESS_DEFAULT const char *shell_platform() {
+    return "headless";
+}
+
+HEADLESS_DEFAULT void shell_blitter(const char *bits, int bytesperline,
+                                    int x, int y, int width, int height) {
+    // No display
+}
+
+HEADLESS_DEFAULT void shell_beeper(int frequency, int duration) {
+    // No sound
+}
+
+HEADLESS_DEFAULT void shell_annunciators(int updn, int shf, int prt, int run,
+                                         int g, int rad) {
+    // No display
+}
+
+HEADLESS_DEFAULT int shell_wants_cpu() {
+    // Nothing else to do; never interrupt a running program
+    return 0;
+}
+
+HEADLESS_DEFAULT void shell_delay(int duration) {
+    // Running at full speed, so there is no point in waiting
+}
+
+HEADLESS_DEFAULT void shell_request_timeout3(int delay) {
+    // The caller calls core_timeout3() itself, without the delay
+}
+
+HEADLESS_DEFAULT uint4 shell_get_mem() {
+    return 1 << 30;
+}
+
+HEADLESS_DEFAULT int shell_low_battery() {
+    return 0;
+}
+
+HEADLESS_DEFAULT void shell_powerdown() {
+    // OFF just stops the program
+}
+
+HEADLESS_DEFAULT int8 shell_random_seed() {
+    return 0;
+}
+
+HEADLESS_DEFAULT uint4 shell_milliseconds() {
+    return 0;
+}
+
+HEADLESS_DEFAULT int shell_decimal_point() {
+    return 1;
+}
+
+HEADLESS_DEFAULT void shell_print(const char *text, int length,
+                                  const char *bits, int bytesperline,
+                                  int x, int y, int width, int height) {
+    // No printer
+}
+
+HEADLESS_DEFAULT void shell_get_time_date(uint4 *time, uint4 *date,
+                                          int *weekday) {
+    // Noon, Wednesday, January 1, 2020
+    if (time != NULL)
+        *time = 12000000;
+    if (date != NULL)
+        *date = 20200101;
+    if (weekday != NULL)
+        *weekday = 3;
+}
+
+HEADLESS_DEFAULT void shell_message(const char *message) {
+    fprintf(stderr, "%s\n", message);
+}
+
+HEADLESS_DEFAULT void shell_log(const char *message) {
+    fprintf(stderr, "%s\n", message);
+}
@@ -0,0 +1,194 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Keystroke injection benchmark. Types "1 +" over and over, so X counts the
+// keystroke pairs that made it through, in three ways:
+//   direct:   core_keydown() and core_keyup() for every key, on one thread,
+//             the way a shell does it for keys typed by hand;
+//   injected: a producer thread feeding the injection queue, while the
+//             calculator's thread delivers what it finds there in batches;
+//   running:  injected as well, but while a program is running, so that
+//             everything has to go through the 16-key type-ahead buffer.
+// It reports keys per second, how often the display was repainted, and how
+// many times the producer found the queue full and had to retry, and it
+// fails if any keystrokes were lost.
+//
+// Usage: injectbench [pairs [queue_limit]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <atomic>
+#include <thread>
+
+#include "shell.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_variables.h"
+
+
+static int repaints = 0;
+static void *queue = NULL;
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Shell overrides; the blitter counts repaints. The rest of the shell is in
+ * headless_shell.cc. */
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                   int width, int height) { repaints++; }
+int shell_wants_cpu() { return core_inject_ready(); }
+uint4 shell_milliseconds() { return (uint4) (now() * 1000); }
+
+
+static const char *spin_listing =
+    "01 LBL \"SPIN\"\n"
+    "02 STO 00\n"
+    "03 LBL 01\n"
+    "04 DSE 00\n"
+    "05 GTO 01\n"
+    "06 CLST\n"
+    "07 END\n";
+
+static const int pair[] = { KEY_1, KEY_ADD };
+
+static std::atomic<bool> producer_done;
+static long retries;
+
+static void producer(int pairs) {
+    int keys[513];
+    for (int i = 0; i < 513; i++)
+        keys[i] = pair[i & 1];
+    long left = 2L * pairs;
+    while (left > 0) {
+        int n = left > 512 ? 512 : (int) left;
+        // Pick up where the last call left off, which may be mid-pair
+        int accepted = core_inject_keys(queue, keys + (left & 1), n);
+        left -= accepted;
+        if (accepted < n) {
+            retries++;
+            std::this_thread::yield();
+        }
+    }
+    producer_done.store(true);
+}
+
+static void clear_stack() {
+    int enqueued, repeat;
+    core_keydown_command("CLST", &enqueued, &repeat);
+    core_keyup();
+}
+
+static bool check(const char *name, int pairs) {
+    char *x = core_copy();
+    long got = atol(x);
+    free(x);
+    if (got != pairs) {
+        printf("%s: X = %ld, expected %d; keystrokes were lost\n",
+                name, got, pairs);
+        return false;
+    }
+    return true;
+}
+
+static double time_direct(int pairs) {
+    int enqueued, repeat;
+    clear_stack();
+    repaints = 0;
+    double t = now();
+    for (long i = 0; i < 2L * pairs; i++) {
+        core_keydown(pair[i & 1], &enqueued, &repeat);
+        core_keyup();
+    }
+    return now() - t;
+}
+
+static double time_injected(int pairs, int spin) {
+    int enqueued, repeat;
+    clear_stack();
+    int keep_running = 0;
+    if (spin > 0) {
+        vartype *v = new_real(spin);
+        recall_result(v);
+        arg_struct arg;
+        int prgm;
+        int4 lblpc;
+        arg.type = ARGTYPE_STR;
+        arg.length = 4;
+        memcpy(arg.val.text, "SPIN", 4);
+        find_global_label(&arg, &prgm, &lblpc);
+        clear_all_rtns();
+        current_prgm = prgm;
+        pc = lblpc;
+        set_running(true);
+        keep_running = 1;
+    }
+    repaints = 0;
+    retries = 0;
+    producer_done.store(false);
+    double t = now();
+    std::thread p(producer, pairs);
+    while (true) {
+        bool pending = core_inject_pending(queue) != 0;
+        if (pending)
+            keep_running = core_inject_deliver(&enqueued);
+        if (keep_running)
+            keep_running = core_keydown(0, &enqueued, &repeat);
+        else if (!pending) {
+            if (producer_done.load() && core_inject_pending(queue) == 0)
+                break;
+            std::this_thread::yield();
+        }
+    }
+    p.join();
+    return now() - t;
+}
+
+int main(int argc, char *argv[]) {
+    int pairs = argc > 1 ? atoi(argv[1]) : 200000;
+    int limit = argc > 2 ? atoi(argv[2]) : 0;
+    bool ok = true;
+
+    core_init(0, 0, NULL, 0);
+    flags.f.prgm_mode = true;
+    core_paste(spin_listing);
+    flags.f.prgm_mode = false;
+    queue = core_inject_open(limit, NULL, NULL);
+
+    double t = time_direct(pairs);
+    ok &= check("direct", pairs);
+    printf("direct:   %9.0f keys/s, %8d repaints\n", 2 * pairs / t, repaints);
+
+    t = time_injected(pairs, 0);
+    ok &= check("injected", pairs);
+    printf("injected: %9.0f keys/s, %8d repaints, %6ld retries\n",
+            2 * pairs / t, repaints, retries);
+
+    t = time_injected(pairs, 100000);
+    ok &= check("running", pairs);
+    printf("running:  %9.0f keys/s, %8d repaints, %6ld retries\n",
+            2 * pairs / t, repaints, retries);
+
+    core_cleanup();
+    return ok ? 0 : 1;
+}
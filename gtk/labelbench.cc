@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Global label table microbenchmark. Builds a program library with a large
+// number of global labels, and compares the cost of XEQ "NAME" lookups and
+// of storing and deleting global LBLs, between the hashed, incrementally
+// maintained label index and the old linear table, which is emulated here
+// by a linear scan of labels[] and a rebuild_label_table() per edit.
+//
+// Usage: labelbench [programs [labels_per_program [lookups]]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "shell.h"
+#include "core_main.h"
+#include "core_globals.h"
+
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void make_name(arg_struct *arg, int n) {
+    arg->type = ARGTYPE_STR;
+    arg->length = sprintf(arg->val.text, "L%05d", n);
+}
+
+/* The lookup loop of the old find_global_label() */
+static int linear_find_global_label(const arg_struct *arg, int *prgm, int4 *pc) {
+    for (int i = labels_count - 1; i >= 0; i--)
+        if (labels[i].length == arg->length
+                && memcmp(labels[i].name, arg->val.text, arg->length) == 0) {
+            *prgm = labels[i].prgm;
+            *pc = labels[i].pc;
+            return 1;
+        }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int nprgms = argc > 1 ? atoi(argv[1]) : 200;
+    int nlabels = argc > 2 ? atoi(argv[2]) : 20;
+    int nlookups = argc > 3 ? atoi(argv[3]) : 100000;
+    int total = nprgms * nlabels;
+    arg_struct arg;
+    int prgm;
+    int4 lblpc;
+    double t, t_hash, t_linear;
+
+    core_init(0, 0, NULL, 0);
+
+    int n = 0;
+    for (int p = 0; p < nprgms; p++) {
+        for (int l = 0; l < nlabels; l++) {
+            make_name(&arg, n++);
+            store_command_after(&pc, CMD_LBL, &arg);
+            arg.type = ARGTYPE_NONE;
+            store_command_after(&pc, CMD_ADD, &arg);
+        }
+        goto_dot_dot(true);
+    }
+    printf("%d programs, %d global labels\n", prgms_count, labels_count);
+
+    srand(1);
+    int *keys = (int *) malloc(nlookups * sizeof(int));
+    for (int i = 0; i < nlookups; i++)
+        keys[i] = rand() % total;
+
+    t = now();
+    for (int i = 0; i < nlookups; i++) {
+        make_name(&arg, keys[i]);
+        find_global_label(&arg, &prgm, &lblpc);
+    }
+    t_hash = now() - t;
+    t = now();
+    for (int i = 0; i < nlookups; i++) {
+        make_name(&arg, keys[i]);
+        linear_find_global_label(&arg, &prgm, &lblpc);
+    }
+    t_linear = now() - t;
+    printf("lookup:  hashed %8.3f us, linear %8.3f us, speedup %.1fx\n",
+            t_hash * 1e6 / nlookups, t_linear * 1e6 / nlookups,
+            t_linear / t_hash);
+
+    /* Edits: store and delete a global LBL in the middle of the library */
+    int nedits = 1000;
+    current_prgm = nprgms / 2;
+    t = now();
+    for (int i = 0; i < nedits; i++) {
+        make_name(&arg, total + i);
+        store_command(0, CMD_LBL, &arg);
+        delete_command(0);
+    }
+    t_hash = now() - t;
+    t = now();
+    for (int i = 0; i < nedits; i++) {
+        make_name(&arg, total + i);
+        store_command(0, CMD_LBL, &arg);
+        rebuild_label_table();
+        delete_command(0);
+        rebuild_label_table();
+    }
+    t_linear = now() - t;
+    printf("edit:    hashed %8.3f us, rescan %8.3f us, speedup %.1fx\n",
+            t_hash * 1e6 / nedits, t_linear * 1e6 / nedits,
+            t_linear / t_hash);
+
+    free(keys);
+    core_cleanup();
+    return 0;
+}
@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Real matrix benchmark. Times X*Y (matrix_mul_rr_worker()) and DET
+// (lu_decomp_r_worker()) on random square matrices of a few sizes, running
+// the interruptible workers to completion the way continue_running() does,
+// and reports the time per multiply-add in the inner loops. It also times
+// the element-wise X+Y and SIN (map_binary() and map_unary()), per element.
+// The checksums depend only on the inputs and the number mode, so they can be
+// compared between builds.
+//
+// Usage: matrixbench [size [repetitions]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "shell.h"
+#include "core_commands1.h"
+#include "core_commands3.h"
+#include "core_commands6.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_variables.h"
+
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Entries are k/7 for k in -1000..1000, so that they don't fit in a few
+// digits, in either number mode
+static vartype *random_matrix(int4 n) {
+    vartype_realmatrix *m = (vartype_realmatrix *) new_realmatrix(n, n);
+    if (m == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (int4 i = 0; i < n * n; i++)
+        m->array->data[i] = phloat(rand() % 2001 - 1000) / 7;
+    return (vartype *) m;
+}
+
+static void set_reg(vartype **reg, vartype *v) {
+    free_vartype(*reg);
+    *reg = v;
+}
+
+// Runs a command, and its interruptible worker, to completion
+static void run(int (*cmd)(arg_struct *)) {
+    int error = cmd(NULL);
+    while (error == ERR_INTERRUPTIBLE)
+        error = mode_interruptible(0);
+    if (error != ERR_NONE) {
+        fprintf(stderr, "error %d\n", error);
+        exit(1);
+    }
+}
+
+static double checksum(vartype *v) {
+    if (v->type == TYPE_REAL)
+        return to_double(((vartype_real *) v)->x);
+    vartype_realmatrix *m = (vartype_realmatrix *) v;
+    phloat sum = 0;
+    for (int4 i = 0; i < m->rows * m->columns; i++)
+        sum += m->array->data[i];
+    return to_double(sum);
+}
+
+static void bench(int4 n, int reps) {
+    vartype *a = random_matrix(n);
+    vartype *b = random_matrix(n);
+    double t_mul = 0, t_det = 0, sum_mul = 0, sum_det = 0;
+    double t_add = 0, t_sin = 0, sum_add = 0, sum_sin = 0;
+    for (int r = 0; r < reps; r++) {
+        set_reg(&reg_y, dup_vartype(a));
+        set_reg(&reg_x, dup_vartype(b));
+        double t = now();
+        run(docmd_mul);
+        t_mul += now() - t;
+        sum_mul = checksum(reg_x);
+        set_reg(&reg_x, dup_vartype(a));
+        t = now();
+        run(docmd_det);
+        t_det += now() - t;
+        sum_det = checksum(reg_x);
+        set_reg(&reg_y, dup_vartype(a));
+        set_reg(&reg_x, dup_vartype(b));
+        t = now();
+        run(docmd_add);
+        t_add += now() - t;
+        sum_add = checksum(reg_x);
+        set_reg(&reg_x, dup_vartype(a));
+        t = now();
+        run(docmd_sin);
+        t_sin += now() - t;
+        sum_sin = checksum(reg_x);
+    }
+    // n^3 multiply-adds for the product, about n^3/3 for the decomposition
+    double macs = (double) n * n * n;
+    printf("%3dx%-3d  mul %8.2f ns/madd  det %8.2f ns/madd  "
+            "checksums %.17g %.17g\n",
+            (int) n, (int) n, t_mul * 1e9 / (macs * reps),
+            t_det * 1e9 / (macs / 3 * reps), sum_mul, sum_det);
+    double elts = (double) n * n;
+    printf("         add %8.2f ns/elt   sin %8.2f ns/elt   "
+            "checksums %.17g %.17g\n",
+            t_add * 1e9 / (elts * reps), t_sin * 1e9 / (elts * reps),
+            sum_add, sum_sin);
+    free_vartype(a);
+    free_vartype(b);
+}
+
+int main(int argc, char *argv[]) {
+    int4 size = argc > 1 ? atoi(argv[1]) : 0;
+    int reps = argc > 2 ? atoi(argv[2]) : 0;
+
+    core_init(0, 0, NULL, 0);
+    srand(42);
+
+    if (size > 0) {
+        bench(size, reps > 0 ? reps : 10);
+    } else {
+        static const int4 sizes[] = { 5, 10, 20, 40, 80 };
+        for (int i = 0; i < 5; i++) {
+            int4 n = sizes[i];
+            bench(n, reps > 0 ? reps : 1 + 400000 / (n * n * n));
+        }
+    }
+
+    core_cleanup();
+    return 0;
+}
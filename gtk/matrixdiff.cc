@@ -0,0 +1,271 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Differential test for the array versions of the real mappables (the *_ra
+// and *_rra operators, applied by map_unary() and map_binary(); see
+// core_sto_rcl.h). Runs each command that has one on random real matrices,
+// once as usual and once with core_settings.no_map_arrays set, so the
+// per-element mappables are used instead, and checks that both return the
+// same error, and, if there is none, a result that is the same bit for bit.
+// The binary operators are run on matrix and matrix (+ and - only), matrix
+// and scalar, and scalar and matrix. The elements mix zeros of both signs,
+// ordinary numbers, angles, numbers that overflow or underflow, and numbers
+// outside the domain of LOG, LN, and SQRT, and the matrices are sized so
+// that they span several MAP_BLOCKs, and end in a partial one. Every check
+// is made in each angle mode, with range errors both reported and ignored.
+//
+// Usage: matrixdiff [iterations [seed]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shell.h"
+#include "core_commands1.h"
+#include "core_commands6.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_sto_rcl.h"
+#include "core_variables.h"
+
+
+static uint8 rng_state = 88172645463325252ULL;
+
+// xorshift64*, as in phloatdiff
+static uint8 rng() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+// An element that is likely to make some operator fail
+static phloat special_element() {
+    switch (rng() % 10) {
+        case 0: return phloat(0);
+        case 1: return -phloat(0);
+        case 2: return POS_HUGE_PHLOAT / (int) (rng() % 4 + 1);
+        case 3: return NEG_HUGE_PHLOAT / (int) (rng() % 4 + 1);
+        case 4: return POS_TINY_PHLOAT * (int) (rng() % 4 + 1);
+        case 5: return NEG_TINY_PHLOAT * (int) (rng() % 4 + 1);
+        // Overflow or underflow for 10^X and E^X in either number mode
+        case 6: return phloat(7000);
+        case 7: return phloat(-20000);
+        case 8: return phloat(400);
+        default: return -phloat((int) (rng() % 1000 + 1)) / 7;
+    }
+}
+
+// An element that any of the operators can take, as long as it's positive;
+// multiples of 45 are angles where the trig functions take shortcuts
+static phloat plain_element(bool positive) {
+    phloat x;
+    switch (rng() % 3) {
+        case 0:
+            x = phloat((int) (rng() % 1000 + 1)) / 7;
+            break;
+        case 1:
+            x = phloat((int) (rng() % 17 + 1) * 45);
+            break;
+        default:
+            x = phloat((int) (rng() % 100000 + 1)) / 1000;
+            break;
+    }
+    return positive || (rng() & 1) == 0 ? x : -x;
+}
+
+static vartype *random_matrix(int4 rows, int4 columns) {
+    vartype_realmatrix *m = (vartype_realmatrix *) new_realmatrix(rows, columns);
+    if (m == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    // Clean matrices, so that results get compared, and matrices with a few
+    // bad elements, at random positions, so that errors do
+    static const int rates[] = { 0, 0, 500, 50, 5 };
+    int rate = rates[rng() % 5];
+    bool positive = (rng() & 1) == 0;
+    for (int4 i = 0; i < rows * columns; i++)
+        m->array->data[i] = rate != 0 && rng() % rate == 0
+                ? special_element() : plain_element(positive);
+    return (vartype *) m;
+}
+
+static vartype *random_scalar() {
+    return new_real(rng() % 4 == 0 ? special_element() : plain_element(false));
+}
+
+// Mostly small, but also around MAP_BLOCK and its multiples
+static void random_size(int4 *rows, int4 *columns) {
+    if (rng() % 4 == 0) {
+        int4 n = (int4) (rng() % 3 + 1) * MAP_BLOCK + (int4) (rng() % 3) - 1;
+        if (rng() & 1) {
+            *rows = 1;
+            *columns = n;
+        } else {
+            *rows = n;
+            *columns = 1;
+        }
+    } else {
+        *rows = (int4) (rng() % 20 + 1);
+        *columns = (int4) (rng() % 20 + 1);
+    }
+}
+
+static void set_reg(vartype **reg, vartype *v) {
+    free_vartype(*reg);
+    *reg = v;
+}
+
+// Runs a command on copies of x and y; returns a copy of the result, or NULL
+// if the command returned an error.
+static vartype *run(int (*cmd)(arg_struct *), const vartype *x,
+                    const vartype *y, bool arrays, int *error) {
+    set_reg(&reg_x, dup_vartype(x));
+    if (y != NULL)
+        set_reg(&reg_y, dup_vartype(y));
+    core_settings.no_map_arrays = !arrays;
+    *error = cmd(NULL);
+    core_settings.no_map_arrays = false;
+    return *error == ERR_NONE ? dup_vartype(reg_x) : NULL;
+}
+
+static bool same_result(const vartype *a, const vartype *b) {
+    if (a->type != b->type)
+        return false;
+    if (a->type == TYPE_REAL) {
+        phloat ax = ((vartype_real *) a)->x;
+        phloat bx = ((vartype_real *) b)->x;
+        return memcmp(&ax, &bx, sizeof(phloat)) == 0;
+    }
+    if (a->type != TYPE_REALMATRIX)
+        return false;
+    vartype_realmatrix *am = (vartype_realmatrix *) a;
+    vartype_realmatrix *bm = (vartype_realmatrix *) b;
+    if (am->rows != bm->rows || am->columns != bm->columns)
+        return false;
+    return memcmp(am->array->data, bm->array->data,
+                  am->rows * am->columns * sizeof(phloat)) == 0;
+}
+
+static int checks;
+static int with_errors;
+static int failures;
+
+static const char *mode_name() {
+    static char buf[32];
+    snprintf(buf, 32, "%s%s", flags.f.rad ? "RAD" : flags.f.grad ? "GRAD" : "DEG",
+             flags.f.range_error_ignore ? ", range errors ignored" : "");
+    return buf;
+}
+
+static void check(const char *op, const char *operands,
+                  int (*cmd)(arg_struct *), const vartype *x,
+                  const vartype *y) {
+    int err1, err2;
+    vartype *r1 = run(cmd, x, y, true, &err1);
+    vartype *r2 = run(cmd, x, y, false, &err2);
+    checks++;
+    if (err2 != ERR_NONE)
+        with_errors++;
+    bool same = err1 == err2 && (r1 == NULL || same_result(r1, r2));
+    if (!same && failures++ < 20) {
+        const vartype *m = x->type == TYPE_REALMATRIX ? x : y;
+        printf("%s (%s, %dx%d, %s): error %d, per element %d%s\n",
+                op, operands, (int) ((vartype_realmatrix *) m)->rows,
+                (int) ((vartype_realmatrix *) m)->columns, mode_name(),
+                err1, err2, err1 == err2 ? ", results differ" : "");
+    }
+    free_vartype(r1);
+    free_vartype(r2);
+}
+
+struct unary_op {
+    const char *name;
+    int (*cmd)(arg_struct *);
+};
+
+static const unary_op unary_ops[] = {
+    { "SIN",  docmd_sin },
+    { "COS",  docmd_cos },
+    { "LOG",  docmd_log },
+    { "10^X", docmd_10_pow_x },
+    { "LN",   docmd_ln },
+    { "E^X",  docmd_e_pow_x },
+    { "SQRT", docmd_sqrt },
+    { "X^2",  docmd_square },
+    { "1/X",  docmd_inv }
+};
+
+struct binary_op {
+    const char *name;
+    int (*cmd)(arg_struct *);
+    bool element_wise;      // matrix and matrix too, rather than X*Y etc.
+};
+
+static const binary_op binary_ops[] = {
+    { "+", docmd_add, true },
+    { "-", docmd_sub, true },
+    { "*", docmd_mul, false },
+    { "/", docmd_div, false }
+};
+
+static void check_all(const vartype *m1, const vartype *m2, const vartype *s) {
+    for (size_t i = 0; i < sizeof(unary_ops) / sizeof(unary_op); i++)
+        check(unary_ops[i].name, "matrix", unary_ops[i].cmd, m1, NULL);
+    for (size_t i = 0; i < sizeof(binary_ops) / sizeof(binary_op); i++) {
+        const binary_op *op = binary_ops + i;
+        if (op->element_wise)
+            check(op->name, "matrix, matrix", op->cmd, m1, m2);
+        check(op->name, "matrix, scalar", op->cmd, m1, s);
+        check(op->name, "scalar, matrix", op->cmd, s, m1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    if (argc > 2)
+        rng_state = strtoull(argv[2], NULL, 10) | 1;
+    if (iterations <= 0 || argc > 3) {
+        fprintf(stderr, "Usage: matrixdiff [iterations [seed]]\n");
+        return 2;
+    }
+
+    core_init(0, 0, NULL, 0);
+    for (int n = 0; n < iterations; n++) {
+        int4 rows, columns;
+        random_size(&rows, &columns);
+        vartype *m1 = random_matrix(rows, columns);
+        vartype *m2 = random_matrix(rows, columns);
+        vartype *s = random_scalar();
+        for (int mode = 0; mode < 6; mode++) {
+            flags.f.rad = mode % 3 == 1;
+            flags.f.grad = mode % 3 == 2;
+            flags.f.range_error_ignore = mode >= 3;
+            check_all(m1, m2, s);
+        }
+        free_vartype(m1);
+        free_vartype(m2);
+        free_vartype(s);
+    }
+    core_cleanup();
+
+    printf("%d checks, %d with errors, %d mismatches\n",
+            checks, with_errors, failures);
+    return failures == 0 ? 0 : 1;
+}
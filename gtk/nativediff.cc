@@ -0,0 +1,266 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Differential test for compiled programs (see core_native.h and
+// focal2cc.cc). Links the module focal2cc generated from the same programs
+// it loads, and runs every global label in every compiled program on random
+// inputs, once interpreted and once compiled, each time in a fresh
+// calculator, and compares the complete saved states afterwards. Besides
+// running to completion, each input is also run for a random number of
+// lines, which stops the programs in the middle, so that stopping a compiled
+// program partway through is checked as well. Runs are capped at max_lines
+// lines, so programs that don't stop on their own are fine too. Reports any
+// mismatches, and how much faster the compiled runs were.
+//
+// Usage: nativediff [-r file.raw] [-l listing.txt] [runs [max_lines]]
+// With neither -r nor -l, nativetest.txt is loaded.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "shell.h"
+#include "shell_spool.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+#include "core_main.h"
+#include "core_native.h"
+#include "core_variables.h"
+
+// Defined by the module focal2cc generated
+void register_native_test();
+
+
+static uint8 step_limit;
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Shell override; shell_wants_cpu() is what enforces the line limit. The
+ * rest of the shell is in headless_shell.cc. */
+
+int shell_wants_cpu() { return core_program_steps() >= step_limit; }
+
+
+static int nsources;
+static const char **source_opts;
+static const char **source_files;
+
+static char *read_file(const char *name) {
+    FILE *f = fopen(name, "rb");
+    if (f == NULL)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = (char *) malloc(size + 1);
+    if (buf == NULL || fread(buf, 1, size, f) != (size_t) size) {
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+    buf[size] = 0;
+    fclose(f);
+    return buf;
+}
+
+// Starts a fresh calculator, with the programs loaded
+static bool start_core(bool native) {
+    core_init(0, 0, NULL, 0);
+    core_settings.no_native = !native;
+    for (int i = 0; i < nsources; i++) {
+        if (source_opts[i][1] == 'r') {
+            FILE *f = fopen(source_files[i], "rb");
+            if (f == NULL) {
+                fprintf(stderr, "Can't open \"%s\"\n", source_files[i]);
+                return false;
+            }
+            fclose(f);
+            core_import_programs(0, source_files[i]);
+        } else {
+            char *text = read_file(source_files[i]);
+            if (text == NULL) {
+                fprintf(stderr, "Can't read \"%s\"\n", source_files[i]);
+                return false;
+            }
+            flags.f.prgm_mode = true;
+            core_paste(text);
+            flags.f.prgm_mode = false;
+            free(text);
+        }
+    }
+    return true;
+}
+
+// FNV-1a hash of the saved state, minus the platform string
+static uint8 state_checksum() {
+    char name[] = "/tmp/nativediff.XXXXXX";
+    int fd = mkstemp(name);
+    if (fd == -1)
+        return 0;
+    close(fd);
+    core_save_state(name);
+    uint8 h = 14695981039346656037ULL;
+    FILE *f = fopen(name, "rb");
+    if (f != NULL) {
+        int c, pos = 0;
+        while ((c = getc(f)) != EOF) {
+            if (pos < 8) {
+                pos++;
+            } else if (pos == 8) {
+                if (c == 0)
+                    pos++;
+                continue;
+            }
+            h ^= (unsigned char) c;
+            h *= 1099511628211ULL;
+        }
+        fclose(f);
+    }
+    unlink(name);
+    return h;
+}
+
+// Runs the label, with y and x on the stack, until it stops or has executed
+// 'lines' lines, and returns the checksum of the resulting state; 'seconds'
+// is set to the time spent running.
+static uint8 run_label(const label_struct *lbl, double y, double x,
+                       uint8 lines, bool native, double *seconds) {
+    if (!start_core(native))
+        exit(1);
+    recall_result(new_real(y));
+    recall_result(new_real(x));
+    clear_all_rtns();
+    current_prgm = lbl->prgm;
+    pc = lbl->pc;
+    set_running(true);
+    double t = now();
+    while (true) {
+        uint8 steps = core_program_steps();
+        if (steps >= lines)
+            break;
+        step_limit = lines;
+        core_settings.run_slice_instructions = (int) (lines - steps + 1);
+        int enqueued, repeat;
+        if (core_keydown(0, &enqueued, &repeat))
+            continue;
+        if (mode_pause && core_timeout3(1))
+            continue;
+        break;
+    }
+    *seconds = now() - t;
+    uint8 sum = state_checksum();
+    core_cleanup();
+    return sum;
+}
+
+static double random_value() {
+    switch (rand() % 4) {
+        case 0: return rand() % 10;
+        case 1: return rand() % 50 - 25;
+        case 2: return (rand() % 2000 - 1000) / 100.0;
+        default: return 0;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int runs = 20;
+    int max_lines = 1000000;
+    source_opts = (const char **) malloc(argc * sizeof(char *));
+    source_files = (const char **) malloc(argc * sizeof(char *));
+    int i;
+    for (i = 1; i + 1 < argc && (strcmp(argv[i], "-r") == 0
+                                 || strcmp(argv[i], "-l") == 0); i += 2) {
+        source_opts[nsources] = argv[i];
+        source_files[nsources++] = argv[i + 1];
+    }
+    if (i < argc)
+        runs = atoi(argv[i++]);
+    if (i < argc)
+        max_lines = atoi(argv[i++]);
+    if (i < argc || runs <= 0 || max_lines <= 0) {
+        fprintf(stderr, "Usage: nativediff [-r file.raw] [-l listing.txt] [runs [max_lines]]\n");
+        return 2;
+    }
+    if (nsources == 0) {
+        source_opts[0] = "-l";
+        source_files[nsources++] = "nativetest.txt";
+    }
+
+    register_native_test();
+
+    // Find the labels to test, in a calculator of our own
+    if (!start_core(true))
+        return 1;
+    int nlabels = 0;
+    label_struct *lbls = (label_struct *) malloc(labels_count * sizeof(label_struct));
+    for (i = 0; i < labels_count; i++) {
+        if (labels[i].length == 0)
+            continue;
+        if (find_native(labels[i].prgm) == NULL) {
+            char name[50];
+            name[hp2ascii(name, labels[i].name, labels[i].length)] = 0;
+            printf("%-8s not compiled; rebuild the module\n", name);
+            continue;
+        }
+        lbls[nlabels++] = labels[i];
+    }
+    core_cleanup();
+
+    srand(42);
+    int failures = 0;
+    for (i = 0; i < nlabels; i++) {
+        const label_struct *lbl = lbls + i;
+        char name[50];
+        name[hp2ascii(name, lbl->name, lbl->length)] = 0;
+        int bad = 0;
+        double interp_time = 0, native_time = 0;
+        for (int r = 0; r < runs; r++) {
+            double y = random_value();
+            double x = random_value();
+            double t1, t2;
+            uint8 a = run_label(lbl, y, x, max_lines, false, &t1);
+            uint8 b = run_label(lbl, y, x, max_lines, true, &t2);
+            interp_time += t1;
+            native_time += t2;
+            if (a != b) {
+                printf("%-8s y=%g x=%g: states differ after running\n", name, y, x);
+                bad++;
+            }
+            uint8 cut = 1 + rand() % 200;
+            a = run_label(lbl, y, x, cut, false, &t1);
+            b = run_label(lbl, y, x, cut, true, &t2);
+            if (a != b) {
+                printf("%-8s y=%g x=%g: states differ after %d lines\n",
+                        name, y, x, (int) cut);
+                bad++;
+            }
+        }
+        printf("%-8s %4d runs, %s, interpreted %8.3f ms, compiled %8.3f ms (%.2fx)\n",
+                name, runs, bad == 0 ? "ok" : "FAILED",
+                interp_time * 1000, native_time * 1000,
+                native_time > 0 ? interp_time / native_time : 0);
+        failures += bad;
+    }
+    free(lbls);
+    return failures == 0 && nlabels > 0 ? 0 : 1;
+}
@@ -0,0 +1,498 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Phloat microbenchmark. Times the operations core_phloat.h exports, in
+// whichever number mode the core was built in (phloatbench-dec with
+// BCD_MATH, phloatbench-bin without), on operands drawn from a few
+// distributions per operation, such as small integers, full-precision reals,
+// or the range a function is usually called with. Each operation is timed
+// two ways: throughput, with independent operands, and latency, where each
+// operation's operands are picked using its result, so that it can't start
+// before the previous one has finished. Both are reported in ns per
+// operation, as tab-separated values, one line per operation and
+// distribution; the 'load' line is the loop overhead.
+//
+// With -c, compares two such reports instead, usually one from each number
+// mode (see the phloatbench-report target in the Makefile), or from before
+// and after a change, and prints the times side by side, with the ratios.
+//
+// Usage: phloatbench [-t seconds] [-o report.tsv] [operation ...]
+//        phloatbench -c a.tsv b.tsv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "shell.h"
+#include "core_phloat.h"
+
+
+#ifdef BCD_MATH
+#define MODE_NAME "dec"
+#else
+#define MODE_NAME "bin"
+#endif
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// Operands; the kernels cycle through NOPS of them
+#define NOPS 1024
+#define STRLEN 50
+
+static phloat a[NOPS];
+static phloat b[NOPS];
+static double d[NOPS];
+static char s[NOPS][STRLEN];
+static int slen[NOPS];
+
+// Formatting parameters for phloat2string()
+static int p2s_digits;
+static int p2s_mode;
+
+// Always zero, but the compiler can't know that; see lat_##name()
+static volatile uint8 chain_mask = 0;
+
+
+// The low bits of a result, folded into a checksum, so that the compiler
+// can't drop the operations; in the latency kernels, they also select the
+// next operands
+static inline uint8 bits(bool r) { return r; }
+static inline uint8 bits(int r) { return (uint8) r; }
+static inline uint8 bits(int8 r) { return (uint8) r; }
+static inline uint8 bits(double r) {
+    uint8 u;
+    memcpy(&u, &r, sizeof(u));
+    return u;
+}
+#ifdef BCD_MATH
+static inline uint8 bits(const Phloat &r) {
+    uint8 u;
+    memcpy(&u, &r.val, sizeof(u));
+    return u;
+}
+#endif
+
+static inline int p2s(const phloat &x) {
+    char buf[STRLEN];
+    return phloat2string(x, buf, STRLEN, 0, p2s_digits, p2s_mode, 0, 12);
+}
+
+static inline phloat s2p(int j) {
+    phloat r;
+    string2phloat(s[j], slen[j], &r);
+    return r;
+}
+
+// Defines tput_<name>() and lat_<name>(), which evaluate 'expr' 'count'
+// times, with x and y (and j) set to successive operands. In the latency
+// kernel, the index of the next operands depends on the result, through
+// chain_mask, so the evaluations are serialized.
+#define BENCH(name, expr) \
+    static uint8 tput_##name(int count) { \
+        uint8 sink = 0; \
+        for (int i = 0; i < count; i++) { \
+            int j = i & (NOPS - 1); \
+            const phloat &x = a[j]; \
+            const phloat &y = b[j]; \
+            (void) x; (void) y; \
+            sink ^= bits(expr); \
+        } \
+        return sink; \
+    } \
+    static uint8 lat_##name(int count) { \
+        uint8 sink = 0; \
+        uint8 mask = chain_mask; \
+        int j = 0; \
+        for (int i = 0; i < count; i++) { \
+            const phloat &x = a[j]; \
+            const phloat &y = b[j]; \
+            (void) x; (void) y; \
+            uint8 r = bits(expr); \
+            sink ^= r; \
+            j = (int) ((i + 1 + (r & mask)) & (NOPS - 1)); \
+        } \
+        return sink; \
+    }
+
+BENCH(load, x)
+BENCH(add, x + y)
+BENCH(sub, x - y)
+BENCH(mul, x * y)
+BENCH(div, x / y)
+BENCH(neg, -x)
+BENCH(lt, x < y)
+BENCH(eq, x == y)
+BENCH(sin, sin(x))
+BENCH(cos, cos(x))
+BENCH(tan, tan(x))
+BENCH(asin, asin(x))
+BENCH(acos, acos(x))
+BENCH(atan, atan(x))
+BENCH(atan2, atan2(x, y))
+BENCH(hypot, hypot(x, y))
+BENCH(sinh, sinh(x))
+BENCH(cosh, cosh(x))
+BENCH(tanh, tanh(x))
+BENCH(asinh, asinh(x))
+BENCH(acosh, acosh(x))
+BENCH(atanh, atanh(x))
+BENCH(log, log(x))
+BENCH(log10, log10(x))
+BENCH(log1p, log1p(x))
+BENCH(exp, exp(x))
+BENCH(expm1, expm1(x))
+BENCH(sqrt, sqrt(x))
+BENCH(pow, pow(x, y))
+BENCH(tgamma, tgamma(x))
+BENCH(fmod, fmod(x, y))
+BENCH(fabs, fabs(x))
+BENCH(floor, floor(x))
+BENCH(to_int8, to_int8(x))
+BENCH(to_double, to_double(x))
+BENCH(from_double, phloat(d[j]))
+BENCH(phloat2string, p2s(x))
+BENCH(string2phloat, s2p(j))
+
+
+/* Operand distributions. These only use operations that are exact, or
+ * correctly rounded, in both number modes, so that both get the same
+ * operands, give or take the precision.
+ */
+
+// Uniform in [lo, hi), with all digits in use
+static phloat uniform(int lo, int hi) {
+    phloat u = phloat(rand() % 999983) / 999983;
+    return lo + (hi - lo) * u;
+}
+
+static phloat nonzero_int(int range) {
+    int i = rand() % (2 * range) - range;
+    return i >= 0 ? i + 1 : i;
+}
+
+// Full-precision reals, with magnitudes from 10^-range to 10^range
+static phloat wide(int range) {
+    phloat m = uniform(1, 10);
+    int e = rand() % (2 * range + 1) - range;
+    return (rand() & 1 ? m : -m) * pow(phloat(10), phloat(e));
+}
+
+enum dist_type {
+    DIST_INT, DIST_REAL, DIST_WIDE, DIST_SMALL, DIST_LARGE, DIST_UNIT,
+    DIST_MID, DIST_POS, DIST_WIDEPOS, DIST_GAMMA, DIST_GAMMAINT, DIST_POWINT,
+    DIST_FIX4, DIST_ALL
+};
+
+static void generate(int dist, const char *op) {
+    srand(1);
+    for (int i = 0; i < NOPS; i++) {
+        switch (dist) {
+            case DIST_INT:
+                // Small integers, like loop counters and indices
+                a[i] = nonzero_int(1000);
+                b[i] = nonzero_int(1000);
+                break;
+            case DIST_REAL:
+            case DIST_FIX4:
+            case DIST_ALL:
+                a[i] = uniform(-1000, 1000);
+                b[i] = uniform(-1000, 1000);
+                break;
+            case DIST_WIDE:
+                // Products and quotients still fit in a double
+                a[i] = wide(150);
+                b[i] = wide(150);
+                break;
+            case DIST_SMALL:
+                a[i] = uniform(-10, 10);
+                b[i] = uniform(-10, 10);
+                break;
+            case DIST_LARGE:
+                // Arguments that need a lot of range reduction
+                a[i] = uniform(-1000000, 1000000);
+                b[i] = uniform(-1000000, 1000000);
+                break;
+            case DIST_UNIT:
+                a[i] = uniform(-1, 1);
+                b[i] = uniform(-1, 1);
+                break;
+            case DIST_MID:
+                a[i] = uniform(-20, 20);
+                b[i] = uniform(-20, 20);
+                break;
+            case DIST_POS:
+                a[i] = uniform(0, 1000) + phloat(1) / 1000;
+                b[i] = uniform(-10, 10);
+                break;
+            case DIST_WIDEPOS:
+                a[i] = fabs(wide(300));
+                b[i] = 0;
+                break;
+            case DIST_GAMMA:
+                a[i] = uniform(0, 50) + phloat(1) / 10;
+                b[i] = 0;
+                break;
+            case DIST_GAMMAINT:
+                a[i] = rand() % 50 + 1;
+                b[i] = 0;
+                break;
+            case DIST_POWINT:
+                a[i] = uniform(-10, 10);
+                b[i] = rand() % 41 - 20;
+                break;
+        }
+    }
+    // Adjustments for functions with a restricted domain
+    for (int i = 0; i < NOPS; i++) {
+        if (strcmp(op, "pow") == 0 && dist == DIST_REAL) {
+            a[i] = fabs(a[i]) / 10;
+            b[i] = b[i] / 100;
+        } else if (strcmp(op, "acosh") == 0)
+            a[i] = fabs(a[i]) + 1;
+        else if (strcmp(op, "atanh") == 0)
+            a[i] = a[i] * 99 / 100;
+        else if (strcmp(op, "log1p") == 0)
+            a[i] = fabs(a[i]) - phloat(1) / 2;
+        d[i] = to_double(a[i]);
+        slen[i] = phloat2string(a[i], s[i], STRLEN, 0, 0, 3, 0,
+                                MAX_MANT_DIGITS);
+    }
+    p2s_digits = dist == DIST_FIX4 ? 4 : 0;
+    p2s_mode = dist == DIST_FIX4 ? 0 : 3;
+}
+
+
+struct bench_struct {
+    const char *op;
+    const char *dist_name;
+    int dist;
+    uint8 (*tput)(int count);
+    uint8 (*lat)(int count);
+};
+
+#define B(op, dist, type) { #op, dist, type, tput_##op, lat_##op }
+
+static const bench_struct benches[] = {
+    B(load, "real", DIST_REAL),
+    B(add, "int", DIST_INT),
+    B(add, "real", DIST_REAL),
+    B(add, "wide", DIST_WIDE),
+    B(sub, "int", DIST_INT),
+    B(sub, "real", DIST_REAL),
+    B(mul, "int", DIST_INT),
+    B(mul, "real", DIST_REAL),
+    B(mul, "wide", DIST_WIDE),
+    B(div, "int", DIST_INT),
+    B(div, "real", DIST_REAL),
+    B(neg, "real", DIST_REAL),
+    B(lt, "int", DIST_INT),
+    B(lt, "real", DIST_REAL),
+    B(eq, "int", DIST_INT),
+    B(eq, "real", DIST_REAL),
+    B(sin, "small", DIST_SMALL),
+    B(sin, "large", DIST_LARGE),
+    B(cos, "small", DIST_SMALL),
+    B(cos, "large", DIST_LARGE),
+    B(tan, "small", DIST_SMALL),
+    B(tan, "large", DIST_LARGE),
+    B(asin, "unit", DIST_UNIT),
+    B(acos, "unit", DIST_UNIT),
+    B(atan, "real", DIST_REAL),
+    B(atan2, "real", DIST_REAL),
+    B(hypot, "real", DIST_REAL),
+    B(hypot, "wide", DIST_WIDE),
+    B(sinh, "mid", DIST_MID),
+    B(cosh, "mid", DIST_MID),
+    B(tanh, "mid", DIST_MID),
+    B(asinh, "real", DIST_REAL),
+    B(acosh, "real", DIST_REAL),
+    B(atanh, "unit", DIST_UNIT),
+    B(log, "pos", DIST_POS),
+    B(log, "wide", DIST_WIDEPOS),
+    B(log10, "pos", DIST_POS),
+    B(log1p, "real", DIST_REAL),
+    B(exp, "mid", DIST_MID),
+    B(expm1, "mid", DIST_MID),
+    B(sqrt, "pos", DIST_POS),
+    B(sqrt, "wide", DIST_WIDEPOS),
+    B(pow, "real", DIST_REAL),
+    B(pow, "int", DIST_POWINT),
+    B(tgamma, "real", DIST_GAMMA),
+    B(tgamma, "int", DIST_GAMMAINT),
+    B(fmod, "real", DIST_REAL),
+    B(fabs, "real", DIST_REAL),
+    B(floor, "real", DIST_REAL),
+    B(to_int8, "int", DIST_INT),
+    B(to_double, "real", DIST_REAL),
+    B(from_double, "real", DIST_REAL),
+    B(phloat2string, "fix4", DIST_FIX4),
+    B(phloat2string, "all", DIST_ALL),
+    B(phloat2string, "int", DIST_INT),
+    B(string2phloat, "real", DIST_REAL),
+    B(string2phloat, "int", DIST_INT)
+};
+
+static uint8 sink;
+
+// ns per operation, running the kernel for at least 'seconds'
+static double measure(uint8 (*kernel)(int), double seconds) {
+    int count = NOPS;
+    while (true) {
+        double t = now();
+        sink ^= kernel(count);
+        t = now() - t;
+        if (t >= seconds || count >= 1 << 30)
+            return t * 1e9 / count;
+        double next = t < seconds / 100 ? count * 10.0
+                                         : count * seconds * 1.2 / t + 1;
+        count = next > 1 << 30 ? 1 << 30 : (int) next;
+    }
+}
+
+
+/* Comparison of two reports */
+
+struct result_struct {
+    char op[32];
+    char dist[32];
+    double tput, lat;
+};
+
+static int read_report(const char *name, char *mode, result_struct **res) {
+    FILE *f = fopen(name, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Can't open \"%s\"\n", name);
+        exit(2);
+    }
+    strcpy(mode, "?");
+    int n = 0, cap = 64;
+    *res = (result_struct *) malloc(cap * sizeof(result_struct));
+    char line[256];
+    while (fgets(line, 256, f) != NULL) {
+        if (line[0] == '#') {
+            sscanf(line, "# phloatbench %15s", mode);
+            continue;
+        }
+        result_struct r;
+        if (sscanf(line, "%31s %31s %lf %lf", r.op, r.dist, &r.tput, &r.lat)
+                != 4)
+            // The column header, or garbage
+            continue;
+        if (n == cap) {
+            cap *= 2;
+            *res = (result_struct *) realloc(*res, cap * sizeof(result_struct));
+        }
+        (*res)[n++] = r;
+    }
+    fclose(f);
+    return n;
+}
+
+static int compare(const char *aname, const char *bname) {
+    char amode[16], bmode[16];
+    result_struct *ares, *bres;
+    int an = read_report(aname, amode, &ares);
+    int bn = read_report(bname, bmode, &bres);
+    printf("# phloatbench comparison: a=%s (%s) b=%s (%s); ratio is a/b\n",
+            aname, amode, bname, bmode);
+    printf("op\tdist\ta_throughput_ns\tb_throughput_ns\tthroughput_ratio\t"
+           "a_latency_ns\tb_latency_ns\tlatency_ratio\n");
+    for (int i = 0; i < an; i++) {
+        const result_struct *ra = ares + i;
+        for (int j = 0; j < bn; j++) {
+            const result_struct *rb = bres + j;
+            if (strcmp(ra->op, rb->op) != 0 || strcmp(ra->dist, rb->dist) != 0)
+                continue;
+            printf("%s\t%s\t%.2f\t%.2f\t%.3f\t%.2f\t%.2f\t%.3f\n",
+                    ra->op, ra->dist, ra->tput, rb->tput,
+                    rb->tput > 0 ? ra->tput / rb->tput : 0,
+                    ra->lat, rb->lat, rb->lat > 0 ? ra->lat / rb->lat : 0);
+            break;
+        }
+    }
+    free(ares);
+    free(bres);
+    return 0;
+}
+
+
+static void usage() {
+    fprintf(stderr, "Usage: phloatbench [-t seconds] [-o report.tsv] [operation ...]\n"
+                    "       phloatbench -c a.tsv b.tsv\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = 0.1;
+    const char *outname = NULL;
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            if (i + 3 != argc)
+                usage();
+            return compare(argv[i + 1], argv[i + 2]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+            if (seconds <= 0)
+                usage();
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outname = argv[++i];
+        else
+            usage();
+    }
+    int first_op = i;
+
+    FILE *out = stdout;
+    if (outname != NULL) {
+        out = fopen(outname, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Can't write \"%s\"\n", outname);
+            return 2;
+        }
+    }
+
+    phloat_init();
+    fprintf(out, "# phloatbench %s %d digits\n", MODE_NAME, MAX_MANT_DIGITS);
+    fprintf(out, "op\tdist\tthroughput_ns\tlatency_ns\n");
+    int nbenches = sizeof(benches) / sizeof(bench_struct);
+    for (int n = 0; n < nbenches; n++) {
+        const bench_struct *bs = benches + n;
+        if (first_op < argc) {
+            bool selected = false;
+            for (i = first_op; i < argc; i++)
+                if (strcmp(argv[i], bs->op) == 0)
+                    selected = true;
+            if (!selected)
+                continue;
+        }
+        generate(bs->dist, bs->op);
+        double tput = measure(bs->tput, seconds);
+        double lat = measure(bs->lat, seconds);
+        fprintf(out, "%s\t%s\t%.2f\t%.2f\n", bs->op, bs->dist_name, tput, lat);
+        fflush(out);
+    }
+    if (out != stdout)
+        fclose(out);
+    // Keeps the kernels' results live
+    return sink == 12345 ? 3 : 0;
+}
@@ -0,0 +1,267 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+// Differential test for the small-integer fast path in the Phloat operators
+// (see core_phloat.cc). Applies the constructors, + - *, the compound and
+// increment operators, and the comparisons, to random operands, and checks
+// that every result is bit-for-bit what the corresponding bid128_* call
+// returns. The operands are built by the library, and mix small integers,
+// integers at the 32- and 64-bit boundaries, integers that don't have an
+// exponent of 0 or don't fit in 64 bits, non-integers, signed zeros,
+// infinities, and NaN. Only the decimal build has a fast path to test.
+//
+// Usage: phloatdiff [iterations [seed]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shell.h"
+#include "core_phloat.h"
+
+
+#ifndef BCD_MATH
+
+int main(int argc, char *argv[]) {
+    printf("phloatdiff: nothing to test in the binary build\n");
+    return 0;
+}
+
+#else
+
+static uint8 rng_state = 88172645463325252ULL;
+
+// xorshift64*; rand() doesn't give 64 bits everywhere
+static uint8 rng() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+static BID_UINT128 from_uint8(uint8 c, bool neg) {
+    BID_UINT128 r, n;
+    bid128_from_uint64(&r, &c);
+    if (!neg)
+        return r;
+    bid128_negate(&n, &r);
+    return n;
+}
+
+static BID_UINT128 from_string(const char *s) {
+    BID_UINT128 r;
+    bid128_from_string(&r, (char *) s);
+    return r;
+}
+
+static BID_UINT128 random_operand() {
+    bool neg = (rng() & 1) != 0;
+    char buf[64];
+    switch (rng() % 10) {
+        case 0:
+        case 1:
+            return from_uint8(rng() % 21, neg);
+        case 2:
+            return from_uint8(0xffffffffULL + rng() % 5 - 2, neg);
+        case 3:
+            return from_uint8(0xffffffffffffffffULL - rng() % 5, neg);
+        case 4:
+            return from_uint8(rng() >> (rng() % 64), neg);
+        case 5:
+            // Integers that don't fit in 64 bits
+            snprintf(buf, 64, "%s%llu%03d", neg ? "-" : "",
+                     (unsigned long long) (rng() >> 1), (int) (rng() % 1000));
+            return from_string(buf);
+        case 6:
+            // Integers, and zeros, with a nonzero exponent
+            snprintf(buf, 64, "%s%dE%d", neg ? "-" : "",
+                     (int) (rng() % 100), (int) (rng() % 5) - 2);
+            return from_string(buf);
+        case 7:
+            snprintf(buf, 64, "%s%d.%d", neg ? "-" : "",
+                     (int) (rng() % 100), (int) (rng() % 1000));
+            return from_string(buf);
+        case 8:
+            switch (rng() % 4) {
+                case 0: return from_string(neg ? "-Inf" : "+Inf");
+                case 1: return from_string("NaN");
+                case 2: return POS_HUGE_PHLOAT.val;
+                default: return NEG_TINY_PHLOAT.val;
+            }
+        default:
+            return from_uint8(0, neg);
+    }
+}
+
+static int checks;
+static int failures;
+
+static void print_bid(const char *label, const BID_UINT128 &b) {
+    char buf[100];
+    bid128_to_string(buf, (BID_UINT128 *) &b);
+    printf(" %s=%s (%016llx %016llx)", label, buf,
+           (unsigned long long) b.w[BID_HIGH_128W],
+           (unsigned long long) b.w[BID_LOW_128W]);
+}
+
+static void check(const char *op, const BID_UINT128 &x, const BID_UINT128 &y,
+                  const BID_UINT128 &got, const BID_UINT128 &want) {
+    checks++;
+    if (memcmp(&got, &want, sizeof(BID_UINT128)) == 0)
+        return;
+    if (failures++ < 20) {
+        printf("%s:", op);
+        print_bid("x", x);
+        print_bid("y", y);
+        print_bid("got", got);
+        print_bid("want", want);
+        printf("\n");
+    }
+}
+
+static void check_bool(const char *op, const BID_UINT128 &x,
+                       const BID_UINT128 &y, bool got, int want) {
+    checks++;
+    if (got == (want != 0))
+        return;
+    if (failures++ < 20) {
+        printf("%s:", op);
+        print_bid("x", x);
+        print_bid("y", y);
+        printf(" got=%d\n", (int) got);
+    }
+}
+
+static void test_binary(const BID_UINT128 &xb, const BID_UINT128 &yb) {
+    BID_UINT128 xv = xb, yv = yb, want;
+    Phloat x(xb), y(yb), r;
+    int w;
+
+    bid128_add(&want, &xv, &yv);
+    check("x+y", xb, yb, (x + y).val, want);
+    r = x;
+    r += y;
+    check("x+=y", xb, yb, r.val, want);
+
+    bid128_sub(&want, &xv, &yv);
+    check("x-y", xb, yb, (x - y).val, want);
+    r = x;
+    r -= y;
+    check("x-=y", xb, yb, r.val, want);
+
+    bid128_mul(&want, &xv, &yv);
+    check("x*y", xb, yb, (x * y).val, want);
+    r = x;
+    r *= y;
+    check("x*=y", xb, yb, r.val, want);
+
+    bid128_quiet_equal(&w, &xv, &yv);
+    check_bool("x==y", xb, yb, x == y, w);
+    bid128_quiet_not_equal(&w, &xv, &yv);
+    check_bool("x!=y", xb, yb, x != y, w);
+    bid128_quiet_less(&w, &xv, &yv);
+    check_bool("x<y", xb, yb, x < y, w);
+    bid128_quiet_less_equal(&w, &xv, &yv);
+    check_bool("x<=y", xb, yb, x <= y, w);
+    bid128_quiet_greater(&w, &xv, &yv);
+    check_bool("x>y", xb, yb, x > y, w);
+    bid128_quiet_greater_equal(&w, &xv, &yv);
+    check_bool("x>=y", xb, yb, x >= y, w);
+}
+
+static void test_unary(const BID_UINT128 &xb) {
+    BID_UINT128 xv = xb, one, inc, dec, none;
+    int ione = 1;
+    bid128_from_int32(&one, &ione);
+    bid128_add(&inc, &xv, &one);
+    bid128_sub(&dec, &xv, &one);
+    memset(&none, 0, sizeof(none));
+
+    Phloat x(xb), r;
+    r = x;
+    check("++x", xb, none, (++r).val, inc);
+    r = x;
+    check("x++ result", xb, none, (r++).val, xb);
+    check("x++", xb, none, r.val, inc);
+    r = x;
+    check("--x", xb, none, (--r).val, dec);
+    r = x;
+    check("x-- result", xb, none, (r--).val, xb);
+    check("x--", xb, none, r.val, dec);
+}
+
+static void test_int(int i, int8 l, uint8 u, const BID_UINT128 &yb) {
+    BID_UINT128 want, ib, yv = yb;
+    bid128_from_int32(&ib, &i);
+    check("Phloat(int)", ib, yb, Phloat(i).val, ib);
+    Phloat r;
+    r = i;
+    check("=int", ib, yb, r.val, ib);
+    bid128_from_int64(&want, &l);
+    check("Phloat(int8)", want, yb, Phloat(l).val, want);
+    r = l;
+    check("=int8", want, yb, r.val, want);
+    bid128_from_uint64(&want, &u);
+    check("Phloat(uint8)", want, yb, Phloat(u).val, want);
+    r = u;
+    check("=uint8", want, yb, r.val, want);
+
+    Phloat y(yb);
+    bid128_mul(&want, &ib, &yv);
+    check("int*y", ib, yb, (i * y).val, want);
+    bid128_add(&want, &ib, &yv);
+    check("int+y", ib, yb, (i + y).val, want);
+    bid128_sub(&want, &ib, &yv);
+    check("int-y", ib, yb, (i - y).val, want);
+    int w;
+    bid128_quiet_equal(&w, &ib, &yv);
+    check_bool("int==y", ib, yb, (int4) i == y, w);
+}
+
+static int random_int() {
+    switch (rng() % 4) {
+        case 0: return (int) (rng() % 21) - 10;
+        case 1: return (int) (rng() % 2 ? 2147483647 : -2147483647 - 1);
+        default: return (int) rng();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    if (argc > 2)
+        rng_state = strtoull(argv[2], NULL, 10) | 1;
+    if (iterations <= 0 || argc > 3) {
+        fprintf(stderr, "Usage: phloatdiff [iterations [seed]]\n");
+        return 2;
+    }
+
+    phloat_init();
+    for (int n = 0; n < iterations; n++) {
+        BID_UINT128 x = random_operand();
+        BID_UINT128 y = random_operand();
+        test_binary(x, y);
+        test_binary(x, x);
+        test_unary(x);
+        int8 l = (int8) rng() >> (rng() % 64);
+        test_int(random_int(), n % 7 == 0 ? -l : l, rng() >> (rng() % 64), y);
+    }
+
+    printf("%d checks, %d mismatches\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
+
+#endif
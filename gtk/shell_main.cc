@@ -26,6 +26,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <unistd.h>
@@ -1028,6 +1029,10 @@ static int write_shell_state() {
 
 static void int_term_handler(int sig) {
     write(pype[1], "1\n", 2);
+    /* Make a running program yield right away, so the pipe watch gets
+     * dispatched without waiting for the end of the run slice.
+     */
+    core_request_interrupt();
 }
 
 static gboolean gt_signal_handler(GIOChannel *source, GIOCondition condition,
@@ -3055,9 +3060,11 @@ int8 shell_random_seed() {
 }
 
 uint4 shell_milliseconds() {
-    struct timeval tv;               
-    gettimeofday(&tv, NULL);
-    return (uint4) (tv.tv_sec * 1000L + tv.tv_usec / 1000);
+    // Monotonic, so the core's run slice deadlines and other elapsed-time
+    // measurements don't jump when the system clock is set.
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint4) (ts.tv_sec * 1000L + ts.tv_nsec / 1000000);
 }
 
 int shell_decimal_point() {
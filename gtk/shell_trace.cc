@@ -0,0 +1,589 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shell_trace.h"
+#include "core_display.h"
+#include "core_main.h"
+
+
+// Trace file format: the magic number "F42T", a format version byte, and the
+// arguments for core_init(), followed by the state file contents; then the
+// events, each a type byte, the logical time since the previous event in
+// milliseconds, the event's arguments, and the number of program steps the
+// call executed. All numbers are unsigned LEB128 varints, and strings and
+// file contents are a length followed by the bytes. The last event is
+// TR_END, with the checksum of the final state.
+
+#define TRACE_MAGIC "F42T"
+#define TRACE_FORMAT 1
+
+enum {
+    TR_KEYDOWN = 1,
+    TR_COMMAND,
+    TR_KEYUP,
+    TR_REPEAT,
+    TR_TIMEOUT1,
+    TR_TIMEOUT2,
+    TR_TIMEOUT3,
+    TR_RUN,
+    TR_POWERCYCLE,
+    TR_PASTE,
+    TR_IMPORT,
+    TR_REDISPLAY,
+    TR_SETTINGS,
+    TR_END
+};
+
+// The fixed clock and random seed: 2020-01-01, a Wednesday, at noon
+#define TRACE_SEED 20200101120000LL
+#define TRACE_TIME 12000000
+#define TRACE_DATE 20200101
+#define TRACE_WEEKDAY 3
+
+enum { TRACE_OFF, TRACE_RECORD, TRACE_REPLAY };
+
+static int trace_mode = TRACE_OFF;
+static FILE *trace_file;
+static uint4 logical_millis;
+static uint8 record_start;
+static uint8 replay_target;
+
+static uint8 monotonic_nanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Saves the core state to a scratch file, and returns its FNV-1a hash. The
+// shell_platform() string near the start is skipped, so a trace recorded by
+// one shell can be checked by another.
+static uint8 state_checksum() {
+    char name[] = "/tmp/free42trace.XXXXXX";
+    int fd = mkstemp(name);
+    if (fd == -1)
+        return 0;
+    close(fd);
+    core_save_state(name);
+    uint8 h = 14695981039346656037ULL;
+    FILE *f = fopen(name, "rb");
+    if (f != NULL) {
+        // Magic number and version, then the nul-terminated platform
+        int c, pos = 0;
+        while ((c = getc(f)) != EOF) {
+            if (pos < 8) {
+                pos++;
+            } else if (pos == 8) {
+                if (c == 0)
+                    pos++;
+                continue;
+            }
+            h ^= (unsigned char) c;
+            h *= 1099511628211ULL;
+        }
+        fclose(f);
+    }
+    unlink(name);
+    return h;
+}
+
+
+/* Recording */
+
+static void put_varint(uint8 n) {
+    while (n >= 0x80) {
+        putc((int) (n & 0x7f) | 0x80, trace_file);
+        n >>= 7;
+    }
+    putc((int) n, trace_file);
+}
+
+static void put_bytes(const char *buf, size_t len) {
+    put_varint(len);
+    fwrite(buf, 1, len, trace_file);
+}
+
+static bool recording() {
+    return trace_mode == TRACE_RECORD;
+}
+
+static uint8 event_steps;
+
+static void begin_event(int type) {
+    uint4 now = (uint4) ((monotonic_nanos() - record_start) / 1000000);
+    putc(type, trace_file);
+    put_varint(now - logical_millis);
+    logical_millis = now;
+    event_steps = core_program_steps();
+}
+
+static void end_event() {
+    put_varint(core_program_steps() - event_steps);
+}
+
+bool trace_record_start(const char *file_name, int read_state, int4 version,
+                        const char *state_file_name, int offset) {
+    trace_file = fopen(file_name, "wb");
+    if (trace_file == NULL)
+        return false;
+    char *state = NULL;
+    size_t state_len = 0;
+    if (read_state == 1) {
+        FILE *f = fopen(state_file_name, "rb");
+        if (f != NULL) {
+            fseek(f, 0, SEEK_END);
+            long size = ftell(f) - offset;
+            if (size > 0 && (state = (char *) malloc(size)) != NULL) {
+                fseek(f, offset, SEEK_SET);
+                state_len = fread(state, 1, size, f);
+            }
+            fclose(f);
+        }
+        if (state_len == 0)
+            read_state = 0;
+    }
+    fwrite(TRACE_MAGIC, 1, 4, trace_file);
+    putc(TRACE_FORMAT, trace_file);
+    put_varint(read_state);
+    put_varint(version);
+    put_bytes(state, state_len);
+    free(state);
+    trace_mode = TRACE_RECORD;
+    record_start = monotonic_nanos();
+    logical_millis = 0;
+    return true;
+}
+
+void trace_record_end() {
+    if (!recording())
+        return;
+    begin_event(TR_END);
+    uint8 sum = state_checksum();
+    for (int i = 0; i < 8; i++)
+        putc((int) (sum >> (i * 8)) & 255, trace_file);
+    fclose(trace_file);
+    trace_file = NULL;
+    trace_mode = TRACE_OFF;
+}
+
+bool trace_active() {
+    return trace_mode != TRACE_OFF;
+}
+
+int8 trace_random_seed() {
+    return TRACE_SEED;
+}
+
+void trace_time_date(uint4 *time, uint4 *date, int *weekday) {
+    if (time != NULL)
+        *time = TRACE_TIME;
+    if (date != NULL)
+        *date = TRACE_DATE;
+    if (weekday != NULL)
+        *weekday = TRACE_WEEKDAY;
+}
+
+uint4 trace_milliseconds() {
+    return logical_millis;
+}
+
+int trace_wants_cpu() {
+    // Only meaningful while replaying; see replay_event()
+    return core_program_steps() >= replay_target;
+}
+
+int traced_keydown(int key, int *enqueued, int *repeat) {
+    if (!recording())
+        return core_keydown(key, enqueued, repeat);
+    begin_event(TR_KEYDOWN);
+    put_varint(key);
+    int ret = core_keydown(key, enqueued, repeat);
+    end_event();
+    return ret;
+}
+
+int traced_keydown_command(const char *name, int *enqueued, int *repeat) {
+    if (!recording())
+        return core_keydown_command(name, enqueued, repeat);
+    begin_event(TR_COMMAND);
+    put_bytes(name, strlen(name));
+    int ret = core_keydown_command(name, enqueued, repeat);
+    end_event();
+    return ret;
+}
+
+int traced_keyup() {
+    if (!recording())
+        return core_keyup();
+    begin_event(TR_KEYUP);
+    int ret = core_keyup();
+    end_event();
+    return ret;
+}
+
+int traced_repeat() {
+    if (!recording())
+        return core_repeat();
+    begin_event(TR_REPEAT);
+    int ret = core_repeat();
+    end_event();
+    return ret;
+}
+
+void traced_keytimeout1() {
+    if (!recording()) {
+        core_keytimeout1();
+        return;
+    }
+    begin_event(TR_TIMEOUT1);
+    core_keytimeout1();
+    end_event();
+}
+
+void traced_keytimeout2() {
+    if (!recording()) {
+        core_keytimeout2();
+        return;
+    }
+    begin_event(TR_TIMEOUT2);
+    core_keytimeout2();
+    end_event();
+}
+
+bool traced_timeout3(int repaint) {
+    if (!recording())
+        return core_timeout3(repaint);
+    begin_event(TR_TIMEOUT3);
+    put_varint(repaint);
+    bool ret = core_timeout3(repaint);
+    end_event();
+    return ret;
+}
+
+int traced_run() {
+    int enqueued, repeat;
+    if (!recording())
+        return core_keydown(0, &enqueued, &repeat);
+    begin_event(TR_RUN);
+    int ret = core_keydown(0, &enqueued, &repeat);
+    end_event();
+    return ret;
+}
+
+int traced_powercycle() {
+    if (!recording())
+        return core_powercycle();
+    begin_event(TR_POWERCYCLE);
+    int ret = core_powercycle();
+    end_event();
+    return ret;
+}
+
+void traced_paste(const char *text) {
+    if (!recording()) {
+        core_paste(text);
+        return;
+    }
+    begin_event(TR_PASTE);
+    put_bytes(text, strlen(text));
+    core_paste(text);
+    end_event();
+}
+
+void traced_import(const char *file_name) {
+    if (!recording()) {
+        core_import_programs(0, file_name);
+        return;
+    }
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *f = fopen(file_name, "rb");
+    if (f != NULL) {
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        if (size > 0 && (buf = (char *) malloc(size)) != NULL)
+            len = fread(buf, 1, size, f);
+        fclose(f);
+    }
+    begin_event(TR_IMPORT);
+    put_bytes(buf, len);
+    free(buf);
+    core_import_programs(0, file_name);
+    end_event();
+}
+
+void traced_redisplay() {
+    if (!recording()) {
+        redisplay();
+        return;
+    }
+    begin_event(TR_REDISPLAY);
+    redisplay();
+    end_event();
+}
+
+void traced_settings() {
+    if (!recording())
+        return;
+    begin_event(TR_SETTINGS);
+    put_varint(core_settings.matrix_singularmatrix
+                | core_settings.matrix_outofrange << 1
+                | core_settings.auto_repeat << 2);
+    end_event();
+}
+
+
+/* Replay */
+
+struct trace_reader {
+    const unsigned char *p;
+    const unsigned char *end;
+    bool error;
+};
+
+static uint8 get_varint(trace_reader *r) {
+    uint8 n = 0;
+    int shift = 0;
+    while (true) {
+        if (r->p == r->end || shift > 63) {
+            r->error = true;
+            return 0;
+        }
+        int c = *r->p++;
+        n |= (uint8) (c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return n;
+        shift += 7;
+    }
+}
+
+// Returns a malloc()ed, nul-terminated copy of a string or file contents
+static char *get_bytes(trace_reader *r, size_t *len) {
+    uint8 n = get_varint(r);
+    if (r->error || n > (uint8) (r->end - r->p)) {
+        r->error = true;
+        return NULL;
+    }
+    char *buf = (char *) malloc(n + 1);
+    if (buf == NULL) {
+        r->error = true;
+        return NULL;
+    }
+    memcpy(buf, r->p, n);
+    buf[n] = 0;
+    r->p += n;
+    if (len != NULL)
+        *len = n;
+    return buf;
+}
+
+// Writes 'buf' to a scratch file, whose name is returned in 'name'
+static bool write_scratch(char *name, const char *buf, size_t len) {
+    strcpy(name, "/tmp/free42trace.XXXXXX");
+    int fd = mkstemp(name);
+    if (fd == -1)
+        return false;
+    bool ok = write(fd, buf, len) == (ssize_t) len;
+    close(fd);
+    return ok;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Runs one event, and returns how long the call took, in microseconds, in
+// 'micros'. Returns false at TR_END, or on error.
+static bool replay_event(trace_reader *r, int type, trace_stats *stats,
+                         double *micros) {
+    int enqueued, repeat;
+    char *text = NULL;
+    size_t len;
+    uint8 arg = 0;
+
+    // Read the arguments first, so only the call itself gets timed
+    switch (type) {
+        case TR_KEYDOWN:
+        case TR_TIMEOUT3:
+        case TR_SETTINGS:
+            arg = get_varint(r);
+            break;
+        case TR_COMMAND:
+        case TR_PASTE:
+        case TR_IMPORT:
+            text = get_bytes(r, &len);
+            break;
+        case TR_END:
+            stats->recorded_checksum = 0;
+            for (int i = 0; i < 8 && r->p < r->end; i++)
+                stats->recorded_checksum |= (uint8) *r->p++ << (i * 8);
+            return false;
+    }
+    char scratch[32] = "";
+    if (type == TR_IMPORT && text != NULL && !write_scratch(scratch, text, len))
+        r->error = true;
+    uint8 steps = get_varint(r);
+    if (r->error) {
+        free(text);
+        return false;
+    }
+
+    // Let programs run for exactly as many steps as they did when recorded;
+    // continue_running() checks shell_wants_cpu() after that many, plus one
+    uint8 steps_before = core_program_steps();
+    replay_target = steps_before + steps;
+    core_settings.run_slice_instructions = steps >= 0x7ffffffe ? 0x7fffffff : (int) steps + 1;
+
+    uint8 start = monotonic_nanos();
+    switch (type) {
+        case TR_KEYDOWN: core_keydown((int) arg, &enqueued, &repeat); break;
+        case TR_COMMAND: core_keydown_command(text, &enqueued, &repeat); break;
+        case TR_KEYUP: core_keyup(); break;
+        case TR_REPEAT: core_repeat(); break;
+        case TR_TIMEOUT1: core_keytimeout1(); break;
+        case TR_TIMEOUT2: core_keytimeout2(); break;
+        case TR_TIMEOUT3: core_timeout3((int) arg); break;
+        case TR_RUN: core_keydown(0, &enqueued, &repeat); break;
+        case TR_POWERCYCLE: core_powercycle(); break;
+        case TR_PASTE: core_paste(text); break;
+        case TR_IMPORT: core_import_programs(0, scratch); break;
+        case TR_REDISPLAY: redisplay(); break;
+        case TR_SETTINGS:
+            core_settings.matrix_singularmatrix = (arg & 1) != 0;
+            core_settings.matrix_outofrange = (arg & 2) != 0;
+            core_settings.auto_repeat = (arg & 4) != 0;
+            break;
+        default:
+            fprintf(stderr, "Unknown trace event type %d\n", type);
+            r->error = true;
+            break;
+    }
+    *micros = (monotonic_nanos() - start) / 1000.0;
+
+    core_settings.run_slice_instructions = 0;
+    free(text);
+    if (scratch[0] != 0)
+        unlink(scratch);
+    if (r->error)
+        return false;
+    if (core_program_steps() != replay_target) {
+        fprintf(stderr, "Replay diverged at event %d: %llu steps, recorded %llu\n",
+                stats->events,
+                (unsigned long long) (core_program_steps() - steps_before),
+                (unsigned long long) steps);
+        r->error = true;
+        return false;
+    }
+
+    stats->events++;
+    return true;
+}
+
+bool trace_replay(const char *file_name, trace_stats *stats) {
+    FILE *f = fopen(file_name, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Can't open \"%s\"\n", file_name);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *buf = (unsigned char *) malloc(size > 0 ? size : 1);
+    if (buf == NULL || fread(buf, 1, size, f) != (size_t) size) {
+        fprintf(stderr, "Can't read \"%s\"\n", file_name);
+        free(buf);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+
+    trace_reader r;
+    r.p = buf;
+    r.end = buf + size;
+    r.error = false;
+    if (size < 5 || memcmp(buf, TRACE_MAGIC, 4) != 0 || buf[4] != TRACE_FORMAT) {
+        fprintf(stderr, "\"%s\" is not a Free42 trace\n", file_name);
+        free(buf);
+        return false;
+    }
+    r.p += 5;
+    int read_state = (int) get_varint(&r);
+    int4 version = (int4) get_varint(&r);
+    size_t state_len;
+    char *state = get_bytes(&r, &state_len);
+    char state_name[32];
+    if (r.error || read_state == 1 && !write_scratch(state_name, state, state_len)) {
+        fprintf(stderr, "Can't read the initial state from \"%s\"\n", file_name);
+        free(state);
+        free(buf);
+        return false;
+    }
+    free(state);
+
+    memset(stats, 0, sizeof(trace_stats));
+    trace_mode = TRACE_REPLAY;
+    logical_millis = 0;
+    core_init(read_state, version, read_state == 1 ? state_name : NULL, 0);
+    if (read_state == 1)
+        unlink(state_name);
+
+    int cap = 1024;
+    double *latencies = (double *) malloc(cap * sizeof(double));
+    bool ended = false;
+    uint8 start = monotonic_nanos();
+    while (r.p < r.end) {
+        int type = *r.p++;
+        logical_millis += (uint4) get_varint(&r);
+        double micros;
+        if (!replay_event(&r, type, stats, &micros)) {
+            ended = !r.error && type == TR_END;
+            break;
+        }
+        if (stats->events > cap) {
+            cap *= 2;
+            latencies = (double *) realloc(latencies, cap * sizeof(double));
+        }
+        latencies[stats->events - 1] = micros;
+    }
+    stats->seconds = (monotonic_nanos() - start) / 1e9;
+    if (ended)
+        stats->checksum = state_checksum();
+    else
+        fprintf(stderr, "\"%s\" is truncated or corrupt\n", file_name);
+
+    if (stats->events > 0) {
+        qsort(latencies, stats->events, sizeof(double), compare_doubles);
+        int n = stats->events;
+        stats->p50 = latencies[(n - 1) * 50 / 100];
+        stats->p90 = latencies[(n - 1) * 90 / 100];
+        stats->p99 = latencies[(n - 1) * 99 / 100];
+        stats->max = latencies[n - 1];
+    }
+    free(latencies);
+    free(buf);
+    core_cleanup();
+    trace_mode = TRACE_OFF;
+    return ended;
+}
@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+// Free42 -- an HP-42S calculator simulator
+// Copyright (C) 2004-2020  Thomas Okken
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License, version 2,
+// as published by the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see http://www.gnu.org/licenses/.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef SHELL_TRACE_H
+#define SHELL_TRACE_H 1
+
+#include "free42.h"
+
+// Session recording and replay, for reproducible end-to-end benchmarks.
+//
+// While recording, every call the shell makes into the core that can change
+// its state goes through one of the traced_*() functions below, which log
+// the call, with its logical timestamp, to a trace file, and then make it.
+// The trace starts with a copy of the state the core was initialized from,
+// and ends with a checksum of the state it was left in.
+// Replaying runs the same calls, in the same order, as fast as possible, and
+// reports how long that took, the latency of the individual calls, and
+// whether the final state matches.
+//
+// To make that deterministic, a program that was running is run for exactly
+// as many steps as it ran during recording (see core_program_steps()). While
+// a trace is being recorded or replayed, the shell must take
+// shell_random_seed(), shell_get_time_date(), and shell_milliseconds() from
+// trace_random_seed(), trace_time_date(), and trace_milliseconds(): the seed
+// and clock are fixed, and milliseconds are logical, advancing only from one
+// call to the next. While replaying, shell_wants_cpu() must return
+// trace_wants_cpu().
+//
+// All of this runs on the thread that runs the calculator.
+
+// Starts recording to 'file_name'; the arguments after it are those about to
+// be passed to core_init(). Returns false if the trace can't be written.
+bool trace_record_start(const char *file_name, int read_state, int4 version,
+                        const char *state_file_name, int offset);
+// Ends the recording, saving the checksum of the current core state
+void trace_record_end();
+
+// True while recording or replaying
+bool trace_active();
+int8 trace_random_seed();
+void trace_time_date(uint4 *time, uint4 *date, int *weekday);
+uint4 trace_milliseconds();
+int trace_wants_cpu();
+
+// The core calls, as recorded. traced_run() is core_keydown(0, ...), that is,
+// a slice of a running program or interruptible function; traced_import()
+// records the contents of the file, not its name.
+int traced_keydown(int key, int *enqueued, int *repeat);
+int traced_keydown_command(const char *name, int *enqueued, int *repeat);
+int traced_keyup();
+int traced_repeat();
+void traced_keytimeout1();
+void traced_keytimeout2();
+bool traced_timeout3(int repaint);
+int traced_run();
+int traced_powercycle();
+void traced_paste(const char *text);
+void traced_import(const char *file_name);
+void traced_redisplay();
+// Records the shell's settings in core_settings; call after changing them
+void traced_settings();
+
+// Per-run results of a replay
+typedef struct {
+    int events;
+    double seconds;                 // wall-clock time for the whole trace
+    double p50, p90, p99, max;      // per-event latency, in microseconds
+    uint8 checksum;                 // of the final state
+    uint8 recorded_checksum;        // as saved in the trace
+} trace_stats;
+
+// Initializes the core from the trace, replays it, and cleans up the core
+// afterwards. Returns false, with a message on stderr, if the trace can't be
+// read.
+bool trace_replay(const char *file_name, trace_stats *stats);
+
+#endif